@@ -1,41 +1,475 @@
 #include "App.h"
 #include "CallbackSingleton.h"
+#include "frametiming.h"
+#include "pagedworld.h"
+#include "rules.h"
+#include "snapshot.h"
+#include "stepscheduler.h"
+#include "threadpool.h"
+#include "worldstats.h"
 
 #include <array>
 #include <algorithm>
 #include <iostream>
-#include <numeric>
+#include <fstream>
 #include <random>
+#include <sstream>
 #include <thread>
 #include <vector>
 
 
+namespace {
+	GLenum glCellFormat(voxel::CellFormat format) {
+		switch (format) {
+		case voxel::CellFormat::R8UI:	return GL_R8UI;
+		case voxel::CellFormat::R16UI:	return GL_R16UI;
+		default:						return GL_R32UI;
+		}
+	}
+
+	const char* glslCellFormat(voxel::CellFormat format) {
+		switch (format) {
+		case voxel::CellFormat::R8UI:	return "r8ui";
+		case voxel::CellFormat::R16UI:	return "r16ui";
+		default:						return "r32ui";
+		}
+	}
+
+	// rules::orderTable as the ivec2 list of particlesim.comp's lateralOrders, so the shader can't drift from the CPU
+	std::string glslLateralOrders() {
+		std::ostringstream list;
+		for (int i = 0; i < rules::orderCount; i++)
+			for (int j = 0; j < 9; j++)
+				list << (i || j ? ", " : "") << "ivec2(" << int(rules::orderTable.orders[i].x[j]) << ", " << int(rules::orderTable.orders[i].z[j]) << ")";
+
+		return list.str();
+	}
+
+	GLenum glCellType(voxel::CellFormat format) {
+		switch (format) {
+		case voxel::CellFormat::R8UI:	return GL_UNSIGNED_BYTE;
+		case voxel::CellFormat::R16UI:	return GL_UNSIGNED_SHORT;
+		default:						return GL_UNSIGNED_INT;
+		}
+	}
+
+
+	// compile a shader file with #defines inserted after its #version line, errors are printed and left for linking to fail
+	GLuint createShader(const char* path, GLenum type, const std::string& defines) {
+		std::ifstream file(path);
+		std::stringstream source;
+		source << file.rdbuf();
+
+		std::string text = source.str();
+		const size_t versionEnd = text.compare(0, 8, "#version") == 0 ? text.find('\n') + 1 : 0;
+		text.insert(versionEnd, defines);
+
+		GLuint shader = glCreateShader(type);
+		const GLchar* sourcePointer = text.c_str();
+		glShaderSource(shader, 1, &sourcePointer, NULL);
+		glCompileShader(shader);
+
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled) {
+			GLint logLength = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<GLchar> log(std::max(logLength, 1));
+			glGetShaderInfoLog(shader, GLsizei(log.size()), NULL, log.data());
+			std::cout << path << ": " << log.data() << std::endl;
+		}
+
+		return shader;
+	}
+
+
+	// GL_TIME_ELAPSED queries for a ring of frames, results are read once the GPU has them instead of waiting every frame
+	class GLTimerClock : public PhaseClock {
+	public:
+		GLTimerClock(int phases, int frames) :
+			phases(phases),
+			frames(frames),
+			queries(size_t(phases) * frames),
+			measured(frames) {
+			glGenQueries(GLsizei(queries.size()), queries.data());
+		}
+
+		~GLTimerClock() {
+			glDeleteQueries(GLsizei(queries.size()), queries.data());
+		}
+
+		void begin(int phase) override {
+			glBeginQuery(GL_TIME_ELAPSED, query(current, phase));
+			measured[current].push_back(phase);
+		}
+
+		void end(int phase) override {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+
+		void endFrame() override {
+			current = (current + 1) % frames;
+			inFlight++;
+
+			// the ring is full, wait on the oldest frame rather than reuse its queries
+			if (inFlight == frames)
+				retire(true);
+		}
+
+		void collect(FrameTimings& timings) override {
+			while (inFlight > 0 && retire(false));
+			hand(timings);
+		}
+
+		void flush(FrameTimings& timings) override {
+			while (inFlight > 0)
+				retire(true);
+			hand(timings);
+		}
+
+	private:
+		const int phases, frames;
+		std::vector<GLuint> queries;
+		std::vector<std::vector<int>> measured;		// phases begun in each frame of the ring
+		std::vector<std::pair<int, uint64_t>> finished;
+		int current = 0, inFlight = 0;
+
+		GLuint query(int frame, int phase) const {
+			return queries[size_t(frame) * phases + phase];
+		}
+
+		bool retire(bool wait) {
+			const int frame = (current + frames - inFlight) % frames;
+
+			// queries finish in order, the frame's last one tells if all are ready
+			if (!wait && !measured[frame].empty()) {
+				GLint available = 0;
+				glGetQueryObjectiv(query(frame, measured[frame].back()), GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available)
+					return false;
+			}
+
+			for (int phase : measured[frame]) {
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query(frame, phase), GL_QUERY_RESULT, &elapsed);
+				finished.emplace_back(phase, elapsed);
+			}
+
+			measured[frame].clear();
+			inFlight--;
+			return true;
+		}
+
+		void hand(FrameTimings& timings) {
+			for (const auto& result : finished)
+				timings.add(result.first, result.second);
+			finished.clear();
+		}
+	};
+
+
+	// write a block of cells to the grid texture and mark the occupancy bricks it fills
+	template<typename Cell>
+	void uploadCells(const Cell* cells, const int origin[3], const int size[3], GLuint gridTexture, GLuint occupancyTexture, GLuint brickShift, std::vector<GLubyte>& bricks) {
+		int brickOrigin[3], brickSize[3];
+		for (int a = 0; a < 3; a++) {
+			brickOrigin[a] = origin[a] >> brickShift;
+			brickSize[a] = (size[a] + (1 << brickShift) - 1) >> brickShift;
+		}
+
+		glTextureSubImage3D(gridTexture, 0, origin[0], origin[1], origin[2], size[0], size[1], size[2], GL_RED_INTEGER, glCellType(voxel::CellTraits<Cell>::format), cells);
+
+		bricks.assign(size_t(brickSize[0]) * brickSize[1] * brickSize[2], 0);
+		for (int z = 0; z < size[2]; z++)
+			for (int y = 0; y < size[1]; y++)
+				for (int x = 0; x < size[0]; x++)
+					if (voxel::type(cells[(size_t(z) * size[1] + y) * size[0] + x]) != voxel::AIR)
+						bricks[((z >> brickShift) * brickSize[1] + (y >> brickShift)) * brickSize[0] + (x >> brickShift)] = 1;
+
+		glTextureSubImage3D(occupancyTexture, 0, brickOrigin[0], brickOrigin[1], brickOrigin[2], brickSize[0], brickSize[1], brickSize[2], GL_RED_INTEGER, GL_UNSIGNED_BYTE, bricks.data());
+	}
+
+	// stream a snapshot into the grid texture and occupancy bricks, only one chunk is decoded at a time
+	template<typename Cell>
+	bool uploadSnapshot(const SnapshotReader& reader, GLuint gridTexture, GLuint occupancyTexture, GLuint brickShift) {
+		const snapshot::Layout& layout = reader.layout();
+		const GLenum type = glCellType(voxel::CellTraits<Cell>::format);
+
+		std::vector<Cell> cells(size_t(snapshot::chunkDim) * snapshot::chunkDim * snapshot::chunkDim);
+		std::vector<GLubyte> bricks;
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		for (int chunk = 0; chunk < layout.chunkCount(); chunk++) {
+			int origin[3], size[3], brickOrigin[3], brickSize[3];
+			layout.chunkExtent(chunk, origin, size);
+			for (int a = 0; a < 3; a++) {
+				brickOrigin[a] = origin[a] >> brickShift;
+				brickSize[a] = (size[a] + (1 << brickShift) - 1) >> brickShift;
+			}
+
+			// all air chunks are cleared without decoding
+			if (reader.chunkEmpty(chunk)) {
+				glClearTexSubImage(gridTexture, 0, origin[0], origin[1], origin[2], size[0], size[1], size[2], GL_RED_INTEGER, type, NULL);
+				glClearTexSubImage(occupancyTexture, 0, brickOrigin[0], brickOrigin[1], brickOrigin[2], brickSize[0], brickSize[1], brickSize[2], GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+				continue;
+			}
+
+			if (!reader.readChunk(chunk, cells.data()))
+				return false;
+
+			uploadCells(cells.data(), origin, size, gridTexture, occupancyTexture, brickShift, bricks);
+		}
+
+		return true;
+	}
+
+	// read the grid texture back a chunk at a time and compress it to a snapshot
+	template<typename Cell>
+	bool downloadSnapshot(const std::string& path, GLuint dimension, GLuint gridTexture) {
+		SnapshotWriter writer;
+		if (!writer.open(path, dimension, voxel::CellTraits<Cell>::format))
+			return false;
+
+		const snapshot::Layout& layout = writer.layout();
+		const GLenum type = glCellType(voxel::CellTraits<Cell>::format);
+		std::vector<Cell> cells(size_t(snapshot::chunkDim) * snapshot::chunkDim * snapshot::chunkDim);
+
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+		for (int chunk = 0; chunk < layout.chunkCount(); chunk++) {
+			int origin[3], size[3];
+			layout.chunkExtent(chunk, origin, size);
+
+			glGetTextureSubImage(gridTexture, 0, origin[0], origin[1], origin[2], size[0], size[1], size[2], GL_RED_INTEGER, type,
+				GLsizei(cells.size() * sizeof(Cell)), cells.data());
+
+			if (!writer.writeChunk(chunk, cells.data()))
+				return false;
+		}
+
+		return writer.close();
+	}
+}
+
+
+// keeps gridTexture a window of a paged world around the player, implemented for each cell format
+class WorldPager {
+public:
+	virtual ~WorldPager() = default;
+
+	// world voxel coordinates of gridTexture's first cell
+	virtual const int* origin() const = 0;
+
+	// true if the window moved, gridTexture and occupancy level 0 then hold the new window
+	virtual bool follow(const glm::vec3& position) = 0;
+	virtual void prefetch(const glm::vec3& position, const glm::vec3& velocity, float lookahead) = 0;
+
+	// write the window and every changed chunk back to the world file
+	virtual bool save() = 0;
+};
+
+
+namespace {
+	// the window moves a chunk at a time, each chunk read back or uploaded on its own so no copy of the whole grid is kept
+	template<typename Cell>
+	class TexturePager : public WorldPager {
+	public:
+		TexturePager(GLuint dimension, GLuint gridTexture, GLuint occupancyTexture, GLuint brickShift) :
+			world(dimension),
+			gridTexture(gridTexture),
+			occupancyTexture(occupancyTexture),
+			brickShift(brickShift),
+			cells(size_t(paged::chunkDim) * paged::chunkDim * paged::chunkDim) {}
+
+		bool open(const std::string& path, unsigned int worldDimension) {
+			if (!world.open(path, worldDimension))
+				return false;
+
+			upload();
+			return true;
+		}
+
+		const int* origin() const override {
+			return world.origin();
+		}
+
+		bool follow(const glm::vec3& position) override {
+			if (!world.needsMove(glm::value_ptr(position)))
+				return false;
+
+			download();
+			world.moveTo(glm::value_ptr(position));
+			upload();
+			return true;
+		}
+
+		void prefetch(const glm::vec3& position, const glm::vec3& velocity, float lookahead) override {
+			world.prefetch(glm::value_ptr(position), glm::value_ptr(velocity), lookahead);
+		}
+
+		bool save() override {
+			download();
+			return world.chunks().flush();
+		}
+
+	private:
+		PagedWorld<Cell> world;
+		GLuint gridTexture, occupancyTexture, brickShift;
+		std::vector<Cell> cells;
+		std::vector<GLubyte> bricks;
+
+		void download() {
+			const int edge = int(paged::chunkDim);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+			for (int cz = 0; cz < world.windowChunks(); cz++) {
+				for (int cy = 0; cy < world.windowChunks(); cy++) {
+					for (int cx = 0; cx < world.windowChunks(); cx++) {
+						glGetTextureSubImage(gridTexture, 0, cx * edge, cy * edge, cz * edge, edge, edge, edge, GL_RED_INTEGER, glCellType(voxel::CellTraits<Cell>::format),
+							GLsizei(cells.size() * sizeof(Cell)), cells.data());
+						world.storeChunk(cx, cy, cz, cells.data());
+					}
+				}
+			}
+		}
+
+		void upload() {
+			const int edge = int(paged::chunkDim);
+			const int size[3] = { edge, edge, edge };
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+			for (int cz = 0; cz < world.windowChunks(); cz++) {
+				for (int cy = 0; cy < world.windowChunks(); cy++) {
+					for (int cx = 0; cx < world.windowChunks(); cx++) {
+						const int origin[3] = { cx * edge, cy * edge, cz * edge };
+						uploadCells(world.loadChunk(cx, cy, cz), origin, size, gridTexture, occupancyTexture, brickShift, bricks);
+					}
+				}
+			}
+		}
+	};
+}
+
+
+// reads gridTexture back into a CPU grid for WorldStatistics, implemented for each cell format
+class GridSampler {
+public:
+	virtual ~GridSampler() = default;
+
+	// unbrushed if the brush wasn't used since the last sample, its changes aren't read back so only those
+	// intervals are checked for leaks
+	virtual const WorldStats& sample(bool unbrushed) = 0;
+	virtual const WorldStats& last() const = 0;
+
+	// the next sample is a new baseline, after the grid was replaced from outside the shaders
+	virtual void reset() = 0;
+};
+
+
+namespace {
+	// the copy costs a grid and the statistics a byte per cell, layers are read one at a time so no single
+	// transfer passes the 2 GiB a GLsizei can describe
+	template<typename Cell>
+	class TextureSampler : public GridSampler {
+	public:
+		TextureSampler(GLuint dimension, GLuint gridTexture) :
+			grid(dimension),
+			stats(pool),
+			gridTexture(gridTexture) {}
+
+		const WorldStats& sample(bool unbrushed) override {
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			const GLsizei dim = GLsizei(grid.dimension());
+			const size_t layerCells = size_t(dim) * dim;
+			for (GLsizei z = 0; z < dim; z++)
+				glGetTextureSubImage(gridTexture, 0, 0, 0, z, dim, dim, 1, GL_RED_INTEGER, glCellType(voxel::CellTraits<Cell>::format),
+					GLsizei(layerCells * sizeof(Cell)), grid.data() + z * layerCells);
+
+			// the GPU brush isn't counted, intervals without it have nothing to add
+			static const int64_t none[rules::materialCount] = {};
+			return stats.sample(grid, unbrushed ? none : nullptr);
+		}
+
+		const WorldStats& last() const override {
+			return stats.last();
+		}
+
+		void reset() override {
+			stats.reset();
+		}
+
+	private:
+		VoxelGrid<Cell> grid;
+		ThreadPool pool;
+		WorldStatistics<Cell> stats;
+		GLuint gridTexture;
+	};
+}
+
+
+App::App(const Config& config) {
+	physProperties.dimension = config.dimension;
+	physProperties.simIterations = config.simIterations;
+	physProperties.adaptiveIterations = config.adaptiveIterations;
+	physProperties.cellFormat = config.cellFormat;
+	physProperties.maxDrawDist = config.maxDrawDist;
 
+	physShaderProperties.simLocalDim = config.simLocalDim;
+	physShaderProperties.simSpacing = 2 * config.simLocalDim;
+
+	sleepProperties.sleepAfter = config.sleepAfter;
+	rayCacheProperties.refresh = config.rayCache;
+	statsProperties.every = config.statsEvery;
+
+	occupancyProperties.brickShift = 0;
+	while ((1U << occupancyProperties.brickShift) < config.simLocalDim)
+		occupancyProperties.brickShift++;
 
-App::App() {
 	createWindow();
 
 	setupShaders();
 	
 	setupObjects();
+	setupStats();
+
+	if (!config.world.empty())
+		openPagedWorld(config.world, config.worldDimension ? config.worldDimension : config.dimension);
 }
 
 App::~App() {
 	glDeleteProgram(physShaderProperties.ptProgram);
 	glDeleteProgram(renderShaderProperties.quadProgram);
 	glDeleteProgram(renderShaderProperties.rtProgram);
+	glDeleteProgram(occupancyProperties.occProgram);
+	glDeleteProgram(blockPlacingProperties.plProgram);
+	if (sleepProperties.sleepAfter > 0)
+		glDeleteProgram(sleepProperties.acProgram);
+	if (rayCacheProperties.refresh > 0)
+		glDeleteProgram(rayCacheProperties.rcProgram);
 
 	glBindVertexArray(0);
 	glDeleteVertexArrays(1, &renderShaderProperties.quadVAO);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glDeleteTextures(1, &renderShaderProperties.rtTexture);
+	if (rayCacheProperties.refresh > 0) {
+		glDeleteTextures(1, &rayCacheProperties.hitCache);
+		glDeleteTextures(1, &rayCacheProperties.rayDepth);
+	}
 	glBindTexture(GL_TEXTURE_3D, 0);
 	glDeleteTextures(1, &sharedShaderProperties.gridTexture);
+	glDeleteTextures(1, &occupancyProperties.occupancyTexture);
 	//glDeleteTextures(1, &gridTexture1);
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	glDeleteBuffers(1, &blockPlacingProperties.blockLocation);
+	if (sleepProperties.sleepAfter > 0) {
+		glDeleteBuffers(1, &sleepProperties.brickActivity);
+		glDeleteBuffers(1, &sleepProperties.activeBricks);
+		glDeleteBuffers(1, &sleepProperties.dispatches);
+	}
 }
 
 
@@ -73,8 +507,23 @@ void App::setupShaders() {
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexStorage3D(GL_TEXTURE_3D, 1, GL_R32UI, physProperties.dimension, physProperties.dimension, physProperties.dimension);
-	glBindImageTexture(1, sharedShaderProperties.gridTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+	glTexStorage3D(GL_TEXTURE_3D, 1, glCellFormat(physProperties.cellFormat), physProperties.dimension, physProperties.dimension, physProperties.dimension);
+	glBindImageTexture(1, sharedShaderProperties.gridTexture, 0, GL_TRUE, 0, GL_READ_WRITE, glCellFormat(physProperties.cellFormat));
+
+	// texture storage starts undefined, replays rely on an empty world
+	const GLuint air = voxel::AIR;
+	glClearTexImage(sharedShaderProperties.gridTexture, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &air);
+
+	const size_t gridBytes = size_t(physProperties.dimension) * physProperties.dimension * physProperties.dimension * voxel::cellBytes(physProperties.cellFormat);
+	std::cout << "grid texture: " << voxel::cellFormatName(physProperties.cellFormat) << ", " << (gridBytes >> 20) << " MiB" << std::endl;
+
+	setupOccupancy();
+
+	if (sleepProperties.sleepAfter > 0)
+		setupSleeping();
+
+	if (rayCacheProperties.refresh > 0)
+		setupRayCache();
 }
 
 void App::setupRenderShader() {
@@ -128,6 +577,105 @@ void App::setupPhysicsShader() {
 	physShaderProperties.ptWorkGroups = (physProperties.dimension - 1) / physShaderProperties.simSpacing + 1; // int division with ceiling rounding
 
 	loadPTShader();
+	loadPlaceShader();
+}
+
+
+void App::setupOccupancy() {
+	const GLuint brickDim = physProperties.dimension >> occupancyProperties.brickShift;
+
+	occupancyProperties.levels = 1;
+	for (GLuint d = brickDim; d > 1; d /= 2)
+		occupancyProperties.levels++;
+
+	// occupancy pyramid lets the ray caster skip empty space, the physics shader keeps level 0 current
+	glGenTextures(1, &occupancyProperties.occupancyTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_3D, occupancyProperties.occupancyTexture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexStorage3D(GL_TEXTURE_3D, occupancyProperties.levels, GL_R8UI, brickDim, brickDim, brickDim);
+
+	const GLubyte empty = 0;
+	for (GLint level = 0; level < occupancyProperties.levels; level++)
+		glClearTexImage(occupancyProperties.occupancyTexture, level, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &empty);
+
+	glBindImageTexture(2, occupancyProperties.occupancyTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8UI);
+
+	loadOccupancyShader();
+
+	// the render shader was loaded before the pyramid existed
+	glUseProgram(renderShaderProperties.rtProgram);
+	glUniform1i(renderShaderProperties.rtOccupancyLevels, occupancyProperties.levels);
+}
+
+void App::setupSleeping() {
+	sleepProperties.bricks = 2 * physShaderProperties.ptWorkGroups;
+	const GLuint bricks = sleepProperties.bricks * sleepProperties.bricks * sleepProperties.bricks;
+
+	glGenBuffers(1, &sleepProperties.brickActivity);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepProperties.brickActivity);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2 * bricks, NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sleepProperties.brickActivity);
+
+	// each pass has room for all of its bricks
+	glGenBuffers(1, &sleepProperties.activeBricks);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepProperties.activeBricks);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * bricks, NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sleepProperties.activeBricks);
+
+	glGenBuffers(1, &sleepProperties.dispatches);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepProperties.dispatches);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 3 * 8, NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sleepProperties.dispatches);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, sleepProperties.dispatches);
+
+	wakeBricks();
+	loadActivityShader();
+}
+
+
+void App::setupRayCache() {
+	const GLsizei width = renderProperties.framebufferWidth, height = renderProperties.framebufferHeight;
+
+	glGenTextures(1, &rayCacheProperties.hitCache);
+	glBindTexture(GL_TEXTURE_2D, rayCacheProperties.hitCache);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32UI, width, height);
+	clearHitCache();
+	glBindImageTexture(5, rayCacheProperties.hitCache, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32UI);
+
+	glGenTextures(1, &rayCacheProperties.rayDepth);
+	glBindTexture(GL_TEXTURE_2D, rayCacheProperties.rayDepth);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, width, height);
+	glBindImageTexture(6, rayCacheProperties.rayDepth, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	loadReprojectShader();
+}
+
+// the first frame and the frames after a paged window moved have no hits to reproject
+void App::clearHitCache() {
+	const GLuint miss[4] = { 0, 0, 0, voxel::AIR };
+	glClearTexImage(rayCacheProperties.hitCache, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, miss);
+}
+
+
+// a sampler for the grid's cell format, kept while statistics are on
+void App::setupStats() {
+	if (statsProperties.every == 0 || statsProperties.sampler)
+		return;
+
+	const GLuint dimension = physProperties.dimension;
+	const GLuint grid = sharedShaderProperties.gridTexture;
+	switch (physProperties.cellFormat) {
+	case voxel::CellFormat::R8UI:	statsProperties.sampler = std::make_unique<TextureSampler<GLubyte>>(dimension, grid); break;
+	case voxel::CellFormat::R16UI:	statsProperties.sampler = std::make_unique<TextureSampler<GLushort>>(dimension, grid); break;
+	default:						statsProperties.sampler = std::make_unique<TextureSampler<GLuint>>(dimension, grid); break;
+	}
 }
 
 
@@ -137,8 +685,27 @@ void App::setupObjects() {
 }
 
 
+// configuration the compute shaders are compiled with, constants let the compiler fold the world size and loop bounds
+std::string App::shaderDefines() const {
+	std::ostringstream defines;
+	defines << "#define CELL_FORMAT " << glslCellFormat(physProperties.cellFormat) << "\n"
+		<< "#define DIMENSION " << physProperties.dimension << "u\n"
+		<< "#define SIM_LOCAL_DIM " << physShaderProperties.simLocalDim << "\n"
+		<< "#define BRICK_SHIFT " << occupancyProperties.brickShift << "\n"
+		<< "#define MAX_DRAW_DIST " << std::to_string(physProperties.maxDrawDist) << "\n"
+		<< "#define LATERAL_ORDERS " << glslLateralOrders() << "\n";
+
+	if (sleepProperties.sleepAfter > 0)
+		defines << "#define SLEEP_AFTER " << sleepProperties.sleepAfter << "\n";
+	if (rayCacheProperties.refresh > 0)
+		defines << "#define RAY_CACHE " << rayCacheProperties.refresh << "\n";
+
+	return defines.str();
+}
+
+
 void App::loadPTShader() {
-	GLuint ptCompShader = voxgl::createShader("./shaders/particlesim.comp", GL_COMPUTE_SHADER);
+	GLuint ptCompShader = createShader("./shaders/particlesim.comp", GL_COMPUTE_SHADER, shaderDefines());
 	std::vector<GLuint> ptShaders;
 	ptShaders.emplace_back(ptCompShader);
 
@@ -150,10 +717,8 @@ void App::loadPTShader() {
 		physShaderProperties.ptCurrentFlag = glGetUniformLocation(physShaderProperties.ptProgram, "currentFlag");
 		physShaderProperties.ptPartition = glGetUniformLocation(physShaderProperties.ptProgram, "part");
 		physShaderProperties.ptRNG = glGetUniformLocation(physShaderProperties.ptProgram, "rng");
-		physShaderProperties.ptBlockType = glGetUniformLocation(physShaderProperties.ptProgram, "blockType");
-		physShaderProperties.ptBlockSize = glGetUniformLocation(physShaderProperties.ptProgram, "blockSize");
-		physShaderProperties.ptPlaceBlock = glGetUniformLocation(physShaderProperties.ptProgram, "placeBlock");
 		physShaderProperties.ptDimension = glGetUniformLocation(physShaderProperties.ptProgram, "dimension");
+		physShaderProperties.ptIteration = glGetUniformLocation(physShaderProperties.ptProgram, "iteration");
 		//physShaderProperties.ptMaxVelocity = glGetUniformLocation(ptProgram, "maxVelocity");
 
 		glUseProgram(physShaderProperties.ptProgram);
@@ -163,7 +728,7 @@ void App::loadPTShader() {
 }
 
 void App::loadRTShader() {
-	GLuint rtCompShader = voxgl::createShader("./shaders/dda.comp", GL_COMPUTE_SHADER);
+	GLuint rtCompShader = createShader("./shaders/dda.comp", GL_COMPUTE_SHADER, shaderDefines());
 	std::vector<GLuint> rtShaders;
 	rtShaders.emplace_back(rtCompShader);
 
@@ -180,25 +745,323 @@ void App::loadRTShader() {
 		renderShaderProperties.rtPlaceBlock = glGetUniformLocation(renderShaderProperties.rtProgram, "placeBlock");
 		renderShaderProperties.rtUpdateDist = glGetUniformLocation(renderShaderProperties.rtProgram, "updateDist");
 		renderShaderProperties.rtDrawLines = glGetUniformLocation(renderShaderProperties.rtProgram, "drawLines");
+		renderShaderProperties.rtOccupancyLevels = glGetUniformLocation(renderShaderProperties.rtProgram, "occupancyLevels");
+		rayCacheProperties.rtFrame = glGetUniformLocation(renderShaderProperties.rtProgram, "frame");
 
 		glUseProgram(renderShaderProperties.rtProgram);
 		glUniform2i(renderShaderProperties.rtResolution, renderProperties.framebufferWidth, renderProperties.framebufferHeight);
 		glUniform1ui(renderShaderProperties.rtDimension, physProperties.dimension);
+		glUniform1i(renderShaderProperties.rtOccupancyLevels, occupancyProperties.levels);
+	}
+}
+
+void App::loadOccupancyShader() {
+	GLuint occCompShader = createShader("./shaders/occupancy.comp", GL_COMPUTE_SHADER, shaderDefines());
+	std::vector<GLuint> occShaders;
+	occShaders.emplace_back(occCompShader);
+
+	GLint shaderRef = voxgl::createProgram(occShaders);
+	if (shaderRef != -1)
+		occupancyProperties.occProgram = shaderRef;
+}
+
+void App::loadPlaceShader() {
+	GLuint plCompShader = createShader("./shaders/place.comp", GL_COMPUTE_SHADER, shaderDefines());
+	std::vector<GLuint> plShaders;
+	plShaders.emplace_back(plCompShader);
+
+	GLint shaderRef = voxgl::createProgram(plShaders);
+	if (shaderRef != -1) {
+		blockPlacingProperties.plProgram = shaderRef;
+
+		blockPlacingProperties.plCurrentFlag = glGetUniformLocation(blockPlacingProperties.plProgram, "currentFlag");
+		blockPlacingProperties.plBlockType = glGetUniformLocation(blockPlacingProperties.plProgram, "blockType");
+		blockPlacingProperties.plBlockSize = glGetUniformLocation(blockPlacingProperties.plProgram, "blockSize");
+		blockPlacingProperties.plIteration = glGetUniformLocation(blockPlacingProperties.plProgram, "iteration");
+	}
+}
+
+void App::loadActivityShader() {
+	GLuint acCompShader = createShader("./shaders/activity.comp", GL_COMPUTE_SHADER, shaderDefines());
+	std::vector<GLuint> acShaders;
+	acShaders.emplace_back(acCompShader);
+
+	GLint shaderRef = voxgl::createProgram(acShaders);
+	if (shaderRef != -1) {
+		sleepProperties.acProgram = shaderRef;
+
+		sleepProperties.acIteration = glGetUniformLocation(sleepProperties.acProgram, "iteration");
+		sleepProperties.acCurrentFlag = glGetUniformLocation(sleepProperties.acProgram, "currentFlag");
+		sleepProperties.acBlockSize = glGetUniformLocation(sleepProperties.acProgram, "blockSize");
+		sleepProperties.acPlaceBlock = glGetUniformLocation(sleepProperties.acProgram, "placeBlock");
+	}
+}
+
+
+void App::loadReprojectShader() {
+	GLuint rcCompShader = createShader("./shaders/reproject.comp", GL_COMPUTE_SHADER, shaderDefines());
+	std::vector<GLuint> rcShaders;
+	rcShaders.emplace_back(rcCompShader);
+
+	GLint shaderRef = voxgl::createProgram(rcShaders);
+	if (shaderRef != -1) {
+		rayCacheProperties.rcProgram = shaderRef;
+
+		rayCacheProperties.rcResolution = glGetUniformLocation(rayCacheProperties.rcProgram, "resolution");
+		rayCacheProperties.rcCamPos = glGetUniformLocation(rayCacheProperties.rcProgram, "cameraPos");
+		rayCacheProperties.rcCamMat = glGetUniformLocation(rayCacheProperties.rcProgram, "cameraMat");
+
+		glUseProgram(rayCacheProperties.rcProgram);
+		glUniform2i(rayCacheProperties.rcResolution, renderProperties.framebufferWidth, renderProperties.framebufferHeight);
+	}
+}
+
+
+// rebuild the coarser occupancy levels from the bricks written by the physics shader
+void App::buildOccupancyLevels() {
+	glUseProgram(occupancyProperties.occProgram);
+
+	for (GLint level = 1; level < occupancyProperties.levels; level++) {
+		glBindImageTexture(3, occupancyProperties.occupancyTexture, level - 1, GL_TRUE, 0, GL_READ_ONLY, GL_R8UI);
+		glBindImageTexture(4, occupancyProperties.occupancyTexture, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8UI);
+
+		const GLuint levelDim = std::max((physProperties.dimension >> occupancyProperties.brickShift) >> level, 1U);
+		const GLuint groups = (levelDim + 3) / 4;
+		glDispatchCompute(groups, groups, groups);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+// scatter the last frame's hits into this frame's pixels ahead of the ray cast, the nearest per pixel kept
+void App::reprojectHits(const glm::vec3& cameraPosition, const glm::mat3& cameraMatrix) {
+	const GLuint none = ~0u;
+	glClearTexImage(rayCacheProperties.rayDepth, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &none);
+
+	glUseProgram(rayCacheProperties.rcProgram);
+	glUniform3f(rayCacheProperties.rcCamPos, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+	glUniformMatrix3fv(rayCacheProperties.rcCamMat, 1, GL_FALSE, glm::value_ptr(glm::transpose(cameraMatrix)));
+
+	glDispatchCompute(renderShaderProperties.rtX, renderShaderProperties.rtY, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+// fill or erase the brush ahead of an iteration's passes, the location stays on the GPU where the render shader put it
+// so the dispatch covers the largest box the brush's radius allows around it
+void App::placeBlocks(const Brush& brush) {
+	if (!brush.placeBlock)
+		return;
+
+	glUseProgram(blockPlacingProperties.plProgram);
+	glUniform1ui(blockPlacingProperties.plCurrentFlag, blockPlacingProperties.currentFlag);
+	glUniform1ui(blockPlacingProperties.plBlockType, brush.blockType);
+	glUniform1f(blockPlacingProperties.plBlockSize, brush.blockSize);
+	glUniform1ui(blockPlacingProperties.plIteration, sleepProperties.iteration);
+
+	const GLuint extent = 2 * GLuint(glm::ceil(brush.blockSize)) + 1;
+	const GLuint groups = (extent - 1) / blockPlacingProperties.plWork + 1;
+	glDispatchCompute(groups, groups, groups);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	glUseProgram(physShaderProperties.ptProgram);
+}
+
+// list the bricks the coming iteration dispatches, before placing so bricks waking under the brush keep its flags
+void App::scheduleBricks(const Brush& brush) {
+	sleepProperties.iteration++;
+
+	GLuint commands[3 * 8];
+	for (int pass = 0; pass < 8; pass++) {
+		commands[3 * pass] = 0;
+		commands[3 * pass + 1] = commands[3 * pass + 2] = 1;
 	}
+	glNamedBufferSubData(sleepProperties.dispatches, 0, sizeof(commands), commands);
+
+	glUseProgram(sleepProperties.acProgram);
+	glUniform1ui(sleepProperties.acIteration, sleepProperties.iteration);
+	glUniform1ui(sleepProperties.acCurrentFlag, blockPlacingProperties.currentFlag);
+	glUniform1f(sleepProperties.acBlockSize, brush.blockSize);
+	glUniform1ui(sleepProperties.acPlaceBlock, brush.placeBlock);
+
+	const GLuint groups = (sleepProperties.bricks + 3) / 4;
+	glDispatchCompute(groups, groups, groups);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	glUseProgram(physShaderProperties.ptProgram);
+	glUniform1ui(physShaderProperties.ptIteration, sleepProperties.iteration);
+}
+
+// every brick counts as changed, after the grid was replaced from outside the simulation
+void App::wakeBricks() {
+	if (sleepProperties.sleepAfter <= 0)
+		return;
+
+	const GLuint stamps[2] = { sleepProperties.iteration, sleepProperties.iteration };
+	glClearNamedBufferData(sleepProperties.brickActivity, GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT, stamps);
+}
+
+// bricks the latest iteration dispatched, reading them back waits for its scheduling to finish
+GLuint App::activeBrickCount() {
+	GLuint commands[3 * 8];
+	glGetNamedBufferSubData(sleepProperties.dispatches, 0, sizeof(commands), commands);
+
+	GLuint active = 0;
+	for (int pass = 0; pass < 8; pass++)
+		active += commands[3 * pass];
+
+	return active;
+}
+
+
+void App::saveWorld() {
+	bool saved;
+	switch (physProperties.cellFormat) {
+	case voxel::CellFormat::R8UI:	saved = downloadSnapshot<GLubyte>(snapshotProperties.path, physProperties.dimension, sharedShaderProperties.gridTexture); break;
+	case voxel::CellFormat::R16UI:	saved = downloadSnapshot<GLushort>(snapshotProperties.path, physProperties.dimension, sharedShaderProperties.gridTexture); break;
+	default:						saved = downloadSnapshot<GLuint>(snapshotProperties.path, physProperties.dimension, sharedShaderProperties.gridTexture); break;
+	}
+
+	std::cout << (saved ? "saved world to " : "could not save world to ") << snapshotProperties.path << std::endl;
+}
+
+void App::loadWorld() {
+	SnapshotReader reader;
+	if (!reader.open(snapshotProperties.path) || reader.dimension() != physProperties.dimension) {
+		std::cout << "could not load " << snapshotProperties.path << " as a " << physProperties.dimension << "^3 world" << std::endl;
+		return;
+	}
+
+	bool loaded;
+	switch (physProperties.cellFormat) {
+	case voxel::CellFormat::R8UI:	loaded = uploadSnapshot<GLubyte>(reader, sharedShaderProperties.gridTexture, occupancyProperties.occupancyTexture, occupancyProperties.brickShift); break;
+	case voxel::CellFormat::R16UI:	loaded = uploadSnapshot<GLushort>(reader, sharedShaderProperties.gridTexture, occupancyProperties.occupancyTexture, occupancyProperties.brickShift); break;
+	default:						loaded = uploadSnapshot<GLuint>(reader, sharedShaderProperties.gridTexture, occupancyProperties.occupancyTexture, occupancyProperties.brickShift); break;
+	}
+
+	if (loaded) {
+		buildOccupancyLevels();
+		wakeBricks();
+		if (statsProperties.sampler)
+			statsProperties.sampler->reset();
+	}
+
+	std::cout << (loaded ? "loaded world from " : "could not load world from ") << snapshotProperties.path << std::endl;
+}
+
+
+void App::openPagedWorld(const std::string& path, unsigned int worldDimension) {
+	const GLuint dimension = physProperties.dimension;
+	const GLuint grid = sharedShaderProperties.gridTexture;
+	const GLuint occupancy = occupancyProperties.occupancyTexture;
+	const GLuint brickShift = occupancyProperties.brickShift;
+
+	bool opened;
+	switch (physProperties.cellFormat) {
+	case voxel::CellFormat::R8UI: {
+		auto pager = std::make_unique<TexturePager<GLubyte>>(dimension, grid, occupancy, brickShift);
+		opened = pager->open(path, worldDimension);
+		pagingProperties.pager = std::move(pager);
+		break;
+	}
+	case voxel::CellFormat::R16UI: {
+		auto pager = std::make_unique<TexturePager<GLushort>>(dimension, grid, occupancy, brickShift);
+		opened = pager->open(path, worldDimension);
+		pagingProperties.pager = std::move(pager);
+		break;
+	}
+	default: {
+		auto pager = std::make_unique<TexturePager<GLuint>>(dimension, grid, occupancy, brickShift);
+		opened = pager->open(path, worldDimension);
+		pagingProperties.pager = std::move(pager);
+		break;
+	}
+	}
+
+	if (!opened) {
+		pagingProperties.pager.reset();
+		std::cout << "could not open " << path << " as a " << worldDimension << "^3 world" << std::endl;
+		return;
+	}
+
+	buildOccupancyLevels();
+	wakeBricks();
+	std::cout << "paging a " << worldDimension << "^3 world from " << path << std::endl;
+}
+
+
+bool App::recordInput(const std::string& path) {
+	// logs hold window coordinates, which stop meaning anything once a paged world's window moves
+	if (pagingProperties.pager)
+		return false;
+
+	if (!replayProperties.recorder.open(path, physProperties.dimension))
+		return false;
+
+	std::cout << "recording input to " << path << std::endl;
+	return true;
+}
+
+bool App::replayInput(const std::string& path) {
+	if (pagingProperties.pager)
+		return false;
+
+	if (!replayProperties.log.load(path) || replayProperties.log.dimension() != physProperties.dimension)
+		return false;
+
+	replayProperties.next = 0;
+	replayProperties.replaying = true;
+
+	std::cout << "replaying " << replayProperties.log.steps().size() << " steps from " << path << std::endl;
+	return true;
+}
+
+void App::exportTimings(const std::string& path) {
+	timingProperties.path = path;
+}
+
+bool App::exportStats(const std::string& path) {
+	statsProperties.file.open(path);
+	if (!statsProperties.file)
+		return false;
+
+	statsProperties.file << "frame,steps,sim_us," << WorldStats::csvHeader() << "\n";
+	if (statsProperties.every == 0)
+		statsProperties.every = renderProperties.fps;
+	setupStats();
+	return true;
+}
+
+// feed the next logged iteration to the physics shader, the brush location normally comes from the render shader
+ReplayStep App::replayStep() {
+	const ReplayStep& step = replayProperties.log.steps()[replayProperties.next++];
+
+	const GLuint location[3] = { GLuint(step.brush.blockLocation[0]), GLuint(step.brush.blockLocation[1]), GLuint(step.brush.blockLocation[2]) };
+	glNamedBufferSubData(blockPlacingProperties.blockLocation, 0, sizeof(location), location);
+
+	return step;
 }
 
 
 void App::run() {
-	// mutex for shader uniform variables
-	std::mutex dataLock;
+	// the logic thread starts from the initial camera and brush
+	publishInput();
 
-	std::thread render_thread = logicThread(dataLock);
-	inputHandler(dataLock);
+	std::thread render_thread = logicThread();
+	inputHandler();
 
 	render_thread.join();
+
+	if (replayProperties.recorder.isOpen()) {
+		const size_t recorded = replayProperties.recorder.count();
+		if (replayProperties.recorder.close())
+			std::cout << "recorded " << recorded << " steps" << std::endl;
+		else
+			std::cout << "could not write input log" << std::endl;
+	}
 }
 
-const std::thread App::logicThread(std::mutex &dataLock) {
+const std::thread App::logicThread() {
 	glfwMakeContextCurrent(NULL);
 	std::thread logic_thread([&]() {
 		glfwMakeContextCurrent(windowProperties.window.get());
@@ -208,116 +1071,197 @@ const std::thread App::logicThread(std::mutex &dataLock) {
 		GLdouble last_refresh = glfwGetTime();
 		int frames = 0;
 
-		std::vector<unsigned int> simTimes, renderTimes, drawTimes;
-		GLuint timerQueries[3];
-		glGenQueries(3, timerQueries);
+		enum { simPhase, renderPhase, drawPhase };
+		FrameTimings timings({ "sim", "render", "draw" });
+		GLTimerClock gpuClock(3, timingProperties.queryFrames);
+
+		// timer query results reach the scheduler as they're collected, frames after the work they measured
+		StepScheduler::Settings budget;
+		budget.frameNs = 1e9 / renderProperties.fps;
+		budget.nominal = physProperties.simIterations;
+		budget.maxSteps = 2 * physProperties.simIterations;
+		budget.maxDebt = double(renderProperties.fps) * physProperties.simIterations;	// a second of steps
+		StepScheduler scheduler(budget);
+
+		// statistics rows carry the latest sim time measured, which is from a frame a few before theirs
+		uint64_t simNs = 0;
+		unsigned long long frameCount = 0;
+		int statsSteps = 0;		// simulation steps since the last statistics row
+
+		timings.observe([&](int phase, uint64_t nanoseconds) {
+			if (phase == simPhase)
+				simNs = nanoseconds;
+			if (!physProperties.adaptiveIterations)
+				return;
+
+			if (phase == simPhase)
+				scheduler.simMeasured(nanoseconds);
+			else
+				scheduler.otherMeasured(phase, nanoseconds);
+		});
 
 		auto rng = std::minstd_rand{};
 
 
 		while (!glfwWindowShouldClose(windowProperties.window.get())) {
+			// snapshots requested by the input thread
+			if (snapshotProperties.loadRequested.exchange(false))
+				loadWorld();
+			if (snapshotProperties.saveRequested.exchange(false))
+				saveWorld();
+
+			// latest camera and brush from the input thread, one consistent state for the whole frame
+			const InputState& input = inputProperties.state.read();
+
+			// a paged world's window follows the player, the shaders work in window coordinates
+			glm::vec3 windowOrigin(0.f);
+			if (pagingProperties.pager) {
+				pagingProperties.pager->prefetch(input.cameraPosition, input.cameraVelocity, pagingProperties.lookahead);
+				if (pagingProperties.pager->follow(input.cameraPosition)) {
+					buildOccupancyLevels();
+					wakeBricks();
+					if (rayCacheProperties.refresh > 0)
+						clearHitCache();
+					if (statsProperties.sampler)
+						statsProperties.sampler->reset();
+				}
+
+				const int* origin = pagingProperties.pager->origin();
+				windowOrigin = glm::vec3(origin[0], origin[1], origin[2]);
+			}
+			const glm::vec3 cameraPosition = input.cameraPosition - windowOrigin;
+
 			// physics shader
 			glUseProgram(physShaderProperties.ptProgram);
 
-			dataLock.lock();
-			glUniform1ui(physShaderProperties.ptBlockType, blockPlacingProperties.blockType);
-			glUniform1f(physShaderProperties.ptBlockSize, blockPlacingProperties.blockSize);
-			glUniform1ui(physShaderProperties.ptPlaceBlock, blockPlacingProperties.placeBlock);
-			dataLock.unlock();
+			Brush brush;
+			brush.placeBlock = input.placeBlock != 0;
+			brush.blockType = input.blockType;
+			brush.blockSize = input.blockSize;
+
+			// recording reads back the location the render shader picked, which waits for the previous frame
+			if (replayProperties.recorder.isOpen() && !replayProperties.replaying) {
+				GLuint location[3];
+				glGetNamedBufferSubData(blockPlacingProperties.blockLocation, 0, sizeof(location), location);
+				std::copy(location, location + 3, brush.blockLocation);
+			}
+
+			int iterations = physProperties.simIterations;
+			if (physProperties.adaptiveIterations && !replayProperties.replaying)
+				iterations = scheduler.next();
+			if (replayProperties.replaying)
+				iterations = int(std::min(size_t(iterations), replayProperties.log.steps().size() - replayProperties.next));
+
+			gpuClock.begin(simPhase);
+			for (int it = 0; it < iterations; it++) {
+				ReplayStep step{ brush, float(rng()) / float(rng.max()) };
+				if (replayProperties.replaying)
+					step = replayStep();
+				if (replayProperties.recorder.isOpen())
+					replayProperties.recorder.record(step);
+				statsProperties.brushed |= step.brush.placeBlock;
 
-			glBeginQuery(GL_TIME_ELAPSED, timerQueries[0]);
-			for (int it = 0; it < physProperties.simIterations; it++) {
 				glUniform1ui(physShaderProperties.ptCurrentFlag, blockPlacingProperties.currentFlag = (!blockPlacingProperties.currentFlag) * 0x80);
-				glUniform1f(physShaderProperties.ptRNG, float(rng()) / float(rng.max()));
+				glUniform1f(physShaderProperties.ptRNG, step.rng);
+
+				if (sleepProperties.sleepAfter > 0)
+					scheduleBricks(step.brush);
+				placeBlocks(step.brush);
 
 				for (int part = 0; part < 8; part++) {
 					glUniform3i(physShaderProperties.ptPartition, part % 2, (part / 2) % 2, (part / 4) % 2);
-					glDispatchCompute(physShaderProperties.ptWorkGroups, physShaderProperties.ptWorkGroups, physShaderProperties.ptWorkGroups);
-					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+					if (sleepProperties.sleepAfter > 0)
+						glDispatchComputeIndirect(GLintptr(sizeof(GLuint) * 3 * part));
+					else
+						glDispatchCompute(physShaderProperties.ptWorkGroups, physShaderProperties.ptWorkGroups, physShaderProperties.ptWorkGroups);
+					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
 				}
 			}
-			glEndQuery(GL_TIME_ELAPSED);
+			buildOccupancyLevels();
+			gpuClock.end(simPhase);
+			if (statsProperties.sampler)
+				statsSteps += iterations;
+
 
+			gpuClock.begin(renderPhase);
+			if (rayCacheProperties.refresh > 0)
+				reprojectHits(cameraPosition, input.cameraMatrix);
 
 			// ray trace shader
 			glUseProgram(renderShaderProperties.rtProgram);
 
-			dataLock.lock();
-			glUniform3f(renderShaderProperties.rtCamPos, worldObjects.player.camera.position.x, worldObjects.player.camera.position.y, worldObjects.player.camera.position.z);
-			glUniformMatrix3fv(renderShaderProperties.rtCamMat, 1, GL_FALSE, glm::value_ptr(glm::transpose(worldObjects.player.camera.getMatrix())));
-			glUniform1f(renderShaderProperties.rtBlockDist, blockPlacingProperties.blockDist);
-			glUniform1f(renderShaderProperties.rtBlockSize, blockPlacingProperties.blockSize);
-			glUniform1f(renderShaderProperties.rtPlaceBlock, blockPlacingProperties.placeBlock);
-			glUniform1ui(renderShaderProperties.rtUpdateDist, blockPlacingProperties.updateDist);
-			glUniform1ui(renderShaderProperties.rtDrawLines, renderProperties.drawLines);
-			blockPlacingProperties.distUpdated = true;
-			dataLock.unlock();
-
-			glBeginQuery(GL_TIME_ELAPSED, timerQueries[1]);
+			glUniform3f(renderShaderProperties.rtCamPos, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+			glUniformMatrix3fv(renderShaderProperties.rtCamMat, 1, GL_FALSE, glm::value_ptr(glm::transpose(input.cameraMatrix)));
+			glUniform1f(renderShaderProperties.rtBlockDist, input.blockDist);
+			glUniform1f(renderShaderProperties.rtBlockSize, input.blockSize);
+			glUniform1f(renderShaderProperties.rtPlaceBlock, input.placeBlock);
+			glUniform1ui(renderShaderProperties.rtUpdateDist, input.updateDist);
+			glUniform1ui(renderShaderProperties.rtDrawLines, input.drawLines);
+			if (rayCacheProperties.refresh > 0)
+				glUniform1ui(rayCacheProperties.rtFrame, rayCacheProperties.frame++);
+			// acknowledge the snapshot that was used, a request published after it was read stays pending
+			blockPlacingProperties.distConsumed = input.sequence;
+
 			glDispatchCompute(renderShaderProperties.rtX, renderShaderProperties.rtY, 1);
-			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-			glEndQuery(GL_TIME_ELAPSED);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | (rayCacheProperties.refresh > 0 ? GL_SHADER_IMAGE_ACCESS_BARRIER_BIT : 0));
+			gpuClock.end(renderPhase);
 
 
 			// draw ray trace texture to quad
 			glUseProgram(renderShaderProperties.quadProgram);
 
-			glBeginQuery(GL_TIME_ELAPSED, timerQueries[2]);
+			gpuClock.begin(drawPhase);
 			glClear(GL_COLOR_BUFFER_BIT);
 			glDrawArrays(GL_TRIANGLES, 0, 3);
-			glEndQuery(GL_TIME_ELAPSED);
+			gpuClock.end(drawPhase);
+			gpuClock.endFrame();
 
 			glfwSwapBuffers(windowProperties.window.get());
 
-			// get timer queries from opengl
-			GLint queryAvailable = 0;
-			GLuint elapsed_time;
-
-			while (!queryAvailable) {
-				glGetQueryObjectiv(timerQueries[0],
-					GL_QUERY_RESULT_AVAILABLE,
-					&queryAvailable);
-			}
-			glGetQueryObjectuiv(timerQueries[0], GL_QUERY_RESULT, &elapsed_time);
-			simTimes.push_back(elapsed_time / 1000);
-
-			queryAvailable = 0;
-			while (!queryAvailable) {
-				glGetQueryObjectiv(timerQueries[1],
-					GL_QUERY_RESULT_AVAILABLE,
-					&queryAvailable);
+			// pick up whichever earlier frames' timings the GPU has finished
+			gpuClock.collect(timings);
+			frameCount++;
+
+			// world statistics every few frames, reading the grid back waits for the frame's dispatches
+			if (statsProperties.sampler && ++statsProperties.frame >= statsProperties.every) {
+				const WorldStats& stats = statsProperties.sampler->sample(!statsProperties.brushed);
+				if (statsProperties.file.is_open())
+					statsProperties.file << frameCount << "," << statsSteps << "," << simNs / 1000. << "," << stats.csvRow() << "\n";
+				if (!stats.conserved())
+					std::cout << "particle counts drifted: " << stats.summary() << std::endl;
+
+				statsProperties.frame = 0;
+				statsProperties.brushed = false;
+				statsSteps = 0;
 			}
-			glGetQueryObjectuiv(timerQueries[1], GL_QUERY_RESULT, &elapsed_time);
-			renderTimes.push_back(elapsed_time / 1000);
-
-			queryAvailable = 0;
-			while (!queryAvailable) {
-				glGetQueryObjectiv(timerQueries[2],
-					GL_QUERY_RESULT_AVAILABLE,
-					&queryAvailable);
-			}
-			glGetQueryObjectuiv(timerQueries[2], GL_QUERY_RESULT, &elapsed_time);
-			drawTimes.push_back(elapsed_time / 1000);
 
 
-			// output framerate and average times every second
+			// output framerate and timing percentiles every second
 			frames++;
 			if (int(glfwGetTime() - last_refresh) > 0) {
 				std::cout << frames << "fps" << std::endl;
 				frames = 0;
 
-				auto const simCount = static_cast<float>(simTimes.size());
-				auto const renderCount = static_cast<float>(renderTimes.size());
-				auto const drawCount = static_cast<float>(drawTimes.size());
+				if (timings.window(simPhase).count() > 0)
+					std::cout << timings.summary() << std::endl;
+				if (physProperties.adaptiveIterations)
+					std::cout << scheduler.summary() << std::endl;
+				if (sleepProperties.sleepAfter > 0)
+					std::cout << activeBrickCount() << " of " << sleepProperties.bricks * sleepProperties.bricks * sleepProperties.bricks << " bricks active" << std::endl;
+				if (statsProperties.sampler)
+					std::cout << statsProperties.sampler->last().summary() << std::endl;
+				timings.resetWindow();
 
-				if (simCount > 0 && renderCount > 0 && drawCount > 0)
-					std::cout << "sim time: " << std::reduce(simTimes.begin(), simTimes.end()) / simCount << "us\t" << "render time: " << std::reduce(renderTimes.begin(), renderTimes.end()) / renderCount << "us\t" << "draw time: " << std::reduce(drawTimes.begin(), drawTimes.end()) / drawCount << "us" << std::endl;
+				last_refresh = glfwGetTime();
+			}
 
-				simTimes.clear();
-				renderTimes.clear();
-				drawTimes.clear();
 
-				last_refresh = glfwGetTime();
+			// a finished replay reports its total for comparing builds and closes the window
+			if (replayProperties.replaying && replayProperties.next == replayProperties.log.steps().size()) {
+				gpuClock.flush(timings);
+				std::cout << "replayed " << replayProperties.next << " steps, sim time: " << timings.total(simPhase).sum() / 1000000.0 << "ms" << std::endl;
+				replayProperties.replaying = false;
+				glfwSetWindowShouldClose(windowProperties.window.get(), GLFW_TRUE);
 			}
 
 
@@ -325,22 +1269,63 @@ const std::thread App::logicThread(std::mutex &dataLock) {
 			if (glfwGetKey(windowProperties.window.get(), GLFW_KEY_R)) {
 				loadPTShader();
 				loadRTShader();
+				loadOccupancyShader();
+				loadPlaceShader();
+				if (sleepProperties.sleepAfter > 0)
+					loadActivityShader();
+				if (rayCacheProperties.refresh > 0)
+					loadReprojectShader();
 			}
 
 			renderPacer.tick();
 		}
+
+		if (pagingProperties.pager && !pagingProperties.pager->save())
+			std::cout << "could not save the paged world" << std::endl;
+
+		gpuClock.flush(timings);
+		if (!timingProperties.path.empty()) {
+			if (timings.write(timingProperties.path))
+				std::cout << "wrote frame timings to " << timingProperties.path << std::endl;
+			else
+				std::cout << "could not write " << timingProperties.path << std::endl;
+		}
 	});
 
 	return logic_thread;
 }
 
 
-void App::inputHandler(std::mutex& dataLock) {
+void App::publishInput() {
+	InputState input;
+	input.sequence = ++inputProperties.sequence;
+	input.cameraPosition = worldObjects.player.camera.position;
+	input.cameraVelocity = worldObjects.player.velocity;
+	input.cameraMatrix = worldObjects.player.camera.getMatrix();
+	input.placeBlock = blockPlacingProperties.placeBlock;
+	input.blockType = blockPlacingProperties.blockType;
+	input.blockSize = blockPlacingProperties.blockSize;
+	input.blockDist = blockPlacingProperties.blockDist;
+	input.updateDist = blockPlacingProperties.updateDist;
+	input.drawLines = renderProperties.drawLines;
+
+	inputProperties.state.write(input);
+}
+
+
+void App::inputHandler() {
 	// Input handler
 	Timer inputPacer(500);
 	unsigned int timeDelta;
 	glm::vec3 prevFacingRay{ 0 };
 	bool prevQ = false;
+	bool prevSave = false, prevLoad = false;
+
+	// the next snapshot asks the render shader for the placement distance, until one at least as new is used
+	const auto requestDist = [&]() {
+		blockPlacingProperties.updateDist = 1;
+		blockPlacingProperties.distRequested = inputProperties.sequence + 1;
+	};
 
 	while (!glfwWindowShouldClose(windowProperties.window.get())) {
 		timeDelta = inputPacer.tick();
@@ -351,18 +1336,16 @@ void App::inputHandler(std::mutex& dataLock) {
 
 		bool cameraChanged = false;
 
-		dataLock.lock();
-
 		worldObjects.player.handleInputs(windowProperties.window);
 		worldObjects.player.update(timeDelta);
 
 		glm::vec3 facingRay = worldObjects.player.camera.facingRay();
 
-		if (blockPlacingProperties.distUpdated) {
-			if (facingRay != prevFacingRay || glm::any(glm::greaterThan(glm::abs(worldObjects.player.velocity), glm::vec3(0)))) {
-				blockPlacingProperties.updateDist = 1;
-				blockPlacingProperties.distUpdated = false;
-			}
+		// once the render shader used a snapshot at least as new as the last request, decide again whether to ask
+		const bool distUpdated = int32_t(blockPlacingProperties.distConsumed.load() - blockPlacingProperties.distRequested) >= 0;
+		if (distUpdated) {
+			if (facingRay != prevFacingRay || glm::any(glm::greaterThan(glm::abs(worldObjects.player.velocity), glm::vec3(0))))
+				requestDist();
 			else
 				blockPlacingProperties.updateDist = 0;
 		}
@@ -371,13 +1354,11 @@ void App::inputHandler(std::mutex& dataLock) {
 		// block distance
 		if (glfwGetKey(windowProperties.window.get(), GLFW_KEY_EQUAL) == GLFW_PRESS) {
 			blockPlacingProperties.blockDist = glm::min(blockPlacingProperties.blockDist + 0.05f, 200.f);
-			blockPlacingProperties.updateDist = 1;
-			blockPlacingProperties.distUpdated = false;
+			requestDist();
 		}
 		else if (glfwGetKey(windowProperties.window.get(), GLFW_KEY_MINUS) == GLFW_PRESS) {
 			blockPlacingProperties.blockDist = glm::max(blockPlacingProperties.blockDist - 0.05f, blockPlacingProperties.blockSize);
-			blockPlacingProperties.updateDist = 1;
-			blockPlacingProperties.distUpdated = false;
+			requestDist();
 		}
 
 
@@ -404,7 +1385,17 @@ void App::inputHandler(std::mutex& dataLock) {
 		else
 			prevQ = false;
 
-		dataLock.unlock();
+		// save and load the world
+		bool save = glfwGetKey(windowProperties.window.get(), GLFW_KEY_F5) == GLFW_PRESS;
+		bool load = glfwGetKey(windowProperties.window.get(), GLFW_KEY_F9) == GLFW_PRESS;
+		if (save && !prevSave)
+			snapshotProperties.saveRequested = true;
+		if (load && !prevLoad)
+			snapshotProperties.loadRequested = true;
+		prevSave = save;
+		prevLoad = load;
+
+		publishInput();
 
 
 		prevFacingRay = facingRay;
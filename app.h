@@ -6,19 +6,36 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/noise.hpp>
 
-#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <memory>
 
 #include <player.h>
 
+#include "config.h"
+#include "replay.h"
+#include "triplebuffer.h"
+#include "voxel.h"
+
+
+class WorldPager;
+class GridSampler;
+
 
 class App
 {
 public:
 	static App& getInstance(void) {
-		static App instance;
+		static App instance(startupConfig());
 		return instance;
 	}
 
+	// settings the app is created with, only changes made before the first getInstance take effect
+	static Config& startupConfig() {
+		static Config config;
+		return config;
+	}
+
 	App(const App&) = delete;
 	App& operator=(const App&) = delete;
 
@@ -28,6 +45,16 @@ public:
 
 	void run();
 
+	// log every simulation iteration's inputs, or drive the simulation from such a log instead of live input
+	bool recordInput(const std::string& path);
+	bool replayInput(const std::string& path);
+
+	// write per phase timing histograms of the whole run when the window closes
+	void exportTimings(const std::string& path);
+
+	// write a CSV row of world statistics every statsEvery frames, every second if it isn't set
+	bool exportStats(const std::string& path);
+
 
 private:
 	struct {
@@ -61,18 +88,22 @@ private:
 		GLuint rtPlaceBlock;
 		GLuint rtUpdateDist;
 		GLuint rtDrawLines;
+		GLuint rtOccupancyLevels;
 	} renderShaderProperties;
 
 
+	// set from the startup Config, shaders get them as #defines
 	struct {
-		const glm::uint dimension = 256;	// edge dimension of world cube
-		const int simIterations = 4;		// total world steps between renders
+		glm::uint dimension;				// edge dimension of world cube
+		int simIterations;					// total world steps between renders
+		bool adaptiveIterations;			// simIterations is the target of a StepScheduler instead
+		voxel::CellFormat cellFormat;		// gridTexture storage, R16UI keeps velocity bits
+		glm::float32 maxDrawDist;			// ray cast distance limit
 	} physProperties;
 
 	struct {
-		const glm::uint simLocalDim = 8;				// 8 is the maximum work group dimension for a gtx 1080
-		const glm::uint maxVelocity = simLocalDim / 2;	// max velocity is limited by shader work group size
-		const glm::uint simSpacing = 2 * simLocalDim;	// space between cubes acted on by shader workgroups - the gap prevents race conditions
+		glm::uint simLocalDim;			// 8 is the maximum work group dimension for a gtx 1080
+		glm::uint simSpacing;			// space between cubes acted on by shader workgroups, twice simLocalDim - the gap prevents race conditions
 
 		GLuint ptWorkGroups;	// work groups along each cube dimension
 
@@ -81,10 +112,8 @@ private:
 		GLuint ptCurrentFlag;
 		GLuint ptPartition;
 		GLuint ptRNG;
-		GLuint ptBlockType;
-		GLuint ptBlockSize;
-		GLuint ptPlaceBlock;
 		GLuint ptDimension;
+		GLuint ptIteration;
 		//GLuint ptMaxVelocity;
 	} physShaderProperties;
 
@@ -96,36 +125,174 @@ private:
 		glm::float32 blockSize = 4.f;	// radius filled by block placement
 		glm::float32 blockDist = 50.f;	// distance from screen to place blocks
 		glm::uint updateDist = 1;		// render shader calculates block placement, this signals whether it should
-		bool distUpdated = true;
+		glm::uint distRequested = 1;	// input snapshot that last set updateDist, the first one does, input thread only
+		std::atomic<glm::uint> distConsumed{ 0 };	// input snapshot the render shader was last given, logic thread only writes it
 
 		GLuint blockLocation;
+
+		const GLuint plWork = 4;		// placement covers the brush's bounding box in groups of 4^3 voxels
+		GLuint plProgram;
+
+		GLuint plCurrentFlag;
+		GLuint plBlockType;
+		GLuint plBlockSize;
+		GLuint plIteration;
 	} blockPlacingProperties;
 
 
+	// bricks are only dispatched while something around them moves, see shaders/activity.comp
+	struct {
+		int sleepAfter;				// idle iterations before a brick sleeps, 0 dispatches every brick
+		GLuint iteration = 0;		// counts sim iterations, brick stamps are compared to it
+		GLuint bricks;				// bricks along each edge, twice ptWorkGroups
+
+		GLuint brickActivity;		// per brick, the iterations it last changed and was last stepped
+		GLuint activeBricks;		// per pass list of the bricks to dispatch
+		GLuint dispatches;			// DispatchIndirectCommand per pass
+
+		GLuint acProgram;
+
+		GLuint acIteration;
+		GLuint acCurrentFlag;
+		GLuint acBlockSize;
+		GLuint acPlaceBlock;
+	} sleepProperties;
+
+
+	// rays start just before the surfaces the last frame hit, see raycache.h and shaders/reproject.comp
+	struct {
+		int refresh;				// frames between full casts of each pixel, 0 casts every ray in full
+		GLuint frame = 0;			// staggers the full casts
+
+		GLuint hitCache;			// per pixel, the last frame's hit voxel and its material
+		GLuint rayDepth;			// per pixel, the nearest reprojected hit
+
+		GLuint rcProgram;
+
+		GLuint rcResolution;
+		GLuint rcCamPos;
+		GLuint rcCamMat;
+		GLuint rtFrame;
+	} rayCacheProperties;
+
+
 	struct {
 		GLuint gridTexture;
 	} sharedShaderProperties;
 
 
+	struct {
+		glm::uint brickShift;			// level 0 texels cover exactly one physics work group cube, log2 of simLocalDim
+		GLint levels = 0;				// each level above 0 halves the resolution down to a single texel
+
+		GLuint occupancyTexture;
+		GLuint occProgram;
+	} occupancyProperties;
+
+
+	struct {
+		const char* path = "world.vpsn";
+		std::atomic<bool> saveRequested{ false };	// set by the input thread, handled by the thread owning the GL context
+		std::atomic<bool> loadRequested{ false };
+	} snapshotProperties;
+
+
+	struct {
+		ReplayRecorder recorder;
+		ReplayLog log;
+		size_t next = 0;			// next log entry to replay
+		bool replaying = false;
+	} replayProperties;
+
+
+	// gridTexture as a window of a paged world file that follows the player
+	struct {
+		std::unique_ptr<WorldPager> pager;	// none without a world file
+		const float lookahead = .5f;		// seconds of player movement whose chunks are prefetched
+	} pagingProperties;
+
+
+	struct {
+		const int queryFrames = 4;	// frames of timer queries in flight before reading one back has to wait
+		std::string path;			// histogram export, none if empty
+	} timingProperties;
+
+
+	// gridTexture read back every few frames and reduced by WorldStatistics on the CPU
+	struct {
+		int every;								// frames between readbacks, 0 reads nothing
+		int frame = 0;							// frames since the last readback
+		bool brushed = false;					// the brush was used since the last readback, its changes aren't counted
+		std::unique_ptr<GridSampler> sampler;	// none while off
+		std::ofstream file;						// a row per readback, none if not open
+	} statsProperties;
+
+
+	// everything the logic thread reads from the input thread each frame
+	struct InputState {
+		glm::uint sequence;					// counts the snapshots, the logic thread acknowledges the one it used
+		glm::vec3 cameraPosition;			// world coordinates, a paged world's window is subtracted by the logic thread
+		glm::vec3 cameraVelocity;
+		glm::mat3 cameraMatrix;
+		glm::uint placeBlock;
+		glm::uint blockType;
+		glm::float32 blockSize;
+		glm::float32 blockDist;
+		glm::uint updateDist;
+		glm::uint drawLines;
+	};
+
+	struct {
+		TripleBuffer<InputState> state;	// written by the input thread every tick, read by the logic thread every frame without waiting
+		glm::uint sequence = 0;			// of the latest snapshot written, input thread only
+	} inputProperties;
+
+
 	struct {
 		Player player;
 	} worldObjects;
 
 
-	App();
+	App(const Config& config);
 
 	void createWindow();
 
 	void setupShaders();
 	void setupRenderShader();
 	void setupPhysicsShader();
+	void setupOccupancy();
+	void setupSleeping();
+	void setupRayCache();
+	void clearHitCache();
+	void setupStats();
 
 	void setupObjects();
 
+	std::string shaderDefines() const;
+
 	void loadPTShader();
 	void loadRTShader();
+	void loadOccupancyShader();
+	void loadPlaceShader();
+	void loadActivityShader();
+	void loadReprojectShader();
+
+	void buildOccupancyLevels();
+	void placeBlocks(const Brush& brush);
+	void scheduleBricks(const Brush& brush);
+	void wakeBricks();
+	GLuint activeBrickCount();
+	void reprojectHits(const glm::vec3& cameraPosition, const glm::mat3& cameraMatrix);
+
+	void saveWorld();
+	void loadWorld();
+
+	void openPagedWorld(const std::string& path, unsigned int worldDimension);
+
+	ReplayStep replayStep();
 
-	const std::thread logicThread(std::mutex& dataLock);
-	void inputHandler(std::mutex& dataLock);
+	const std::thread logicThread();
+	void inputHandler();
+	void publishInput();
 };
 
@@ -0,0 +1,477 @@
+// Simulation benchmark running fixed scenes on the CPU port of particlesim.comp, results as JSON or CSV
+
+#include "scenes.h"
+#include "simulation.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+
+namespace {
+	struct {
+		std::vector<scene::Kind> scenes = { scene::SandPile, scene::Waterfall, scene::DamBreak, scene::Rain };
+		std::vector<unsigned int> dimensions = { 64, 128, 256 };
+		std::vector<unsigned int> threads;	// every power of two up to the hardware thread count if empty
+		int steps = 200;
+		unsigned int seed = 1;
+		voxel::CellFormat format = voxel::CellFormat::R8UI;
+		bool claimed = false;		// Simulation::Moves::Claimed instead of the partition passes
+		int sleep = 0;				// idle iterations before a brick sleeps, 0 steps every brick
+		bool scalar = false;		// Simulation::Kernel::Scalar instead of visiting only the packed occupancy bits
+		std::vector<std::string> layouts = { layout::Linear::name() };
+		bool stencil = false;		// time neighbourhood reads in each layout instead of running the scenes
+		std::string json, csv;
+	} options;
+
+	struct Result {
+		scene::Kind scene;
+		const char* layout;
+		unsigned int dimension;
+		unsigned int threads;
+		double seconds;
+		double stepsPerSec;
+		double voxelUpdatesPerSec;	// every voxel is visited once per step
+		size_t particles;			// sand and water
+		size_t moving;				// voxels changing material over one more step after the run
+		double activeBricks;		// mean fraction of bricks stepped per step, 1 unless bricks sleep
+		double speedup;				// relative to the first layout and thread count of the same scene and dimension
+		uint32_t checksum;			// of the final world, equal across layouts and thread counts
+	};
+
+	struct StencilResult {
+		const char* layout;
+		unsigned int dimension;
+		unsigned int threads;
+		double seconds;
+		double cellsPerSec;			// cells whose 3x3x2 sand and water stencil was read
+		double speedup;				// relative to the first layout of the same dimension and thread count
+		uint32_t sum;				// of every cell read, equal across layouts
+	};
+
+	void usage(const char* name) {
+		std::cout << "usage: " << name << " [--scenes sandpile,waterfall,dambreak,rain] [--dimensions 64,128,...,1024] [--threads 1,2,...]"
+			<< " [--steps N] [--seed N] [--format 8|16|32] [--moves partitioned|claimed] [--sleep N] [--kernel scalar|packed]"
+			<< " [--layouts linear,bricked,morton] [--mode scenes|stencil] [--json FILE] [--csv FILE]" << std::endl;
+	}
+
+	std::vector<std::string> split(const char* list) {
+		std::vector<std::string> items;
+		std::istringstream in(list);
+		for (std::string item; std::getline(in, item, ',');)
+			if (!item.empty())
+				items.push_back(item);
+
+		return items;
+	}
+
+	bool parseArgs(int argc, char* argv[]) {
+		for (int i = 1; i < argc; i++) {
+			if (i + 1 >= argc) {
+				usage(argv[0]);
+				return false;
+			}
+
+			const char* value = argv[++i];
+			if (std::strcmp(argv[i - 1], "--steps") == 0)			options.steps = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--seed") == 0)		options.seed = std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--sleep") == 0)		options.sleep = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--json") == 0)		options.json = value;
+			else if (std::strcmp(argv[i - 1], "--csv") == 0)		options.csv = value;
+			else if (std::strcmp(argv[i - 1], "--scenes") == 0) {
+				options.scenes.clear();
+				for (const std::string& name : split(value)) {
+					scene::Kind kind;
+					if (!scene::parse(name, kind)) {
+						usage(argv[0]);
+						return false;
+					}
+					options.scenes.push_back(kind);
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--dimensions") == 0) {
+				options.dimensions.clear();
+				for (const std::string& d : split(value))
+					options.dimensions.push_back(std::strtoul(d.c_str(), nullptr, 10));
+			}
+			else if (std::strcmp(argv[i - 1], "--threads") == 0) {
+				options.threads.clear();
+				for (const std::string& t : split(value))
+					options.threads.push_back(std::strtoul(t.c_str(), nullptr, 10));
+			}
+			else if (std::strcmp(argv[i - 1], "--moves") == 0) {
+				if (std::strcmp(value, "partitioned") == 0)		options.claimed = false;
+				else if (std::strcmp(value, "claimed") == 0)	options.claimed = true;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--layouts") == 0) {
+				options.layouts = split(value);
+				for (const std::string& name : options.layouts) {
+					if (name != layout::Linear::name() && name != layout::Bricked::name() && name != layout::Morton::name()) {
+						usage(argv[0]);
+						return false;
+					}
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--mode") == 0) {
+				if (std::strcmp(value, "scenes") == 0)			options.stencil = false;
+				else if (std::strcmp(value, "stencil") == 0)	options.stencil = true;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--kernel") == 0) {
+				if (std::strcmp(value, "scalar") == 0)			options.scalar = true;
+				else if (std::strcmp(value, "packed") == 0)		options.scalar = false;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--format") == 0) {
+				const int bits = std::atoi(value);
+				if (bits == 8)			options.format = voxel::CellFormat::R8UI;
+				else if (bits == 16)	options.format = voxel::CellFormat::R16UI;
+				else if (bits == 32)	options.format = voxel::CellFormat::R32UI;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else {
+				usage(argv[0]);
+				return false;
+			}
+		}
+
+		if (options.threads.empty()) {
+			const unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+			for (unsigned int t = 1; t < hardware; t *= 2)
+				options.threads.push_back(t);
+			options.threads.push_back(hardware);
+		}
+
+		const bool valid = options.steps > 0 && !options.scenes.empty() && !options.dimensions.empty() && !options.layouts.empty()
+			&& std::count(options.dimensions.begin(), options.dimensions.end(), 0u) == 0
+			&& std::count(options.threads.begin(), options.threads.end(), 0u) == 0;
+		if (!valid)
+			usage(argv[0]);
+
+		return valid;
+	}
+
+	template<typename Cell>
+	size_t countParticles(const VoxelGrid<Cell>& grid) {
+		size_t count = 0;
+		for (size_t i = 0; i < grid.size(); i++) {
+			const uint32_t type = grid.data()[i] & voxel::TYPE;
+			count += type == voxel::SAND || type == voxel::WATER;
+		}
+
+		return count;
+	}
+
+	// FNV-1a over cell types, the flag bit alternates every step and velocity bits only exist in wider formats
+	template<typename Cell>
+	uint32_t checksum(const VoxelGrid<Cell>& grid) {
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < grid.size(); i++)
+			h = (h ^ (grid.data()[i] & voxel::TYPE)) * 16777619u;
+
+		return h;
+	}
+
+	// scenes are built in a linear grid and copied into the simulation's layout, and back for the checksum
+	template<typename Cell, typename Layout>
+	Result measure(scene::Kind kind, unsigned int dimension, unsigned int threads) {
+		using clock = std::chrono::steady_clock;
+
+		Simulation<Cell, Layout> sim(dimension, threads);
+		sim.seed(options.seed);
+		if (options.claimed)
+			sim.setMoves(Simulation<Cell, Layout>::Moves::Claimed);
+		if (options.scalar)
+			sim.setKernel(Simulation<Cell, Layout>::Kernel::Scalar);
+
+		VoxelGrid<Cell> world(dimension);
+		scene::build(kind, world);
+		copyCells(world, sim.grid());
+		sim.setSleep(options.sleep);
+
+		size_t active = 0;
+		const auto start = clock::now();
+		for (int step = 0; step < options.steps; step++) {
+			sim.setBrush(scene::brush(kind, dimension, step));
+			sim.step();
+			active += sim.activeBricks();
+		}
+		const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+		copyCells(sim.grid(), world);
+
+		Result result;
+		result.scene = kind;
+		result.layout = Layout::name();
+		result.dimension = dimension;
+		result.threads = sim.threads();
+		result.seconds = seconds;
+		result.stepsPerSec = options.steps / seconds;
+		result.voxelUpdatesPerSec = double(dimension) * dimension * dimension * options.steps / seconds;
+		result.particles = countParticles(world);
+		result.checksum = checksum(world);
+		result.activeBricks = double(active) / (double(sim.brickCount()) * std::max(options.steps, 1));
+		result.speedup = 1.;
+
+		// untimed extra step to see how much of the world is still in motion
+		const std::vector<Cell> before(sim.grid().data(), sim.grid().data() + sim.grid().size());
+		sim.setBrush(scene::brush(kind, dimension, options.steps));
+		sim.step();
+
+		result.moving = 0;
+		for (size_t i = 0; i < before.size(); i++)
+			result.moving += ((before[i] ^ sim.grid().data()[i]) & voxel::TYPE) != 0;
+
+		return result;
+	}
+
+	template<typename Cell>
+	Result measureIn(const std::string& layoutName, scene::Kind kind, unsigned int dimension, unsigned int threads) {
+		if (layoutName == layout::Bricked::name())
+			return measure<Cell, layout::Bricked>(kind, dimension, threads);
+		if (layoutName == layout::Morton::name())
+			return measure<Cell, layout::Morton>(kind, dimension, threads);
+		return measure<Cell, layout::Linear>(kind, dimension, threads);
+	}
+
+	// reads the cells sand and water probe around every cell, their own layer and the one below, visiting the
+	// world brick by brick like the simulation passes, on a rain scene so the reads see a mix of materials
+	template<typename Cell, typename Layout>
+	StencilResult measureStencil(unsigned int dimension, unsigned int threads) {
+		using clock = std::chrono::steady_clock;
+
+		VoxelGrid<Cell> world(dimension);
+		scene::build(scene::Rain, world);
+		VoxelGrid<Cell, Layout> grid(dimension);
+		copyCells(world, grid);
+
+		ThreadPool pool(threads);
+		const int dim = int(dimension);
+		const int bricks = (dim + 7) / 8;
+		std::vector<uint32_t> sums(size_t(bricks) * bricks * bricks);
+
+		const auto start = clock::now();
+		for (int step = 0; step < options.steps; step++) {
+			pool.parallelFor(sums.size(), [&](size_t i) {
+				const int x0 = int(i % bricks) * 8, y0 = int(i / bricks % bricks) * 8, z0 = int(i / (size_t(bricks) * bricks)) * 8;
+				uint32_t sum = sums[i];
+				for (int z = std::max(z0, 1); z < std::min(z0 + 8, dim - 1); z++)
+					for (int y = std::max(y0, 1); y < std::min(y0 + 8, dim); y++)
+						for (int x = std::max(x0, 1); x < std::min(x0 + 8, dim - 1); x++)
+							for (int dz = -1; dz <= 1; dz++)
+								for (int dx = -1; dx <= 1; dx++)
+									sum += grid.get(x + dx, y, z + dz) + grid.get(x + dx, y - 1, z + dz);
+				sums[i] = sum;
+			});
+		}
+		const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+		StencilResult result;
+		result.layout = Layout::name();
+		result.dimension = dimension;
+		result.threads = pool.size();
+		result.seconds = seconds;
+		result.cellsPerSec = double(std::max(dim - 2, 0)) * std::max(dim - 2, 0) * std::max(dim - 1, 0) * options.steps / seconds;
+		result.speedup = 1.;
+
+		result.sum = 0;
+		for (uint32_t sum : sums)
+			result.sum += sum;
+
+		return result;
+	}
+
+	template<typename Cell>
+	StencilResult measureStencilIn(const std::string& layoutName, unsigned int dimension, unsigned int threads) {
+		if (layoutName == layout::Bricked::name())
+			return measureStencil<Cell, layout::Bricked>(dimension, threads);
+		if (layoutName == layout::Morton::name())
+			return measureStencil<Cell, layout::Morton>(dimension, threads);
+		return measureStencil<Cell, layout::Linear>(dimension, threads);
+	}
+
+	bool writeJSON(const std::string& path, const std::vector<Result>& results) {
+		std::ofstream file(path);
+		file << "{\n"
+			<< "  \"format\": \"" << voxel::cellFormatName(options.format) << "\",\n"
+			<< "  \"steps\": " << options.steps << ",\n"
+			<< "  \"seed\": " << options.seed << ",\n"
+			<< "  \"sleep\": " << options.sleep << ",\n"
+			<< "  \"kernel\": \"" << (options.scalar ? "scalar" : "packed") << "\",\n"
+			<< "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n"
+			<< "  \"results\": [\n";
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			file << "    { \"scene\": \"" << scene::name(r.scene) << "\", \"layout\": \"" << r.layout << "\", \"dimension\": " << r.dimension << ", \"threads\": " << r.threads
+				<< ", \"seconds\": " << r.seconds << ", \"stepsPerSec\": " << r.stepsPerSec << ", \"voxelUpdatesPerSec\": " << r.voxelUpdatesPerSec
+				<< ", \"particles\": " << r.particles << ", \"moving\": " << r.moving << ", \"activeBricks\": " << r.activeBricks << ", \"speedup\": " << r.speedup
+				<< ", \"checksum\": \"" << std::hex << std::setw(8) << std::setfill('0') << r.checksum << std::dec << std::setfill(' ') << "\" }"
+				<< (i + 1 < results.size() ? "," : "") << "\n";
+		}
+
+		file << "  ]\n}\n";
+		return bool(file);
+	}
+
+	bool writeCSV(const std::string& path, const std::vector<Result>& results) {
+		std::ofstream file(path);
+		file << "scene,layout,dimension,threads,format,steps,seconds,stepsPerSec,voxelUpdatesPerSec,particles,moving,activeBricks,speedup,checksum\n";
+
+		for (const Result& r : results) {
+			file << scene::name(r.scene) << "," << r.layout << "," << r.dimension << "," << r.threads << "," << voxel::cellFormatName(options.format) << "," << options.steps
+				<< "," << r.seconds << "," << r.stepsPerSec << "," << r.voxelUpdatesPerSec << "," << r.particles << "," << r.moving << "," << r.activeBricks << "," << r.speedup
+				<< "," << std::hex << std::setw(8) << std::setfill('0') << r.checksum << std::dec << std::setfill(' ') << "\n";
+		}
+
+		return bool(file);
+	}
+
+	bool writeStencilJSON(const std::string& path, const std::vector<StencilResult>& results) {
+		std::ofstream file(path);
+		file << "{\n"
+			<< "  \"format\": \"" << voxel::cellFormatName(options.format) << "\",\n"
+			<< "  \"steps\": " << options.steps << ",\n"
+			<< "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n"
+			<< "  \"stencil\": [\n";
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const StencilResult& r = results[i];
+			file << "    { \"layout\": \"" << r.layout << "\", \"dimension\": " << r.dimension << ", \"threads\": " << r.threads
+				<< ", \"seconds\": " << r.seconds << ", \"cellsPerSec\": " << r.cellsPerSec << ", \"speedup\": " << r.speedup << " }"
+				<< (i + 1 < results.size() ? "," : "") << "\n";
+		}
+
+		file << "  ]\n}\n";
+		return bool(file);
+	}
+
+	bool writeStencilCSV(const std::string& path, const std::vector<StencilResult>& results) {
+		std::ofstream file(path);
+		file << "layout,dimension,threads,format,steps,seconds,cellsPerSec,speedup\n";
+
+		for (const StencilResult& r : results) {
+			file << r.layout << "," << r.dimension << "," << r.threads << "," << voxel::cellFormatName(options.format) << "," << options.steps
+				<< "," << r.seconds << "," << r.cellsPerSec << "," << r.speedup << "\n";
+		}
+
+		return bool(file);
+	}
+}
+
+
+template<typename Cell>
+int run() {
+	std::vector<Result> results;
+	bool consistent = true;
+
+	for (scene::Kind kind : options.scenes) {
+		for (unsigned int dimension : options.dimensions) {
+			const size_t first = results.size();
+
+			for (const std::string& layoutName : options.layouts) {
+				for (unsigned int threads : options.threads) {
+					Result result = measureIn<Cell>(layoutName, kind, dimension, threads);
+					result.speedup = result.stepsPerSec / (results.size() > first ? results[first].stepsPerSec : result.stepsPerSec);
+
+					// the simulation is deterministic, a different world means a thread count or layout changed the rules
+					if (results.size() > first && result.checksum != results[first].checksum) {
+						std::cout << "warning: " << scene::name(kind) << " " << dimension << "^3 differs between " << results[first].layout << " on " << results[first].threads
+							<< " and " << result.layout << " on " << result.threads << " threads" << std::endl;
+						consistent = false;
+					}
+
+					std::cout << std::left << std::setw(10) << scene::name(kind) << std::setw(8) << result.layout << std::right << std::setw(5) << dimension << "^3 " << std::setw(3) << result.threads << " threads\t"
+						<< result.stepsPerSec << " steps/s\t" << result.voxelUpdatesPerSec / 1e6 << "M voxels/s\t" << result.particles << " particles\t"
+						<< result.moving << " moving\t" << result.activeBricks * 100. << "% bricks\t" << result.speedup << "x" << std::endl;
+
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	if (!options.json.empty() && !writeJSON(options.json, results)) {
+		std::cout << "could not write " << options.json << std::endl;
+		return 1;
+	}
+
+	if (!options.csv.empty() && !writeCSV(options.csv, results)) {
+		std::cout << "could not write " << options.csv << std::endl;
+		return 1;
+	}
+
+	return consistent ? 0 : 2;
+}
+
+template<typename Cell>
+int runStencil() {
+	std::vector<StencilResult> results;
+	bool consistent = true;
+
+	for (unsigned int dimension : options.dimensions) {
+		for (unsigned int threads : options.threads) {
+			const size_t first = results.size();
+
+			for (const std::string& layoutName : options.layouts) {
+				StencilResult result = measureStencilIn<Cell>(layoutName, dimension, threads);
+				result.speedup = result.cellsPerSec / (results.size() > first ? results[first].cellsPerSec : result.cellsPerSec);
+
+				if (results.size() > first && result.sum != results[first].sum) {
+					std::cout << "warning: " << dimension << "^3 reads differ between " << results[first].layout << " and " << result.layout << std::endl;
+					consistent = false;
+				}
+
+				std::cout << std::left << std::setw(8) << result.layout << std::right << std::setw(5) << dimension << "^3 " << std::setw(3) << result.threads << " threads\t"
+					<< result.cellsPerSec / 1e6 << "M stencils/s\t" << result.speedup << "x" << std::endl;
+
+				results.push_back(result);
+			}
+		}
+	}
+
+	if (!options.json.empty() && !writeStencilJSON(options.json, results)) {
+		std::cout << "could not write " << options.json << std::endl;
+		return 1;
+	}
+
+	if (!options.csv.empty() && !writeStencilCSV(options.csv, results)) {
+		std::cout << "could not write " << options.csv << std::endl;
+		return 1;
+	}
+
+	return consistent ? 0 : 2;
+}
+
+
+int main(int argc, char* argv[]) {
+	if (!parseArgs(argc, argv))
+		return 1;
+
+	switch (options.format) {
+	case voxel::CellFormat::R8UI:	return options.stencil ? runStencil<uint8_t>() : run<uint8_t>();
+	case voxel::CellFormat::R16UI:	return options.stencil ? runStencil<uint16_t>() : run<uint16_t>();
+	default:						return options.stencil ? runStencil<uint32_t>() : run<uint32_t>();
+	}
+}
@@ -0,0 +1,87 @@
+#include "camera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+
+void Camera::basis(float right[3], float up[3], float forward[3]) const {
+	forward[0] = std::cos(pitch) * std::cos(yaw);
+	forward[1] = std::sin(pitch);
+	forward[2] = std::cos(pitch) * std::sin(yaw);
+
+	// right = normalize(cross(forward, worldUp)), up = cross(right, forward)
+	const float length = std::sqrt(forward[0] * forward[0] + forward[2] * forward[2]);
+	right[0] = -forward[2] / length;
+	right[1] = 0.f;
+	right[2] = forward[0] / length;
+
+	up[0] = right[1] * forward[2] - right[2] * forward[1];
+	up[1] = right[2] * forward[0] - right[0] * forward[2];
+	up[2] = right[0] * forward[1] - right[1] * forward[0];
+}
+
+
+CameraPath CameraPath::orbit(unsigned int dimension) {
+	const float pi = 3.14159265f;
+	const float center = dimension / 2.f;
+	const float radius = (dimension / 2.f + 30.f) * std::sqrt(2.f);
+
+	// aimed at the lower quarter of the world where particles settle
+	const float pitch = -std::atan2(dimension + 30.f - dimension / 4.f, radius);
+
+	CameraPath path;
+	for (int i = 0; i <= 16; i++) {
+		const float angle = -2.35f + 2.f * pi * i / 16.f;
+
+		Camera camera;
+		camera.position[0] = center - std::cos(angle) * radius;
+		camera.position[1] = float(dimension + 30);
+		camera.position[2] = center - std::sin(angle) * radius;
+		camera.yaw = angle;
+		camera.pitch = pitch;
+		path.keyframes.push_back(camera);
+	}
+
+	return path;
+}
+
+bool CameraPath::load(const std::string& path, CameraPath& cameraPath) {
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	cameraPath.keyframes.clear();
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		Camera camera;
+		if (fields >> camera.position[0] >> camera.position[1] >> camera.position[2] >> camera.yaw >> camera.pitch)
+			cameraPath.keyframes.push_back(camera);
+	}
+
+	return !cameraPath.keyframes.empty();
+}
+
+
+Camera CameraPath::at(float t) const {
+	if (keyframes.size() == 1)
+		return keyframes.front();
+
+	const float frame = std::min(std::max(t, 0.f), 1.f) * (keyframes.size() - 1);
+	const size_t i = std::min(size_t(frame), keyframes.size() - 2);
+	const float f = frame - float(i);
+
+	const Camera& a = keyframes[i];
+	const Camera& b = keyframes[i + 1];
+
+	Camera camera;
+	for (int c = 0; c < 3; c++)
+		camera.position[c] = a.position[c] + (b.position[c] - a.position[c]) * f;
+	camera.yaw = a.yaw + (b.yaw - a.yaw) * f;
+	camera.pitch = a.pitch + (b.pitch - a.pitch) * f;
+
+	return camera;
+}
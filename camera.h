@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// yaw and pitch follow Player::camera.direction, App starts at { -2.35, -.3 } looking back at the world
+struct Camera
+{
+	float position[3] = { 0.f, 0.f, 0.f };
+	float yaw = 0.f;
+	float pitch = 0.f;
+
+	// world space axes, a screen offset (x, y) maps to right * x + up * y + forward like cameraMat in dda.comp
+	void basis(float right[3], float up[3], float forward[3]) const;
+};
+
+
+// keyframed camera positions and orientations, linearly interpolated
+class CameraPath
+{
+public:
+	// circles the world at App's starting height and distance, looking down at the settled particles
+	static CameraPath orbit(unsigned int dimension);
+
+	// one "x y z yaw pitch" keyframe per line, evenly spaced over the path
+	static bool load(const std::string& path, CameraPath& cameraPath);
+
+	// t runs from 0 at the first keyframe to 1 at the last
+	Camera at(float t) const;
+
+
+private:
+	std::vector<Camera> keyframes;
+};
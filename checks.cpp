@@ -0,0 +1,895 @@
+// Checks of the CPU code paths against references and invariants, the repo's regression suite
+// Each check prints what differed from what it expected and the run exits with 1 if any failed, so it can gate a
+// build. --checks runs some of them by name.
+
+#include "config.h"
+#include "decomposition.h"
+#include "feed.h"
+#include "frametiming.h"
+#include "pagedworld.h"
+#include "rules.h"
+#include "scenes.h"
+#include "simulation.h"
+#include "stepscheduler.h"
+#include "triplebuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+	struct {
+		std::vector<std::string> checks;	// every check if empty
+	} options;
+
+	// a check's failed expectations, each is printed so one run lists every difference
+	class Verdict
+	{
+	public:
+		bool expect(bool condition, const std::string& what) {
+			if (!condition) {
+				std::cout << "\t" << what << std::endl;
+				failures++;
+			}
+			return condition;
+		}
+
+		bool passed() const { return failures == 0; }
+
+
+	private:
+		int failures = 0;
+	};
+
+	template<typename... Parts>
+	std::string text(const Parts&... parts) {
+		std::ostringstream out;
+		(out << ... << parts);
+		return out.str();
+	}
+
+
+	// ChronoClock fed scripted timestamps, the durations and so the histogram and its percentiles are known exactly
+	void checkTimings(Verdict& v) {
+		// frame i takes i microseconds, begin and end read the next two timestamps
+		std::vector<uint64_t> stamps;
+		for (uint64_t i = 1; i <= 100; i++) {
+			stamps.push_back(i * 1000000);
+			stamps.push_back(i * 1000000 + i * 1000);
+		}
+		size_t nextStamp = 0;
+		ChronoClock clock(1, [&]() { return stamps[nextStamp++]; });
+
+		FrameTimings timings({ "sim" });
+		int observed = 0;
+		timings.observe([&](int, uint64_t) { observed++; });
+
+		for (int i = 0; i < 100; i++) {
+			clock.begin(0);
+			clock.end(0);
+		}
+		v.expect(timings.total(0).count() == 0, "measurements reached the timings before collect");
+		clock.collect(timings);
+
+		const TimingHistogram& h = timings.total(0);
+		v.expect(h.count() == 100 && observed == 100, text("collected ", h.count(), " samples and observed ", observed, ", expected 100"));
+		v.expect(h.min() == 1000 && h.max() == 100000, text("min ", h.min(), " max ", h.max(), ", expected 1000 and 100000"));
+		v.expect(h.sum() == 5050000, text("sum ", h.sum(), ", expected 5050000"));
+
+		// 8 buckets per power of two: 1000ns is in [512, 1024) whose eighths are 64ns wide
+		v.expect(TimingHistogram::bucket(5) == 5 && TimingHistogram::bucketUpper(5) == 6, "values below 8 don't have buckets of their own");
+		const int b = TimingHistogram::bucket(1000);
+		v.expect(TimingHistogram::bucketLower(b) == 960 && TimingHistogram::bucketUpper(b) == 1024,
+			text("1000ns is in [", TimingHistogram::bucketLower(b), ", ", TimingHistogram::bucketUpper(b), "), expected [960, 1024)"));
+		for (int bucket = 0; bucket + 1 < TimingHistogram::bucketCount; bucket++) {
+			if (!v.expect(TimingHistogram::bucketUpper(bucket) == TimingHistogram::bucketLower(bucket + 1), text("bucket ", bucket, " doesn't end where the next starts")))
+				break;
+		}
+
+		uint64_t bucketed = 0;
+		for (uint64_t i = 1; i <= 100; i++) {
+			const int bucket = TimingHistogram::bucket(i * 1000);
+			v.expect(TimingHistogram::bucketLower(bucket) <= i * 1000 && i * 1000 < TimingHistogram::bucketUpper(bucket), text(i * 1000, "ns is outside its bucket"));
+		}
+		for (int bucket = 0; bucket < TimingHistogram::bucketCount; bucket++)
+			bucketed += h.bucketSamples(bucket);
+		v.expect(bucketed == 100, text(bucketed, " samples in the buckets, expected 100"));
+
+		// percentiles are the middle of the sample's bucket, clamped to the exact min and max
+		v.expect(h.percentile(.5) == 51199, text("p50 ", h.percentile(.5), ", expected 51199, the middle of [49152, 53248)"));
+		v.expect(h.percentile(.95) == 94207, text("p95 ", h.percentile(.95), ", expected 94207, the middle of [90112, 98304)"));
+		v.expect(h.percentile(.99) == 100000, text("p99 ", h.percentile(.99), ", expected the max 100000"));
+		v.expect(h.percentile(0.) == 1000, text("p0 ", h.percentile(0.), ", expected the min 1000"));
+		for (int p = 1; p <= 100; p++) {
+			const uint64_t exact = uint64_t(p) * 1000, found = h.percentile(p / 100.);
+			v.expect((found > exact ? found - exact : exact - found) * 16 <= exact, text("p", p, " ", found, " is more than 1/16 off ", exact));
+		}
+
+		// the window restarts, the run total keeps everything
+		timings.resetWindow();
+		v.expect(timings.window(0).count() == 0 && timings.total(0).count() == 100, "resetWindow didn't clear only the window");
+		v.expect(timings.summary().empty(), "an empty window has a summary");
+
+		// halves merged give the same histogram as adding every sample
+		TimingHistogram low, high;
+		for (uint64_t i = 1; i <= 100; i++)
+			(i <= 50 ? low : high).add(i * 1000);
+		low.merge(high);
+		bool same = low.count() == h.count() && low.sum() == h.sum() && low.min() == h.min() && low.max() == h.max();
+		for (int bucket = 0; bucket < TimingHistogram::bucketCount; bucket++)
+			same = same && low.bucketSamples(bucket) == h.bucketSamples(bucket);
+		v.expect(same, "merged halves differ from the whole");
+	}
+
+
+	// a record of the given payload filled with one byte, published whole
+	void publishFilled(FeedWriter& writer, uint32_t bytes, uint8_t fill) {
+		uint8_t* payload = writer.reserve(feed::FRAME, 0, bytes);
+		std::memset(payload, fill, bytes);
+		writer.commit(bytes);
+	}
+
+	// a reader lapped by a reservation the writer overwrote in full but committed trimmed, like a uniform chunk, has
+	// to find its record overwritten even after the next, smaller reservation
+	void checkFeed(Verdict& v) {
+		FeedWriter writer;
+		if (!v.expect(writer.create("particlesim-checks", 0, 1024), "couldn't create a feed"))
+			return;
+
+		FeedReader reader;
+		if (!v.expect(reader.open("particlesim-checks"), "couldn't open the feed"))
+			return;
+
+		// a record at 64, read in place
+		publishFilled(writer, 48 - sizeof(feed::RecordHeader), 0x11);
+		publishFilled(writer, 200, 0xAA);
+		FeedReader::Record record;
+		v.expect(reader.next(record) && reader.next(record) && record.bytes == 200, "the reader didn't get the records published");
+		const uint8_t* payload = record.payload;
+		v.expect(reader.intact() && payload[0] == 0xAA, "a record was overwritten before the ring wrapped");
+
+		// up to 720, then a reservation padded to the start of the ring overwriting everything before 1520 - 1024,
+		// the record included, committed with no payload
+		publishFilled(writer, 480 - sizeof(feed::RecordHeader), 0x22);
+		uint8_t* trimmed = writer.reserve(feed::CHUNK, 0, 480);
+		std::memset(trimmed, 0x55, 480);
+		writer.commit(0);
+		v.expect(!reader.intact(), "a record under a trimmed reservation reads intact");
+
+		// the next reservation ends well before the trimmed one did
+		uint8_t* small = writer.reserve(feed::STEP, 0, 0);
+		v.expect(small != nullptr, "the next reservation failed");
+		writer.commit(0);
+		v.expect(payload[0] == 0x55, "the trimmed reservation didn't overwrite the record, the check lost its setup");
+		v.expect(!reader.intact(), "a record overwritten by a trimmed reservation reads intact after the next one");
+		v.expect(reader.lapped(), "the reader behind a trimmed reservation isn't lapped");
+
+		reader.close();
+	}
+
+
+	// frames of a made up cost model, the simulation's cost reaching the scheduler a few frames late like timer queries
+	class CostModel
+	{
+	public:
+		CostModel(const StepScheduler::Settings& settings, unsigned int seed) : scheduler(settings), random(seed) {}
+
+		// one frame whose steps cost stepNs each, noise is the largest relative error of a measurement
+		int frame(double stepNs, double otherNs, double noise = 0.) {
+			const int steps = scheduler.next();
+			inFlight.push_back(uint64_t(steps * stepNs * jitter(noise)));
+			if (inFlight.size() > latency) {
+				scheduler.simMeasured(inFlight.front());
+				inFlight.pop_front();
+			}
+			scheduler.otherMeasured(0, uint64_t(otherNs * jitter(noise)));
+			return steps;
+		}
+
+		StepScheduler scheduler;
+
+
+	private:
+		const size_t latency = 3;
+		std::deque<uint64_t> inFlight;
+		std::minstd_rand random;
+
+		double jitter(double noise) { return 1. + noise * (2. * double(random()) / double(random.max()) - 1.); }
+	};
+
+	// StepScheduler fed synthetic costs: the rate settles on what fits, frames stay within budget, noise inside the
+	// hysteresis band leaves the plan alone and a lasting change of cost moves it
+	void checkScheduler(Verdict& v) {
+		const StepScheduler::Settings settings;
+		const double ms = 1e6;
+
+		// cheap steps, the nominal rate fits and is all that's run
+		{
+			CostModel model(settings, 1);
+			int steps = 0;
+			for (int f = 0; f < 400; f++) {
+				const int frameSteps = model.frame(1 * ms, 2 * ms);
+				steps += f < 100 ? 0 : frameSteps;
+			}
+			v.expect(steps == 300 * settings.nominal, text("cheap steps averaged ", steps / 300., " per frame, expected the nominal ", settings.nominal));
+			v.expect(model.scheduler.last().debt == 0., text(model.scheduler.last().debt, " steps owed with room to spare"));
+		}
+
+		// 5ms steps and 1ms of rendering leave room for (15 - 1) / 5 = 2.8 steps in the 90% of a 16.7ms frame planned
+		// for, 3 steps still fit the whole frame so the fraction is carried into most frames
+		const double fits = (settings.frameNs * settings.headroom - 1 * ms) / (5 * ms);
+		CostModel model(settings, 2);
+		for (int f = 0; f < 100; f++)
+			model.frame(5 * ms, 1 * ms);
+		const StepScheduler::Decision& decision = model.scheduler.last();
+		v.expect(std::abs(decision.rate - fits) <= settings.hysteresis * fits, text("the rate settled on ", decision.rate, ", expected about ", fits));
+
+		int steps = 0, overBudget = 0, rateChanges = 0;
+		double rate = decision.rate;
+		for (int f = 0; f < 500; f++) {
+			const int frameSteps = model.frame(5 * ms, 1 * ms, .1);
+			steps += frameSteps;
+			overBudget += frameSteps * 5 * ms + 1 * ms > settings.frameNs;
+			rateChanges += decision.rate != rate;
+			rate = decision.rate;
+		}
+		v.expect(std::abs(steps / 500. - rate) < .02, text("frames averaged ", steps / 500., " steps, the rate planned ", rate));
+		v.expect(overBudget == 0, text(overBudget, " of 500 frames were planned past the budget"));
+		v.expect(rateChanges == 0, text("10% measurement noise changed the rate ", rateChanges, " times"));
+		v.expect(decision.debt == settings.maxDebt, text(decision.debt, " steps owed after running short for 600 frames, expected the cap ", settings.maxDebt));
+
+		// the same noise without the band does move it
+		{
+			StepScheduler::Settings eager = settings;
+			eager.hysteresis = 0.;
+			CostModel noisy(eager, 2);
+			int changes = 0;
+			double last = noisy.scheduler.last().rate;
+			for (int f = 0; f < 600; f++) {
+				noisy.frame(5 * ms, 1 * ms, .1);
+				changes += f >= 100 && noisy.scheduler.last().rate != last;
+				last = noisy.scheduler.last().rate;
+			}
+			v.expect(changes > 100, text("without hysteresis the noise changed the rate only ", changes, " times"));
+		}
+
+		// a fraction of a step that doesn't fit the whole frame waits, 5ms steps after 3ms of rendering fit 2.4 in
+		// the planned share but only 2 in the frame
+		{
+			CostModel slow(settings, 3);
+			int most = 0;
+			for (int f = 0; f < 200; f++) {
+				const int frameSteps = slow.frame(5 * ms, 3 * ms);
+				most = std::max(most, f < 10 ? 0 : frameSteps);
+			}
+			v.expect(most == 2, text("frames of 5ms steps after 3ms of rendering ran up to ", most, " steps, 2 fit"));
+		}
+
+		// steps getting twice as fast: the rate follows within a few frames of latency and smoothing, and the room
+		// beyond the nominal rate pays the debt back
+		const double faster = (settings.frameNs * settings.headroom - 1 * ms) / (2.5 * ms);
+		int frames = 0;
+		while (frames < 60 && std::abs(decision.rate - faster) > settings.hysteresis * faster) {
+			model.frame(2.5 * ms, 1 * ms);
+			frames++;
+		}
+		v.expect(frames < 30, text("the rate took ", frames, " frames to follow the steps' cost halving, now ", decision.rate, " of ", faster));
+
+		const double owed = decision.debt;
+		steps = 0;
+		for (int f = 0; f < 100; f++)
+			steps += model.frame(2.5 * ms, 1 * ms);
+		v.expect(steps > 100 * settings.nominal && decision.debt < owed, text(steps, " steps in 100 frames paid back ", owed - decision.debt, " of ", owed, " owed"));
+	}
+
+
+	// a stand-in for App::InputState, which holds glm types, every field stamped with the snapshot's sequence
+	struct StampedInput {
+		uint32_t sequence;
+		uint32_t fields[31];
+	};
+
+	// one thread writes sequence numbered snapshots as fast as it can while another reads them, a read mixing two
+	// snapshots or going back to an older one would be a torn or stale handoff
+	void checkTripleBuffer(Verdict& v) {
+		const uint32_t writes = 1 << 21;
+		TripleBuffer<StampedInput> buffer;
+		std::atomic<bool> done{ false };
+
+		std::thread writer([&]() {
+			StampedInput input;
+			for (uint32_t sequence = 1; sequence <= writes; sequence++) {
+				input.sequence = sequence;
+				for (uint32_t& field : input.fields)
+					field = sequence;
+				buffer.write(input);
+
+				// lets the reader in between writes on machines with fewer cores than threads
+				if (sequence % 1024 == 0)
+					std::this_thread::yield();
+			}
+			done = true;
+		});
+
+		uint64_t reads = 0, torn = 0, backwards = 0, fresh = 0;
+		uint32_t last = 0;
+		for (bool finished = false; !finished;) {
+			finished = done;
+			const StampedInput& input = buffer.read();
+			for (uint32_t field : input.fields) {
+				if (field != input.sequence) {
+					torn++;
+					break;
+				}
+			}
+			backwards += input.sequence < last;
+			fresh += input.sequence > last;
+			last = std::max(last, input.sequence);
+			reads++;
+		}
+		writer.join();
+
+		v.expect(torn == 0, text(torn, " of ", reads, " reads mixed two snapshots"));
+		v.expect(backwards == 0, text(backwards, " of ", reads, " reads went back to an older snapshot"));
+		v.expect(last == writes, text("the last read saw snapshot ", last, " of ", writes));
+		std::cout << "\t" << reads << " reads, " << fresh << " of them newer than the one before" << std::endl;
+	}
+
+
+	// cells of the window that differ from the dense grid at the window's origin
+	size_t windowDifferences(const VoxelGrid<uint16_t>& window, const VoxelGrid<uint16_t>& world, const int origin[3]) {
+		size_t differences = 0;
+		for (int z = 0; z < int(window.dimension()); z++)
+			for (int y = 0; y < int(window.dimension()); y++)
+				for (int x = 0; x < int(window.dimension()); x++)
+					differences += window.get(x, y, z) != world.get(origin[0] + x, origin[1] + y, origin[2] + z);
+
+		return differences;
+	}
+
+	// a window walking a paged world through a cache too small to hold it twice, edited as it goes, against a dense
+	// grid of the whole world getting the same edits, then the file reopened and read chunk by chunk
+	void checkPagedWorld(Verdict& v) {
+		const unsigned int worldDim = 128, windowDim = 64;
+		const int edge = int(paged::chunkDim), perAxis = int(worldDim / paged::chunkDim);
+		const std::string path = (std::filesystem::temp_directory_path() / "particlesim-checks.vppw").string();
+		std::filesystem::remove(path);
+
+		VoxelGrid<uint16_t> world(worldDim);
+		std::minstd_rand random(7);
+
+		// corners of the world the player walks between, the window clamps against every face on the way
+		const float waypoints[][3] = {
+			{ 32, 32, 32 }, { 96, 32, 32 }, { 96, 96, 32 }, { 96, 96, 96 }, { 0, 96, 96 }, { 0, 0, 127 }, { 127, 0, 0 }, { 64, 64, 64 },
+		};
+
+		ChunkCache<uint16_t>::Stats walked;
+		{
+			PagedWorld<uint16_t> paged(windowDim, 10);
+			if (!v.expect(paged.open(path, worldDim), text("couldn't create ", path)))
+				return;
+
+			VoxelGrid<uint16_t> window(windowDim);
+			paged.load(window);
+
+			int moves = 0;
+			for (size_t w = 0; w + 1 < std::size(waypoints); w++) {
+				const float* from = waypoints[w];
+				const float* to = waypoints[w + 1];
+				const int steps = 16;
+				const float velocity[3] = { (to[0] - from[0]) / steps, (to[1] - from[1]) / steps, (to[2] - from[2]) / steps };
+
+				for (int s = 1; s <= steps; s++) {
+					const float position[3] = { from[0] + velocity[0] * s, from[1] + velocity[1] * s, from[2] + velocity[2] * s };
+					paged.prefetch(position, velocity, 4);
+					if (paged.follow(position, window)) {
+						moves++;
+						const size_t differences = windowDifferences(window, world, paged.origin());
+						v.expect(differences == 0, text("the window at ", paged.origin()[0], ",", paged.origin()[1], ",", paged.origin()[2], " has ", differences, " cells the world doesn't"));
+					}
+
+					// a few edits per step, not in every chunk, so some stay clean
+					const int* origin = paged.origin();
+					for (int e = 0; e < 8; e++) {
+						const int x = int(random() % 32), y = int(random() % windowDim), z = int(random() % windowDim);
+						const uint32_t cell = uint32_t(random() % 0xffff) + 1;
+						window.set(x, y, z, cell);
+						world.set(origin[0] + x, origin[1] + y, origin[2] + z, cell);
+					}
+				}
+			}
+
+			v.expect(paged.save(window), "save failed");
+			walked = paged.chunks().stats();
+			v.expect(moves >= 6, text("the window moved ", moves, " times, expected at least 6"));
+		}
+
+		v.expect(walked.evictions > 0, "nothing was evicted, the cache held the whole walk");
+		v.expect(walked.prefetches > 0, "nothing was prefetched");
+		v.expect(walked.writeBacks <= walked.misses + walked.prefetches, text(walked.writeBacks, " write backs of ", walked.misses + walked.prefetches, " loads"));
+		std::cout << "\t" << walked.hits << " hits, " << walked.misses << " misses, " << walked.prefetches << " prefetches, "
+			<< walked.evictions << " evictions, " << walked.writeBacks << " write backs" << std::endl;
+
+		{
+			// every chunk of the file against the world, the chunks no edit reached were never written and read as air
+			ChunkCache<uint16_t> reopened(1);
+			if (!v.expect(reopened.open(path, worldDim), "couldn't reopen the world file"))
+				return;
+
+			int differing = 0, untouched = 0;
+			for (int cz = 0; cz < perAxis; cz++) {
+				for (int cy = 0; cy < perAxis; cy++) {
+					for (int cx = 0; cx < perAxis; cx++) {
+						const uint16_t* cells = reopened.read(reopened.chunkIndex(cx, cy, cz));
+						bool same = true, air = true;
+						for (int z = 0; z < edge; z++) {
+							for (int y = 0; y < edge; y++) {
+								for (int x = 0; x < edge; x++) {
+									const uint16_t cell = *cells++;
+									same = same && cell == world.get(cx * edge + x, cy * edge + y, cz * edge + z);
+									air = air && cell == voxel::AIR;
+								}
+							}
+						}
+						differing += !same;
+						untouched += air;
+					}
+				}
+			}
+			v.expect(differing == 0, text(differing, " of ", perAxis * perAxis * perAxis, " chunks differ from the world after reopening"));
+			v.expect(untouched > 0, "every chunk was edited, none shows that untouched chunks read as air");
+
+			// reading doesn't dirty anything
+			reopened.flush();
+			v.expect(reopened.stats().writeBacks == 0, text(reopened.stats().writeBacks, " chunks were written back after only reading"));
+		}
+
+		// a file is only reopened with the dimension and cell format it was made with
+		{
+			ChunkCache<uint16_t> bigger(1);
+			v.expect(!bigger.open(path, 2 * worldDim), "a world file opened with another dimension");
+			ChunkCache<uint8_t> narrower(1);
+			v.expect(!narrower.open(path, worldDim), "a world file opened with another cell format");
+		}
+
+		std::filesystem::remove(path);
+	}
+
+
+	// cells of each material in a grid, air included
+	template<typename Cell, typename Layout>
+	std::vector<int64_t> materialCounts(const VoxelGrid<Cell, Layout>& grid) {
+		std::vector<int64_t> counts(rules::materialCount, 0);
+		for (int z = 0; z < int(grid.depth()); z++)
+			for (int y = 0; y < int(grid.dimension()); y++)
+				for (int x = 0; x < int(grid.dimension()); x++)
+					counts[std::min(voxel::type(grid.get(x, y, z)), rules::materialCount - 1)]++;
+
+		return counts;
+	}
+
+	std::string countsText(const std::vector<int64_t>& counts) {
+		std::string out;
+		for (size_t m = 0; m < counts.size(); m++)
+			out += text(m ? " " : "", rules::materials[m].name, " ", counts[m]);
+		return out;
+	}
+
+	// every scene stepped with its brush, where the counts have to move by exactly what the brush added and
+	// cleared, then without, where they must not move at all
+	template<typename Cell, typename Layout>
+	void conserves(Verdict& v, const char* setup, typename Simulation<Cell, Layout>::Moves moves, int sleepAfter) {
+		const unsigned int dim = 64;
+
+		for (int kind = 0; kind < scene::Count; kind++) {
+			const scene::Kind scene = scene::Kind(kind);
+			Simulation<Cell, Layout> sim(dim, 4);
+			sim.seed(1);
+			sim.setMoves(moves);
+			sim.setSleep(sleepAfter);
+
+			VoxelGrid<Cell> world(dim);
+			scene::build(scene, world);
+			copyCells(world, sim.grid());
+			sim.wake();
+
+			std::vector<int64_t> expected = materialCounts(sim.grid());
+			for (int step = 0; step < 100; step++) {
+				sim.setBrush(scene::brush(scene, dim, step));
+				sim.step();
+			}
+			for (size_t m = 0; m < expected.size(); m++)
+				expected[m] += sim.brushed()[m];
+
+			std::vector<int64_t> found = materialCounts(sim.grid());
+			v.expect(found == expected, text(setup, " ", scene::name(scene), " with its brush has ", countsText(found), ", expected ", countsText(expected)));
+
+			sim.setBrush(Brush());
+			expected = found;
+			sim.step(100);
+			found = materialCounts(sim.grid());
+			v.expect(found == expected, text(setup, " ", scene::name(scene), " without a brush went from ", countsText(expected), " to ", countsText(found)));
+		}
+	}
+
+	// no move may create or destroy a particle, under either kind of moves, any cell format or layout, or sleeping
+	void checkConservation(Verdict& v) {
+		conserves<uint8_t, layout::Linear>(v, "partitioned R8UI", Simulation<uint8_t>::Moves::Partitioned, 0);
+		conserves<uint16_t, layout::Bricked>(v, "partitioned R16UI bricked sleeping", Simulation<uint16_t, layout::Bricked>::Moves::Partitioned, 4);
+		conserves<uint32_t, layout::Morton>(v, "partitioned R32UI morton", Simulation<uint32_t, layout::Morton>::Moves::Partitioned, 0);
+		conserves<uint8_t, layout::Linear>(v, "claimed R8UI", Simulation<uint8_t>::Moves::Claimed, 0);
+		conserves<uint16_t, layout::Linear>(v, "claimed R16UI", Simulation<uint16_t>::Moves::Claimed, 0);
+	}
+
+
+	// the brush rule the physics passes applied to every voxel before placement got its own pass over the brush's box
+	bool inBrush(const Brush& brush, int x, int y, int z) {
+		const float dx = float(x) - float(brush.blockLocation[0]);
+		const float dy = float(y) - float(brush.blockLocation[1]);
+		const float dz = float(z) - float(brush.blockLocation[2]);
+
+		return std::sqrt(dx * dx + dy * dy + dz * dz) < brush.blockSize;
+	}
+
+	// rock and air worlds, where nothing moves, brushed by placeBrush and by the per voxel rule over the whole world
+	template<typename Cell, typename Layout>
+	void brushes(Verdict& v, const char* setup) {
+		const int dim = 32;
+		const float sizes[] = { .5f, 1.f, 2.5f, 4.f, 7.5f };
+		const int locations[][3] = {
+			{ 16, 16, 16 }, { 0, 0, 0 }, { 31, 31, 31 }, { 3, 29, 31 }, { -3, 16, 40 }, { 16, -2, 16 }, { 34, 34, -5 },
+		};
+		std::minstd_rand random(3);
+
+		for (float size : sizes) {
+			for (const int* location : locations) {
+				for (uint32_t type : { voxel::ROCK, voxel::AIR }) {
+					VoxelGrid<Cell> world(dim);
+					for (int z = 0; z < dim; z++)
+						for (int y = 0; y < dim; y++)
+							for (int x = 0; x < dim; x++)
+								world.set(x, y, z, random() % 3 ? voxel::AIR : voxel::ROCK);
+
+					Brush brush;
+					brush.placeBlock = true;
+					brush.blockType = type;
+					brush.blockSize = size;
+					std::copy(location, location + 3, brush.blockLocation);
+
+					Simulation<Cell, Layout> sim(dim, 2);
+					sim.seed(1);
+					copyCells(world, sim.grid());
+					sim.wake();
+					sim.setBrush(brush);
+					sim.step();
+
+					// erasing clears anything but air, placing fills only air
+					int64_t balance[rules::materialCount] = {};
+					int differing = 0;
+					for (int z = 0; z < dim; z++) {
+						for (int y = 0; y < dim; y++) {
+							for (int x = 0; x < dim; x++) {
+								uint32_t expected = world.get(x, y, z);
+								if (inBrush(brush, x, y, z) && (type == voxel::AIR ? expected != voxel::AIR : expected == voxel::AIR)) {
+									balance[expected]--;
+									balance[type]++;
+									expected = type;
+								}
+								differing += voxel::type(sim.grid().get(x, y, z)) != expected;
+							}
+						}
+					}
+
+					const std::string brushed = text(setup, " ", type == voxel::AIR ? "erasing" : "placing", " size ", size, " at ", location[0], ",", location[1], ",", location[2]);
+					v.expect(differing == 0, text(brushed, " left ", differing, " cells different from the per voxel rule"));
+					v.expect(std::equal(balance, balance + rules::materialCount, sim.brushed()), text(brushed, " counted other cells brushed than it changed"));
+				}
+			}
+		}
+	}
+
+	// placeBrush against the per voxel rule for brushes of a few sizes inside, on and past the edges of the world
+	void checkBrush(Verdict& v) {
+		brushes<uint8_t, layout::Linear>(v, "R8UI");
+		brushes<uint16_t, layout::Bricked>(v, "R16UI bricked");
+	}
+
+
+	float fract(float f) {
+		return f - std::floor(f);
+	}
+
+	// the lateral order particles used before rules::lateralOrder, random4to4 of shaders/particlesim.comp picking
+	// the directions and offsets of the (i * dir + offset) % 3 - 1 loops, as an index into rules::orderTable
+	int random4to4Order(int x, int y, int z, float iterationRNG) {
+		float p[4] = { fract(x * .1031f), fract(y * .1030f), fract(z * .0973f), fract(iterationRNG * .1099f) };
+		const float d = p[0] * (p[3] + 33.33f) + p[1] * (p[2] + 33.33f) + p[2] * (p[0] + 33.33f) + p[3] * (p[1] + 33.33f);
+		for (float& c : p)
+			c += d;
+
+		const float r[4] = { fract((p[0] + p[1]) * p[2]), fract((p[0] + p[2]) * p[1]), fract((p[1] + p[2]) * p[3]), fract((p[2] + p[3]) * p[0]) };
+		const int dirX = 2 * int(std::floor(r[0] * 1.999f)) - 1;
+		const int dirZ = 2 * int(std::floor(r[1] * 1.999f)) - 1;
+		return ((dirX > 0) * 2 + (dirZ > 0)) * 9 + int(std::floor(r[2] * 2.999f)) * 3 + int(std::floor(r[3] * 2.999f));
+	}
+
+	// the order table against the loops it replaced, and the cell hash picking from it against random4to4: how often
+	// each offset comes at each place of an order over a 64^3 world and a few iterations has to match, the orders
+	// have to come up evenly and neighbouring cells mustn't share theirs more often than chance
+	void checkDirections(Verdict& v) {
+		for (int dirX : { -1, 1 }) {
+			for (int dirZ : { -1, 1 }) {
+				for (int offsetX = 0; offsetX < 3; offsetX++) {
+					for (int offsetZ = 0; offsetZ < 3; offsetZ++) {
+						const rules::Order& order = rules::orderTable.orders[((dirX > 0) * 2 + (dirZ > 0)) * 9 + offsetX * 3 + offsetZ];
+						int n = 0;
+						bool same = true;
+						for (int i = 0; i < 3; i++) {
+							for (int j = 0; j < 3; j++) {
+								const int x = (i * dirX + offsetX) % 3 - 1, z = (j * dirZ + offsetZ) % 3 - 1;
+								if (x == 0 && z == 0) continue;
+								same = same && order.x[n] == x && order.z[n] == z;
+								n++;
+							}
+						}
+						same = same && (n == 9 || (order.x[n] == 0 && order.z[n] == 0));
+						v.expect(same, text("the order for directions ", dirX, ",", dirZ, " and offsets ", offsetX, ",", offsetZ, " isn't the old loops'"));
+					}
+				}
+			}
+		}
+
+		// offsets reach -3 to 1 on each axis, counted per place in the order
+		const int dim = 64, iterations = 8;
+		std::vector<double> oldPlaces(9 * 7 * 7), newPlaces(9 * 7 * 7), orders(rules::orderCount);
+		double samples = 0., neighbours = 0.;
+		std::minstd_rand random(11);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+		for (int iteration = 0; iteration < iterations; iteration++) {
+			const float rng = uniform(random);
+			for (int z = 0; z < dim; z++) {
+				for (int y = 0; y < dim; y++) {
+					int previous = -1;
+					for (int x = 0; x < dim; x++) {
+						const rules::Order& before = rules::orderTable.orders[random4to4Order(x, y, z, rng)];
+						const rules::Order& now = rules::lateralOrder(x, y, z, rng);
+						const int index = int(&now - rules::orderTable.orders);
+						for (int k = 0; k < 9; k++) {
+							oldPlaces[(k * 7 + before.x[k] + 3) * 7 + before.z[k] + 3]++;
+							newPlaces[(k * 7 + now.x[k] + 3) * 7 + now.z[k] + 3]++;
+						}
+						orders[index]++;
+						neighbours += index == previous;
+						previous = index;
+						samples++;
+					}
+				}
+			}
+		}
+
+		double worst = 0.;
+		for (size_t i = 0; i < oldPlaces.size(); i++)
+			worst = std::max(worst, std::abs(oldPlaces[i] - newPlaces[i]) / samples);
+		v.expect(worst < .0025, text("an offset's share at a place in the order differs by ", 100. * worst, " points from random4to4's, more than .25"));
+
+		// 35 degrees of freedom, 66.6 is the 0.1% tail
+		const double expected = samples / rules::orderCount;
+		double chiSquared = 0.;
+		for (double count : orders)
+			chiSquared += (count - expected) * (count - expected) / expected;
+		v.expect(chiSquared < 66.6, text("the orders' chi squared is ", chiSquared, ", they aren't picked evenly"));
+
+		const double shared = neighbours / (samples - iterations * dim * dim) * rules::orderCount;
+		v.expect(shared > .8 && shared < 1.2, text("neighbouring cells share their order ", shared, " times as often as chance"));
+		std::cout << "\t" << 100. * worst << " points at most from random4to4, chi squared " << chiSquared << ", neighbours share orders " << shared << " times chance" << std::endl;
+	}
+
+
+	// the scalar and packed kernels stepping the same scene from the same seed, the grids must stay byte for byte equal
+	template<typename Cell, typename Layout>
+	void kernelsAgree(Verdict& v, const char* setup, int sleepAfter, typename Simulation<Cell, Layout>::Moves moves = Simulation<Cell, Layout>::Moves::Partitioned) {
+		using Sim = Simulation<Cell, Layout>;
+		const unsigned int dim = 64;
+
+		for (int kind = 0; kind < scene::Count; kind++) {
+			const scene::Kind scene = scene::Kind(kind);
+			VoxelGrid<Cell> world(dim);
+			scene::build(scene, world);
+
+			Sim scalar(dim, 4), packed(dim, 4);
+			scalar.setKernel(Sim::Kernel::Scalar);
+			packed.setKernel(Sim::Kernel::Packed);
+			for (Sim* sim : { &scalar, &packed }) {
+				sim->seed(5);
+				sim->setMoves(moves);
+				sim->setSleep(sleepAfter);
+				copyCells(world, sim->grid());
+				sim->wake();
+			}
+
+			int diverged = -1;
+			for (int step = 0; step < 150 && diverged < 0; step++) {
+				for (Sim* sim : { &scalar, &packed }) {
+					sim->setBrush(scene::brush(scene, dim, step));
+					sim->step();
+				}
+				if (std::memcmp(scalar.grid().data(), packed.grid().data(), scalar.grid().bytes()) != 0)
+					diverged = step;
+			}
+			v.expect(diverged < 0, text(setup, " ", scene::name(scene), " grids differ after step ", diverged));
+		}
+	}
+
+	void checkKernels(Verdict& v) {
+		kernelsAgree<uint8_t, layout::Linear>(v, "R8UI", 0);
+		kernelsAgree<uint16_t, layout::Bricked>(v, "R16UI bricked", 0);
+		kernelsAgree<uint32_t, layout::Morton>(v, "R32UI morton sleeping", 4);
+		kernelsAgree<uint16_t, layout::Linear>(v, "R16UI claimed", 0, Simulation<uint16_t, layout::Linear>::Moves::Claimed);
+		kernelsAgree<uint8_t, layout::Morton>(v, "R8UI morton claimed", 0, Simulation<uint8_t, layout::Morton>::Moves::Claimed);
+	}
+
+
+#ifndef _WIN32
+	// worker processes stepping slabs of a world against a single Simulation of it from the same seed, the grids must
+	// end byte for byte equal, also when the dimension isn't a multiple of the slabs' 16 voxel brick rows
+	template<typename Cell>
+	void decompositionAgrees(Verdict& v, const char* setup) {
+		const int steps = 60;
+
+		for (unsigned int dim : { 64u, 100u }) {
+			const int rows = int(dim + 15) / 16;
+
+			for (int kind = 0; kind < scene::Count; kind++) {
+				const scene::Kind scene = scene::Kind(kind);
+				const auto brush = [&](int step) { return scene::brush(scene, dim, step); };
+				VoxelGrid<Cell> start(dim);
+				scene::build(scene, start);
+
+				Simulation<Cell> single(dim, 2);
+				single.seed(7);
+				copyCells(start, single.grid());
+				single.wake();
+				for (int step = 0; step < steps; step++) {
+					single.setBrush(brush(step));
+					single.step();
+				}
+
+				for (int processes : { 2, 3, rows }) {
+					VoxelGrid<Cell> world(dim);
+					copyCells(start, world);
+
+					DecomposedWorld<Cell> decomposed(dim, processes);
+					if (!v.expect(decomposed.run(world, steps, 7, brush), text(setup, " ", dim, "^3 ", scene::name(scene), " on ", processes, " processes didn't run")))
+						continue;
+
+					v.expect(std::memcmp(world.data(), single.grid().data(), world.bytes()) == 0,
+						text(setup, " ", dim, "^3 ", scene::name(scene), " on ", processes, " processes differs from a single process"));
+				}
+			}
+		}
+	}
+
+	void checkDecomposition(Verdict& v) {
+		decompositionAgrees<uint8_t>(v, "R8UI");
+		decompositionAgrees<uint16_t>(v, "R16UI");
+	}
+#endif
+
+
+	// work groups whose padded tiles overlap their neighbours' in a pass must be refused
+	void checkConfig(Verdict& v) {
+		for (unsigned int localDim : { 1u, 2u, 3u, 4u, 8u, 16u }) {
+			Config config;
+			v.expect(config.set("--simLocalDim", std::to_string(localDim)), text("simLocalDim ", localDim, " didn't parse"));
+
+			const bool accepted = config.check().empty();
+			v.expect(accepted == (localDim == 4 || localDim == 8), text("simLocalDim ", localDim, accepted ? " was accepted" : " was refused: " + config.check()));
+		}
+	}
+
+	struct Check {
+		const char* name;
+		const char* what;
+		void (*run)(Verdict& v);
+	};
+
+	const Check checks[] = {
+		{ "brush", "brush placement against the per voxel rule it replaced", checkBrush },
+		{ "config", "work group sizes the physics tiles fit", checkConfig },
+		{ "conservation", "particle counts of every scene under each kind of moves", checkConservation },
+#ifndef _WIN32
+		{ "decomposition", "worker processes stepping slabs against a single process", checkDecomposition },
+#endif
+		{ "directions", "lateral orders and how they are picked against random4to4", checkDirections },
+		{ "feed", "spectator feed readers lapped across a trimmed reservation", checkFeed },
+		{ "kernels", "the scalar and packed brick kernels give the same grids", checkKernels },
+		{ "paged", "a paged world's window and file against a dense grid of the whole world", checkPagedWorld },
+		{ "scheduler", "steps per frame planned from a synthetic cost model", checkScheduler },
+		{ "timings", "timing histograms of a fake clock", checkTimings },
+		{ "triplebuffer", "torn or stale reads of a TripleBuffer under a busy writer", checkTripleBuffer },
+	};
+
+
+	void usage(const char* name) {
+		std::cout << "usage: " << name << " [--checks name,...]" << std::endl << "checks:";
+		for (const Check& check : checks)
+			std::cout << " " << check.name;
+		std::cout << std::endl;
+	}
+
+	bool known(const std::string& name) {
+		for (const Check& check : checks)
+			if (name == check.name)
+				return true;
+
+		return false;
+	}
+
+	bool parseArgs(int argc, char* argv[]) {
+		for (int i = 1; i < argc; i++) {
+			if (i + 1 >= argc) {
+				usage(argv[0]);
+				return false;
+			}
+
+			const char* value = argv[++i];
+			if (std::strcmp(argv[i - 1], "--checks") == 0) {
+				std::istringstream in(value);
+				for (std::string name; std::getline(in, name, ',');) {
+					if (!known(name)) {
+						usage(argv[0]);
+						return false;
+					}
+					options.checks.push_back(name);
+				}
+			}
+			else {
+				usage(argv[0]);
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	if (!parseArgs(argc, argv))
+		return 1;
+
+	int failed = 0, run = 0;
+	for (const Check& check : checks) {
+		bool selected = options.checks.empty();
+		for (const std::string& name : options.checks)
+			selected = selected || name == check.name;
+		if (!selected)
+			continue;
+
+		std::cout << std::left << std::setw(14) << check.name << check.what << std::endl;
+		Verdict verdict;
+		check.run(verdict);
+		std::cout << std::setw(14) << "" << (verdict.passed() ? "ok" : "FAILED") << std::endl;
+
+		failed += !verdict.passed();
+		run++;
+	}
+
+	std::cout << run - failed << " of " << run << " checks passed" << std::endl;
+	return failed ? 1 : 0;
+}
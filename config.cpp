@@ -0,0 +1,108 @@
+#include "config.h"
+#include "pagedworld.h"
+
+#include <fstream>
+#include <sstream>
+
+
+namespace {
+	std::string trim(const std::string& s) {
+		const size_t begin = s.find_first_not_of(" \t\r");
+		if (begin == std::string::npos)
+			return std::string();
+
+		return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+	}
+
+	template<typename T>
+	bool parse(const std::string& text, T& value) {
+		std::istringstream in(text);
+		T parsed;
+		if (!(in >> parsed) || !(in >> std::ws).eof())
+			return false;
+
+		value = parsed;
+		return true;
+	}
+}
+
+
+bool Config::load(const std::string& path) {
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	for (std::string line; std::getline(file, line);) {
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		const size_t equals = line.find('=');
+		if (equals == std::string::npos || !set(trim(line.substr(0, equals)), trim(line.substr(equals + 1))))
+			return false;
+	}
+
+	return true;
+}
+
+bool Config::set(std::string key, const std::string& value) {
+	if (key.compare(0, 2, "--") == 0)
+		key.erase(0, 2);
+
+	if (key == "dimension")		return parse(value, dimension);
+	if (key == "simIterations")	return parse(value, simIterations);
+	if (key == "adaptiveIterations")	return parse(value, adaptiveIterations);
+	if (key == "simLocalDim")	return parse(value, simLocalDim);
+	if (key == "maxDrawDist")	return parse(value, maxDrawDist);
+	if (key == "worldDimension")	return parse(value, worldDimension);
+	if (key == "sleepAfter")	return parse(value, sleepAfter);
+	if (key == "rayCache")		return parse(value, rayCache);
+	if (key == "statsEvery")	return parse(value, statsEvery);
+
+	if (key == "world") {
+		world = value;
+		return true;
+	}
+
+	if (key == "cellFormat") {
+		int bits = 0;
+		if (!parse(value, bits))
+			return false;
+
+		if (bits == 8)			cellFormat = voxel::CellFormat::R8UI;
+		else if (bits == 16)	cellFormat = voxel::CellFormat::R16UI;
+		else if (bits == 32)	cellFormat = voxel::CellFormat::R32UI;
+		else					return false;
+
+		return true;
+	}
+
+	return false;
+}
+
+std::string Config::check() const {
+	// the groups of a pass are simLocalDim apart and particlesim.comp pads each group's tile by 3 voxels, the reach of
+	// Simulation::reach, so smaller groups' tiles would overlap and their write backs race
+	if (simLocalDim != 4 && simLocalDim != 8)
+		return "simLocalDim must be 4 or 8";
+	if (dimension < simLocalDim || dimension % simLocalDim != 0)
+		return "dimension must be a multiple of simLocalDim";
+	if (simIterations < 1)
+		return "simIterations must be at least 1";
+	if (!(maxDrawDist > 0.f))
+		return "maxDrawDist must be positive";
+	if (sleepAfter < 0)
+		return "sleepAfter can't be negative";
+	if (rayCache < 0)
+		return "rayCache can't be negative";
+	if (statsEvery < 0)
+		return "statsEvery can't be negative";
+
+	// a paged world moves the grid a whole chunk at a time
+	if (!world.empty() && (dimension % paged::chunkDim != 0 || worldDimension % paged::chunkDim != 0))
+		return "dimension and worldDimension must be multiples of 32 with a world file";
+	if (!world.empty() && worldDimension != 0 && worldDimension < dimension)
+		return "worldDimension can't be less than dimension";
+
+	return std::string();
+}
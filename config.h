@@ -0,0 +1,43 @@
+#pragma once
+
+#include "voxel.h"
+
+#include <string>
+
+
+// World and tuning settings chosen at startup instead of compile time
+// Read from a file of "key = value" lines (# starts a comment) and from "--key value" command line flags.
+//
+// dimension		edge of the world cube, a multiple of simLocalDim
+// simIterations	world steps between renders
+// adaptiveIterations	1 fits the steps of each frame to the frame rate's budget, simIterations becoming the target
+// simLocalDim		physics work group edge, 4 or 8 - the cube must fit the 1024 invocation limit and be wider than a tile's padding
+// maxDrawDist		distance past which rays stop
+// cellFormat		8, 16 or 32 bits per voxel
+// world			paged world file, the grid becomes a dimension^3 window of it that follows the player
+// worldDimension	edge of the paged world, 0 uses dimension
+// sleepAfter		iterations without movement around a brick before it stops being stepped, 0 steps every brick
+// rayCache		frames between full casts of each pixel, rays otherwise start near the last frame's hits, 0 casts in full
+// statsEvery		frames between readbacks of the grid for world statistics, 0 reads nothing
+struct Config
+{
+	unsigned int dimension = 256;
+	int simIterations = 4;
+	bool adaptiveIterations = false;
+	unsigned int simLocalDim = 8;
+	float maxDrawDist = 300.f;
+	voxel::CellFormat cellFormat = voxel::CellFormat::R8UI;
+	std::string world;
+	unsigned int worldDimension = 0;
+	int sleepAfter = 0;
+	int rayCache = 0;
+	int statsEvery = 0;
+
+	bool load(const std::string& path);
+
+	// a leading "--" on the key is ignored so command line flags share the file keys
+	bool set(std::string key, const std::string& value);
+
+	// empty if the settings can run, otherwise what's wrong with them
+	std::string check() const;
+};
@@ -0,0 +1,203 @@
+#include "decomposition.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+	const int spacing = 16;		// simSpacing
+	const int localDim = 8;		// simLocalDim
+
+	int floorDiv(int a, int b) {
+		return a / b - (a % b != 0 && (a < 0) != (b < 0));
+	}
+}
+
+
+std::vector<decomposition::Slab> decomposition::split(unsigned int dimension, int processes) {
+	const int rows = (int(dimension) - 1) / spacing + 1;
+	if (processes < 1 || processes > rows)
+		return {};
+
+	std::vector<Slab> slabs(processes);
+	for (int p = 0; p < processes; p++) {
+		slabs[p].zBegin = rows * p / processes * spacing;
+		slabs[p].zEnd = std::min(rows * (p + 1) / processes * spacing, int(dimension));
+	}
+
+	return slabs;
+}
+
+int decomposition::authority(const std::vector<Slab>& slabs, int z, int part) {
+	// the one brick of the pass whose [start - reach, start + localDim + reach) footprint holds z
+	const int reach = Simulation<uint8_t>::reach;
+	const int start = part * localDim + floorDiv(z + reach - part * localDim, spacing) * spacing;
+	if (start < 0 || start + localDim + reach <= z)
+		return -1;
+
+	for (size_t p = 0; p < slabs.size(); p++)
+		if (start >= slabs[p].zBegin && start < slabs[p].zEnd)
+			return int(p);
+
+	return -1;
+}
+
+
+template<typename Cell>
+DecomposedWorld<Cell>::DecomposedWorld(unsigned int dimension, int processes, unsigned int threadsPerProcess) :
+	dim(dimension),
+	threads(threadsPerProcess),
+	slabs(decomposition::split(dimension, processes)) {}
+
+
+#ifdef _WIN32
+
+template<typename Cell>
+bool DecomposedWorld<Cell>::run(VoxelGrid<Cell>&, int, unsigned int, const std::function<Brush(int)>&) {
+	std::cout << "worker processes need fork, which this platform doesn't have" << std::endl;
+	return false;
+}
+
+#else
+
+template<typename Cell>
+bool DecomposedWorld<Cell>::run(VoxelGrid<Cell>& world, int steps, unsigned int seed, const std::function<Brush(int)>& brush) {
+	if (!valid() || world.dimension() != dim)
+		return false;
+
+	const int processes = int(slabs.size());
+	const int reach = Simulation<Cell>::reach;
+	const size_t layerCells = size_t(dim) * dim;
+	const size_t bandCells = 2 * reach * layerCells;
+
+	// barrier, then the world every worker starts from and ends in, then per boundary, direction and pass parity
+	// one band of the layers around the boundary
+	const size_t headerBytes = (sizeof(pthread_barrier_t) + 63) / 64 * 64;
+	const size_t worldBytes = world.size() * sizeof(Cell);
+	const size_t mailboxCount = size_t(processes - 1) * 2 * 2;
+	const size_t bytes = headerBytes + worldBytes + mailboxCount * bandCells * sizeof(Cell);
+
+	void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	pthread_barrier_t* barrier = static_cast<pthread_barrier_t*>(mapping);
+	Cell* shared = reinterpret_cast<Cell*>(static_cast<uint8_t*>(mapping) + headerBytes);
+	Cell* mailboxes = shared + world.size();
+	std::copy(world.data(), world.data() + world.size(), shared);
+
+	pthread_barrierattr_t attributes;
+	pthread_barrierattr_init(&attributes);
+	pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+	pthread_barrier_init(barrier, &attributes, unsigned(processes));
+	pthread_barrierattr_destroy(&attributes);
+
+	// boundary b lies between slabs b and b + 1, direction 0 carries layers up to b + 1 and 1 down to b
+	const auto mailbox = [&](int boundary, int direction, int parity) {
+		return mailboxes + ((size_t(boundary) * 2 + direction) * 2 + parity) * bandCells;
+	};
+
+	std::cout.flush();
+	std::vector<pid_t> workers;
+	for (int p = 0; p < processes; p++) {
+		const pid_t pid = fork();
+		if (pid < 0)
+			break;
+		if (pid > 0) {
+			workers.push_back(pid);
+			continue;
+		}
+
+		const decomposition::Slab slab = slabs[p];
+		Simulation<Cell> sim(dim, slab.zBegin, slab.zEnd, threads);
+		sim.seed(seed);
+
+		VoxelGrid<Cell>& grid = sim.grid();
+		const Cell* first = shared + size_t(sim.firstLayer()) * layerCells;
+		std::copy(first, first + grid.size(), grid.data());
+
+		const auto layer = [&](int z) { return grid.data() + size_t(z - sim.firstLayer()) * layerCells; };
+
+		// send the band layers this slab's bricks may have changed, then take the ones the neighbours changed
+		int pass = 0;
+		sim.afterPass([&](int part) {
+			const int parity = pass++ % 2;
+
+			for (int side = 0; side < 2; side++) {
+				const int boundary = side ? p : p - 1;
+				if (boundary < 0 || boundary >= processes - 1)
+					continue;
+
+				const int bandBegin = slabs[boundary].zEnd - reach;
+				const int bandEnd = std::min(slabs[boundary].zEnd + reach, int(dim));
+				Cell* out = mailbox(boundary, side ? 0 : 1, parity);
+				for (int z = bandBegin; z < bandEnd; z++)
+					if (decomposition::authority(slabs, z, part) == p)
+						std::copy(layer(z), layer(z) + layerCells, out + size_t(z - bandBegin) * layerCells);
+			}
+
+			pthread_barrier_wait(barrier);
+
+			for (int side = 0; side < 2; side++) {
+				const int boundary = side ? p : p - 1;
+				if (boundary < 0 || boundary >= processes - 1)
+					continue;
+
+				const int neighbour = side ? p + 1 : p - 1;
+				const int bandBegin = slabs[boundary].zEnd - reach;
+				const int bandEnd = std::min(slabs[boundary].zEnd + reach, int(dim));
+				const Cell* in = mailbox(boundary, side ? 1 : 0, parity);
+				for (int z = bandBegin; z < bandEnd; z++)
+					if (decomposition::authority(slabs, z, part) == neighbour)
+						std::copy(in + size_t(z - bandBegin) * layerCells, in + size_t(z - bandBegin + 1) * layerCells, layer(z));
+			}
+		});
+
+		for (int step = 0; step < steps; step++) {
+			sim.setBrush(brush(step));
+			sim.step();
+		}
+
+		// owned layers back to the shared world, slabs don't overlap so no barrier is needed
+		std::copy(layer(slab.zBegin), layer(slab.zEnd), shared + size_t(slab.zBegin) * layerCells);
+		_exit(0);
+	}
+
+	// a worker that died would leave the others waiting at the barrier forever
+	bool succeeded = int(workers.size()) == processes;
+	if (!succeeded)
+		for (pid_t pid : workers)
+			kill(pid, SIGKILL);
+
+	for (size_t remaining = workers.size(); remaining > 0; remaining--) {
+		int status = 0;
+		if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			if (succeeded)
+				for (pid_t pid : workers)
+					kill(pid, SIGKILL);
+			succeeded = false;
+		}
+	}
+
+	if (succeeded)
+		std::copy(shared, shared + world.size(), world.data());
+
+	pthread_barrier_destroy(barrier);
+	munmap(mapping, bytes);
+	return succeeded;
+}
+
+#endif
+
+
+template class DecomposedWorld<uint8_t>;
+template class DecomposedWorld<uint16_t>;
+template class DecomposedWorld<uint32_t>;
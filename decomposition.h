@@ -0,0 +1,50 @@
+#pragma once
+
+#include "simulation.h"
+#include "voxelgrid.h"
+
+#include <functional>
+#include <vector>
+
+
+// World stepped by several local processes, each owning a z slab of whole brick rows
+// The 8 partition passes already keep concurrently updated bricks apart, so each process updates its own rows
+// and after every pass sends its neighbours the layers its bricks could have changed inside their halos.
+// Only one brick can reach a layer in a pass, which makes its owner the layer's authority, so particles that
+// crossed into a neighbour's slab arrive there exactly once. Results match a single process run bit for bit.
+//
+// Workers are forked and exchange through an anonymous shared mapping with a process shared barrier per pass,
+// which needs POSIX, run reports failure elsewhere.
+namespace decomposition
+{
+	struct Slab {
+		int zBegin, zEnd;	// owned world layers, multiples of simSpacing except at the world's top
+	};
+
+	// even split of the brick rows, empty if there are more processes than rows
+	std::vector<Slab> split(unsigned int dimension, int processes);
+
+	// the process whose brick can change layer z in a pass with the given z partition offset, -1 if none can
+	int authority(const std::vector<Slab>& slabs, int z, int part);
+}
+
+
+template<typename Cell>
+class DecomposedWorld
+{
+public:
+	DecomposedWorld(unsigned int dimension, int processes, unsigned int threadsPerProcess = 1);
+
+	bool valid() const { return !slabs.empty(); }
+	const std::vector<decomposition::Slab>& slabsOf() const { return slabs; }
+
+	// step world n iterations across the worker processes, brush gives each iteration's input
+	// every worker draws the same rng sequence from seed, like a single Simulation seeded with it
+	bool run(VoxelGrid<Cell>& world, int steps, unsigned int seed, const std::function<Brush(int)>& brush);
+
+
+private:
+	unsigned int dim;
+	unsigned int threads;
+	std::vector<decomposition::Slab> slabs;
+};
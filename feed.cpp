@@ -0,0 +1,435 @@
+#include "feed.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "feed positions are shared between processes");
+
+
+namespace {
+	const size_t headerBytes = (sizeof(feed::Header) + 63) / 64 * 64;
+
+#ifdef _WIN32
+	// "/particlesim" and "particlesim" name the same mapping
+	std::string localName(const std::string& name) {
+		const size_t start = name.find_first_not_of('/');
+		return "Local\\" + (start == std::string::npos ? std::string() : name.substr(start));
+	}
+#else
+	// "/particlesim" and "particlesim" name the same mapping
+	std::string posixName(const std::string& name) {
+		return name.empty() || name[0] != '/' ? "/" + name : name;
+	}
+#endif
+}
+
+
+SharedMapping::~SharedMapping() {
+	close();
+}
+
+
+#ifdef _WIN32
+
+// a pagefile backed mapping lives while any process has it open, there's no name to remove
+bool SharedMapping::create(const std::string& name, size_t size) {
+	close();
+
+	const std::string local = localName(name);
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), local.c_str());
+	if (mapping == NULL) {
+		mapping = nullptr;
+		return false;
+	}
+
+	view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size));
+	if (!view) {
+		close();
+		return false;
+	}
+
+	this->name = name;
+	length = size;
+	return true;
+}
+
+bool SharedMapping::open(const std::string& name) {
+	close();
+
+	const std::string local = localName(name);
+	mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, local.c_str());
+	if (mapping == NULL) {
+		mapping = nullptr;
+		return false;
+	}
+
+	view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	MEMORY_BASIC_INFORMATION info;
+	if (!view || !VirtualQuery(view, &info, sizeof(info))) {
+		close();
+		return false;
+	}
+
+	this->name = name;
+	length = info.RegionSize;
+	return true;
+}
+
+void SharedMapping::close() {
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping)
+		CloseHandle(mapping);
+
+	view = nullptr;
+	mapping = nullptr;
+	length = 0;
+}
+
+void SharedMapping::unlink() {}
+
+#else
+
+bool SharedMapping::create(const std::string& feedName, size_t size) {
+	close();
+	const std::string name = posixName(feedName);
+
+	shm_unlink(name.c_str());
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return false;
+
+	if (ftruncate(fd, off_t(size)) != 0) {
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	this->name = name;
+	view = static_cast<uint8_t*>(address);
+	length = size;
+	return true;
+}
+
+bool SharedMapping::open(const std::string& feedName) {
+	close();
+	const std::string name = posixName(feedName);
+
+	const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void* address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED)
+		return false;
+
+	this->name = name;
+	view = static_cast<uint8_t*>(address);
+	length = size_t(info.st_size);
+	return true;
+}
+
+void SharedMapping::close() {
+	if (view)
+		munmap(view, length);
+
+	view = nullptr;
+	length = 0;
+}
+
+void SharedMapping::unlink() {
+	if (!name.empty())
+		shm_unlink(name.c_str());
+}
+
+#endif
+
+
+bool FeedWriter::create(const std::string& name, unsigned int dimension, size_t capacity) {
+	close();
+
+	capacity = (capacity + 15) / 16 * 16;
+	if (capacity < 2 * feed::recordSize(0) || !memory.create(name, headerBytes + capacity))
+		return false;
+
+	// the fields are set before any reader can trust the magic
+	header = new (memory.data()) feed::Header();
+	header->version = feed::version;
+	header->dimension = dimension;
+	header->chunkDim = feed::chunkDim;
+	header->capacity = capacity;
+	header->head.store(0, std::memory_order_relaxed);
+	header->tail.store(0, std::memory_order_relaxed);
+	header->key.store(feed::none, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(header->magic, "VPSF", 4);
+
+	ring = memory.data() + headerBytes;
+	position = 0;
+	reserved = 0;
+	records = tooLarge = 0;
+	return true;
+}
+
+
+uint8_t* FeedWriter::reserve(uint32_t type, uint64_t step, uint32_t bytes) {
+	const uint64_t capacity = header->capacity;
+	const uint32_t size = feed::recordSize(bytes);
+	if (size > capacity / 2) {
+		tooLarge++;
+		return nullptr;
+	}
+
+	// readers learn a region is being overwritten before any of it changes
+	// a trimmed commit leaves the head short of what its reservation overwrote, so the tail never moves back
+	const auto overwrite = [&](uint64_t end) {
+		if (end > capacity && end - capacity > header->tail.load(std::memory_order_relaxed))
+			header->tail.store(end - capacity, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	};
+
+	position = header->head.load(std::memory_order_relaxed);
+	const uint64_t offset = position % capacity;
+	if (offset + size > capacity) {
+		const uint64_t pad = capacity - offset;
+		overwrite(position + pad);
+
+		feed::RecordHeader filler = { feed::PAD, uint32_t(pad - sizeof(feed::RecordHeader)), step };
+		std::memcpy(ring + offset, &filler, sizeof(filler));
+		position += pad;
+	}
+
+	overwrite(position + size);
+	feed::RecordHeader record = { type, bytes, step };
+	std::memcpy(ring + position % capacity, &record, sizeof(record));
+
+	reserved = bytes;
+	return ring + position % capacity + sizeof(feed::RecordHeader);
+}
+
+void FeedWriter::commit(uint32_t bytes) {
+	bytes = std::min(bytes, reserved);
+	std::memcpy(ring + position % header->capacity + offsetof(feed::RecordHeader, bytes), &bytes, sizeof(bytes));
+	reserved = 0;
+
+	// the pad before the record, if any, is published with it
+	header->head.store(position + feed::recordSize(bytes), std::memory_order_release);
+	records++;
+
+	uint32_t type;
+	std::memcpy(&type, ring + position % header->capacity, sizeof(type));
+	if (type == feed::KEY)
+		header->key.store(position, std::memory_order_release);
+}
+
+void FeedWriter::close() {
+	if (!header)
+		return;
+
+	if (reserve(feed::END, 0, 0))
+		commit(0);
+
+	memory.unlink();
+	memory.close();
+	header = nullptr;
+	ring = nullptr;
+}
+
+
+bool FeedReader::open(const std::string& name) {
+	close();
+	if (!memory.open(name) || memory.size() < headerBytes)
+		return false;
+
+	header = reinterpret_cast<const feed::Header*>(memory.data());
+	if (std::memcmp(header->magic, "VPSF", 4) != 0 || header->version != feed::version || memory.size() < headerBytes + header->capacity) {
+		close();
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	ring = memory.data() + headerBytes;
+
+	// a world feed is joined at its latest keyframe, a feed of frames wherever it is
+	position = header->head.load(std::memory_order_acquire);
+	if (header->dimension > 0)
+		seekKey();
+	return true;
+}
+
+
+bool FeedReader::next(Record& record) {
+	const uint64_t capacity = header->capacity;
+
+	for (;;) {
+		if (position >= header->head.load(std::memory_order_acquire))
+			return false;
+
+		feed::RecordHeader found;
+		std::memcpy(&found, ring + position % capacity, sizeof(found));
+
+		// the header is only trusted once the writer is known not to have reached it since
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (lapped())
+			return false;
+
+		const uint32_t size = feed::recordSize(found.bytes);
+		if (position % capacity + size > capacity)
+			return false;
+
+		current = position;
+		position += found.type == feed::PAD ? capacity - position % capacity : size;
+		if (found.type == feed::PAD)
+			continue;
+
+		record.type = found.type;
+		record.step = found.step;
+		record.payload = ring + current % capacity + sizeof(feed::RecordHeader);
+		record.bytes = found.bytes;
+		return true;
+	}
+}
+
+bool FeedReader::intact() const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return header->tail.load(std::memory_order_relaxed) <= current;
+}
+
+bool FeedReader::lapped() const {
+	return header->tail.load(std::memory_order_relaxed) > position;
+}
+
+// without a keyframe left the reader waits at the head for the next one
+bool FeedReader::seekKey() {
+	const uint64_t key = header->key.load(std::memory_order_acquire);
+	if (key == feed::none || header->tail.load(std::memory_order_relaxed) > key) {
+		position = header->head.load(std::memory_order_acquire);
+		return false;
+	}
+
+	position = key;
+	return true;
+}
+
+
+template<typename Cell>
+WorldPublisher<Cell>::WorldPublisher(FeedWriter& writer, const Simulation<Cell>& sim, int keyEvery) :
+	writer(writer),
+	sim(sim),
+	keyEvery(std::max(keyEvery, 1)) {}
+
+template<typename Cell>
+void WorldPublisher<Cell>::publish(uint64_t step) {
+	const int chunkCount = int(sim.grid().dimension() / feed::chunkDim);
+	const int bricksPerChunk = int(feed::chunkDim) >> OccupancyPyramid::brickShift;
+
+	const bool key = keyPending || step - lastKey >= uint64_t(keyEvery);
+	if (key && writer.reserve(feed::KEY, step, 0)) {
+		writer.commit(0);
+		lastKey = step;
+		keys++;
+	}
+	keyPending = false;
+
+	uint32_t published = 0;
+	for (int cz = 0; cz < chunkCount; cz++) {
+		for (int cy = 0; cy < chunkCount; cy++) {
+			for (int cx = 0; cx < chunkCount; cx++) {
+				bool changed = key;
+				for (int b = 0; b < bricksPerChunk * bricksPerChunk * bricksPerChunk && !changed; b++) {
+					changed = sim.brickChanged(cx * bricksPerChunk + b % bricksPerChunk, cy * bricksPerChunk + b / bricksPerChunk % bricksPerChunk,
+						cz * bricksPerChunk + b / (bricksPerChunk * bricksPerChunk), lastIteration);
+				}
+
+				if (changed && publishChunk(cx, cy, cz, step))
+					published++;
+			}
+		}
+	}
+	lastIteration = sim.iterations();
+	chunks += published;
+
+	uint8_t* payload = writer.reserve(feed::STEP, step, sizeof(feed::StepRecord));
+	if (payload) {
+		const feed::StepRecord record = { published, 0 };
+		std::memcpy(payload, &record, sizeof(record));
+		writer.commit(sizeof(record));
+	}
+}
+
+// the cells' materials are written straight into the ring, a uniform chunk is trimmed to its ChunkRecord
+template<typename Cell>
+bool WorldPublisher<Cell>::publishChunk(int cx, int cy, int cz, uint64_t step) {
+	const int edge = int(feed::chunkDim);
+	uint8_t* payload = writer.reserve(feed::CHUNK, step, uint32_t(sizeof(feed::ChunkRecord) + feed::chunkDim * feed::chunkDim * feed::chunkDim));
+	if (!payload)
+		return false;
+
+	const VoxelGrid<Cell>& grid = sim.grid();
+	uint8_t* cells = payload + sizeof(feed::ChunkRecord);
+	uint8_t any = 0, all = 0xFF;
+	for (int z = 0; z < edge; z++) {
+		for (int y = 0; y < edge; y++) {
+			const Cell* row = grid.data() + grid.index(cx * edge, cy * edge + y, cz * edge + z);
+			uint8_t* out = cells + (size_t(z) * edge + y) * edge;
+			for (int x = 0; x < edge; x++) {
+				out[x] = uint8_t(row[x] & voxel::TYPE);
+				any |= out[x];
+				all &= out[x];
+			}
+		}
+	}
+
+	feed::ChunkRecord record = { cx, cy, cz, feed::mixed };
+	if (any == all)
+		record.fill = any;
+	std::memcpy(payload, &record, sizeof(record));
+	writer.commit(uint32_t(sizeof(record) + (record.fill == feed::mixed ? feed::chunkDim * feed::chunkDim * feed::chunkDim : 0)));
+	return true;
+}
+
+
+bool publishFrame(FeedWriter& writer, const Image& image, uint32_t index, uint64_t step) {
+	const size_t pixels = image.rgb.size();
+	uint8_t* payload = writer.reserve(feed::FRAME, step, uint32_t(sizeof(feed::FrameRecord) + pixels));
+	if (!payload)
+		return false;
+
+	const feed::FrameRecord record = { index, uint32_t(image.width), uint32_t(image.height), feed::RGB8_TOP_DOWN };
+	std::memcpy(payload, &record, sizeof(record));
+	std::memcpy(payload + sizeof(record), image.rgb.data(), pixels);
+	writer.commit(uint32_t(sizeof(record) + pixels));
+	return true;
+}
+
+
+template class WorldPublisher<uint8_t>;
+template class WorldPublisher<uint16_t>;
+template class WorldPublisher<uint32_t>;
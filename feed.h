@@ -0,0 +1,224 @@
+#pragma once
+
+#include "image.h"
+#include "simulation.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Spectator feed, a ring of records in shared memory that other processes read while the simulator runs
+// One writer appends records and never waits for readers. A reader keeps its own position and reads records in
+// place, so nothing is copied, then checks the record is still intact: a reader a whole ring behind finds its
+// records overwritten, like a seqlock reader, and starts again at the latest keyframe. Readers only map the
+// memory read only, any number of them can come and go.
+//
+// The mapping is a Header, then capacity bytes of records. Each record is a RecordHeader and its payload padded
+// to 16 bytes, and never wraps, the writer pads to the end of the ring instead. Positions count bytes written
+// since the feed was created, a position's offset in the ring is position % capacity.
+//
+// POSIX shared memory named "/particlesim" for a feed named particlesim, Windows gets a named file mapping instead.
+namespace feed
+{
+	const uint32_t version = 1;
+	const unsigned int chunkDim = 32;		// chunk edge, the world dimension is a multiple of it
+	const uint32_t mixed = ~0u;				// ChunkRecord::fill of a chunk whose cells follow
+
+	enum RecordType : uint32_t {
+		PAD = 0,		// filler up to the end of the ring
+		KEY = 1,		// the CHUNK records up to the next STEP cover the whole world
+		CHUNK = 2,		// ChunkRecord, then the materials of its chunkDim^3 cells x fastest unless it's uniform
+		STEP = 3,		// StepRecord, the world is whole at the record's step
+		FRAME = 4,		// FrameRecord, then its pixel rows
+		END = 5,		// the writer closed the feed
+	};
+
+	struct RecordHeader {
+		uint32_t type;
+		uint32_t bytes;		// payload, without the padding
+		uint64_t step;		// simulation step the record belongs to
+	};
+
+	struct ChunkRecord {
+		int32_t x, y, z;	// chunk coordinates
+		uint32_t fill;		// the material of every cell, mixed if the cells follow
+	};
+
+	struct StepRecord {
+		uint32_t chunks;	// CHUNK records published for the step, a reader that got fewer missed some
+		uint32_t reserved;
+	};
+
+	enum PixelFormat : uint32_t {
+		RGB8_TOP_DOWN = 0,		// Image
+		RGBA8_BOTTOM_UP = 1,	// rtTexture
+	};
+
+	struct FrameRecord {
+		uint32_t index;
+		uint32_t width, height;
+		uint32_t format;		// PixelFormat
+	};
+
+	struct Header {
+		char magic[4];						// "VPSF"
+		uint32_t version;
+		uint32_t dimension;					// world edge, 0 for a feed of frames only
+		uint32_t chunkDim;
+		uint64_t capacity;					// ring bytes after the header
+		std::atomic<uint64_t> head;			// position past the last published record
+		std::atomic<uint64_t> tail;			// positions before it are overwritten or about to be
+		std::atomic<uint64_t> key;			// position of the latest KEY record, none until the first
+	};
+
+	const uint64_t none = ~uint64_t(0);
+
+	inline uint32_t recordSize(uint32_t bytes) {
+		return (uint32_t(sizeof(RecordHeader)) + bytes + 15) / 16 * 16;
+	}
+}
+
+
+// platform handles of a named shared mapping, shared by FeedWriter and FeedReader
+class SharedMapping
+{
+public:
+	SharedMapping() = default;
+	~SharedMapping();
+
+	SharedMapping(const SharedMapping&) = delete;
+	SharedMapping& operator=(const SharedMapping&) = delete;
+
+	// create replaces a mapping of the same name, readers of the old one keep it until they close
+	bool create(const std::string& name, size_t size);
+	bool open(const std::string& name);
+	void close();
+
+	// remove the name, mappings already open stay valid
+	void unlink();
+
+	uint8_t* data() const { return view; }
+	size_t size() const { return length; }
+
+
+private:
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+	std::string name;
+	uint8_t* view = nullptr;
+	size_t length = 0;
+};
+
+
+class FeedWriter
+{
+public:
+	~FeedWriter() { close(); }
+
+	// dimension 0 for frames only, capacity rounded up to 16 bytes
+	bool create(const std::string& name, unsigned int dimension, size_t capacity);
+	bool isOpen() const { return header != nullptr; }
+
+	// space for a record with up to bytes of payload, filled in place and published by commit
+	// nullptr if the record is larger than half the ring, which it would mostly overwrite itself
+	uint8_t* reserve(uint32_t type, uint64_t step, uint32_t bytes);
+
+	// publish the reserved record, trimmed to the payload bytes actually used
+	// the reserved bytes past it stay behind the tail, readers' records there were overwritten all the same
+	void commit(uint32_t bytes);
+
+	// publish the END record and remove the name, readers keep what they mapped
+	void close();
+
+	uint64_t published() const { return records; }
+	uint64_t dropped() const { return tooLarge; }
+	size_t capacity() const { return size_t(header ? header->capacity : 0); }
+
+
+private:
+	SharedMapping memory;
+	feed::Header* header = nullptr;
+	uint8_t* ring = nullptr;
+
+	uint64_t position = 0;		// where the reserved record starts
+	uint32_t reserved = 0;		// payload bytes reserved, 0 if there's no record in progress
+	uint64_t records = 0, tooLarge = 0;
+};
+
+
+class FeedReader
+{
+public:
+	struct Record {
+		uint32_t type;
+		uint64_t step;
+		const uint8_t* payload;		// in the shared ring, check intact() after using it
+		uint32_t bytes;
+	};
+
+	bool open(const std::string& name);
+	void close() { memory.close(); header = nullptr; }
+
+	unsigned int dimension() const { return header->dimension; }
+
+	// the next published record, false if there's none yet or the reader was lapped
+	bool next(Record& record);
+
+	// the last record next returned wasn't overwritten while it was being used
+	bool intact() const;
+
+	// the producer overwrote the reader's position, seekKey to continue
+	bool lapped() const;
+
+	// move to the latest keyframe, false if none is left in the ring, the reader then continues at the head and
+	// has to skip records up to the next KEY
+	bool seekKey();
+
+
+private:
+	SharedMapping memory;
+	const feed::Header* header = nullptr;
+	const uint8_t* ring = nullptr;
+
+	uint64_t position = 0;		// next record
+	uint64_t current = 0;		// record next returned last
+};
+
+
+// publishes a Simulation's world to a feed, the chunks whose bricks changed since the last step, and every chunk
+// on keyframes so readers can join or recover. Only materials are published, see Simulation::trackChanges.
+template<typename Cell>
+class WorldPublisher
+{
+public:
+	// keyEvery is steps between keyframes, sim has to track changes
+	WorldPublisher(FeedWriter& writer, const Simulation<Cell>& sim, int keyEvery);
+
+	// publish the world as it is after step, the first call always publishes a keyframe
+	void publish(uint64_t step);
+
+	// make the next step a keyframe, after the grid changed in a way the stamps don't cover
+	void requestKey() { keyPending = true; }
+
+	uint64_t chunksPublished() const { return chunks; }
+	uint64_t keyframes() const { return keys; }
+
+
+private:
+	FeedWriter& writer;
+	const Simulation<Cell>& sim;
+	int keyEvery;
+	bool keyPending = true;
+	uint32_t lastIteration = 0;
+	uint64_t lastKey = 0;
+	uint64_t chunks = 0, keys = 0;
+
+	bool publishChunk(int cx, int cy, int cz, uint64_t step);
+};
+
+
+// an Image as a FRAME record, false if it doesn't fit the ring
+bool publishFrame(FeedWriter& writer, const Image& image, uint32_t index, uint64_t step);
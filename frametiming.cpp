@@ -0,0 +1,163 @@
+#include "frametiming.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+
+TimingHistogram::TimingHistogram() :
+	buckets(bucketCount, 0) {}
+
+
+int TimingHistogram::bucket(uint64_t nanoseconds) {
+	if (nanoseconds < uint64_t(subBuckets))
+		return int(nanoseconds);
+
+	int exponent = 3;
+	while (nanoseconds >> (exponent + 1))
+		exponent++;
+
+	const int sub = int(nanoseconds >> (exponent - 3)) - subBuckets;
+	return subBuckets + (exponent - 3) * subBuckets + sub;
+}
+
+uint64_t TimingHistogram::bucketLower(int bucket) {
+	if (bucket < subBuckets)
+		return uint64_t(bucket);
+
+	const int exponent = (bucket - subBuckets) / subBuckets + 3;
+	const int sub = (bucket - subBuckets) % subBuckets;
+	return uint64_t(subBuckets + sub) << (exponent - 3);
+}
+
+uint64_t TimingHistogram::bucketUpper(int bucket) {
+	if (bucket < subBuckets)
+		return uint64_t(bucket) + 1;
+
+	const int exponent = (bucket - subBuckets) / subBuckets + 3;
+	return bucketLower(bucket) + (uint64_t(1) << (exponent - 3));
+}
+
+
+void TimingHistogram::add(uint64_t nanoseconds) {
+	buckets[bucket(nanoseconds)]++;
+
+	minimum = samples ? std::min(minimum, nanoseconds) : nanoseconds;
+	maximum = std::max(maximum, nanoseconds);
+	total += nanoseconds;
+	samples++;
+}
+
+void TimingHistogram::merge(const TimingHistogram& other) {
+	if (!other.samples)
+		return;
+
+	for (int b = 0; b < bucketCount; b++)
+		buckets[b] += other.buckets[b];
+
+	minimum = samples ? std::min(minimum, other.minimum) : other.minimum;
+	maximum = std::max(maximum, other.maximum);
+	total += other.total;
+	samples += other.samples;
+}
+
+void TimingHistogram::clear() {
+	std::fill(buckets.begin(), buckets.end(), 0);
+	samples = total = minimum = maximum = 0;
+}
+
+uint64_t TimingHistogram::percentile(double p) const {
+	if (!samples)
+		return 0;
+
+	// rank of the sample, 1 based
+	const uint64_t rank = std::max<uint64_t>(uint64_t(std::min(std::max(p, 0.), 1.) * double(samples) + .5), 1);
+
+	uint64_t seen = 0;
+	for (int b = 0; b < bucketCount; b++) {
+		seen += buckets[b];
+		if (seen >= rank) {
+			const uint64_t middle = bucketLower(b) + (bucketUpper(b) - 1 - bucketLower(b)) / 2;
+			return std::min(std::max(middle, minimum), maximum);
+		}
+	}
+
+	return maximum;
+}
+
+
+FrameTimings::FrameTimings(std::vector<std::string> phases) :
+	names(std::move(phases)),
+	windows(names.size()),
+	totals(names.size()) {}
+
+void FrameTimings::add(int phase, uint64_t nanoseconds) {
+	windows[phase].add(nanoseconds);
+	totals[phase].add(nanoseconds);
+
+	if (observer)
+		observer(phase, nanoseconds);
+}
+
+void FrameTimings::resetWindow() {
+	for (TimingHistogram& window : windows)
+		window.clear();
+}
+
+std::string FrameTimings::summary() const {
+	std::ostringstream out;
+	for (int phase = 0; phase < phases(); phase++) {
+		const TimingHistogram& h = windows[phase];
+		if (!h.count())
+			continue;
+
+		out << (out.tellp() > 0 ? "\t" : "") << names[phase] << " time: p50 " << h.percentile(.5) / 1000 << "us p95 " << h.percentile(.95) / 1000
+			<< "us p99 " << h.percentile(.99) / 1000 << "us";
+	}
+
+	return out.str();
+}
+
+bool FrameTimings::write(const std::string& path) const {
+	std::ofstream file(path);
+	file << "phase,count,mean_us,min_us,p50_us,p95_us,p99_us,max_us\n";
+	for (int phase = 0; phase < phases(); phase++) {
+		const TimingHistogram& h = totals[phase];
+		file << names[phase] << "," << h.count() << "," << h.mean() / 1000. << "," << h.min() / 1000. << "," << h.percentile(.5) / 1000.
+			<< "," << h.percentile(.95) / 1000. << "," << h.percentile(.99) / 1000. << "," << h.max() / 1000. << "\n";
+	}
+
+	file << "\nphase,bucket_lower_us,bucket_upper_us,count\n";
+	for (int phase = 0; phase < phases(); phase++) {
+		const TimingHistogram& h = totals[phase];
+		for (int b = 0; b < TimingHistogram::bucketCount; b++)
+			if (h.bucketSamples(b))
+				file << names[phase] << "," << TimingHistogram::bucketLower(b) / 1000. << "," << TimingHistogram::bucketUpper(b) / 1000. << "," << h.bucketSamples(b) << "\n";
+	}
+
+	return bool(file);
+}
+
+
+uint64_t ChronoClock::steadyNow() {
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+ChronoClock::ChronoClock(int phases, Source now) :
+	now(std::move(now)),
+	started(phases, 0) {}
+
+void ChronoClock::begin(int phase) {
+	started[phase] = now();
+}
+
+void ChronoClock::end(int phase) {
+	finished.emplace_back(phase, now() - started[phase]);
+}
+
+void ChronoClock::collect(FrameTimings& timings) {
+	for (const auto& result : finished)
+		timings.add(result.first, result.second);
+	finished.clear();
+}
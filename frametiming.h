@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// log-linear histogram of durations in nanoseconds, 8 buckets per power of two keep percentiles within about 6%
+class TimingHistogram
+{
+public:
+	static const int subBuckets = 8;
+	static const int bucketCount = subBuckets + 61 * subBuckets;
+
+	TimingHistogram();
+
+	void add(uint64_t nanoseconds);
+	void merge(const TimingHistogram& other);
+	void clear();
+
+	uint64_t count() const { return samples; }
+	uint64_t sum() const { return total; }
+	uint64_t min() const { return samples ? minimum : 0; }
+	uint64_t max() const { return maximum; }
+	double mean() const { return samples ? double(total) / double(samples) : 0.; }
+
+	// p in [0, 1], the middle of the bucket holding the sample, clamped to the exact min and max
+	uint64_t percentile(double p) const;
+
+	static int bucket(uint64_t nanoseconds);
+	static uint64_t bucketLower(int bucket);
+	static uint64_t bucketUpper(int bucket);	// exclusive
+
+	uint64_t bucketSamples(int bucket) const { return buckets[bucket]; }
+
+
+private:
+	std::vector<uint64_t> buckets;
+	uint64_t samples = 0;
+	uint64_t total = 0;
+	uint64_t minimum = 0;
+	uint64_t maximum = 0;
+};
+
+
+// per phase histograms, one window reset by whoever reports it and one for the whole run
+class FrameTimings
+{
+public:
+	explicit FrameTimings(std::vector<std::string> phases);
+
+	void add(int phase, uint64_t nanoseconds);
+
+	// called with every measurement as it is added, like results of timer queries read frames later
+	using Observer = std::function<void(int phase, uint64_t nanoseconds)>;
+	void observe(Observer observer) { this->observer = std::move(observer); }
+
+	int phases() const { return int(names.size()); }
+	const std::string& name(int phase) const { return names[phase]; }
+	const TimingHistogram& window(int phase) const { return windows[phase]; }
+	const TimingHistogram& total(int phase) const { return totals[phase]; }
+
+	void resetWindow();
+
+	// "<name> time: p50 Nus p95 Nus p99 Nus" for every phase measured in the window
+	std::string summary() const;
+
+	// CSV of every phase's run totals, summary rows followed by the non-empty buckets
+	bool write(const std::string& path) const;
+
+
+private:
+	std::vector<std::string> names;
+	std::vector<TimingHistogram> windows;
+	std::vector<TimingHistogram> totals;
+	Observer observer;
+};
+
+
+// where phase durations come from, timer queries for GPU work or std::chrono for CPU paths
+// begin/end pairs of one frame must not overlap, results may arrive frames later
+class PhaseClock
+{
+public:
+	virtual ~PhaseClock() = default;
+
+	virtual void begin(int phase) = 0;
+	virtual void end(int phase) = 0;
+	virtual void endFrame() {}
+
+	// hand over finished measurements without waiting for any
+	virtual void collect(FrameTimings& timings) = 0;
+	// hand over every measurement, waiting if needed
+	virtual void flush(FrameTimings& timings) { collect(timings); }
+};
+
+
+class ChronoClock : public PhaseClock
+{
+public:
+	using Source = std::function<uint64_t()>;	// nanoseconds, a fake source makes the aggregation repeatable
+
+	static uint64_t steadyNow();
+
+	explicit ChronoClock(int phases, Source now = steadyNow);
+
+	void begin(int phase) override;
+	void end(int phase) override;
+	void collect(FrameTimings& timings) override;
+
+
+private:
+	Source now;
+	std::vector<uint64_t> started;
+	std::vector<std::pair<int, uint64_t>> finished;
+};
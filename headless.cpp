@@ -0,0 +1,832 @@
+// Headless particle simulator running the particlesim.comp rules on the CPU, no window or GPU required
+
+#include "camera.h"
+#include "decomposition.h"
+#include "feed.h"
+#include "frametiming.h"
+#include "image.h"
+#include "pagedworld.h"
+#include "pipeline.h"
+#include "raycast.h"
+#include "renderer.h"
+#include "replay.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "worldstats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+
+namespace {
+	struct {
+		unsigned int dimension = 256;
+		int steps = 1000;
+		unsigned int threads = 0;
+		unsigned int seed = 1;
+		voxel::CellFormat format = voxel::CellFormat::R8UI;
+		int rays = 0;				// rays per image edge when comparing traversals, 0 skips it
+		float drawDist = 300.f;		// maxDrawDist in dda.comp
+		int frames = 0;				// frames rendered over the run, 0 renders nothing
+		int width = 1280, height = 720;
+		std::string output = "frame";
+		std::string imageFormat = "png";
+		std::string cameraPath;		// keyframe file, an orbit around the world if empty
+		std::string load, save;		// snapshot files read before and written after the run
+		std::string record, replay;	// input logs written during the run, or replayed instead of the pour
+		std::string timings;		// sim and render timing histograms written after the run
+		std::string world;			// paged world file walked through during the run, the grid is a window of it
+		unsigned int worldDimension = 0;
+		int processes = 0;			// worker processes splitting the world into slabs, 0 steps it in this process
+		bool claimed = false;		// Simulation::Moves::Claimed instead of the partition passes
+		int sleep = 0;				// idle iterations before a brick sleeps, 0 steps every brick
+		bool scalar = false;		// Simulation::Kernel::Scalar instead of visiting only the packed occupancy bits
+		bool pipelined = false;		// render frames on their own thread from copies while the simulation steps on
+		unsigned int renderThreads = 0;	// render pool size, --threads if 0
+		int rayCache = 0;			// frames between full casts of each pixel, 0 casts every ray in full
+		std::string stats;			// per step world statistics written as CSV, sampling nothing if empty
+		std::string feed;			// shared memory name the world's changes and frames are published under
+		int feedKey = 100;			// steps between keyframes of every chunk
+		int feedMiB = 0;			// ring size, 0 fits two keyframes and frames
+		std::string watch;			// feed to rebuild the world from instead of simulating
+		std::string verify;			// snapshot the rebuilt world has to match when the feed ends
+	} options;
+
+	void usage(const char* name) {
+		std::cout << "usage: " << name << " [--dimension N] [--steps N] [--threads N] [--seed N] [--format 8|16|32] [--rays N] [--drawdist N]"
+			<< " [--frames N] [--width N] [--height N] [--output PREFIX] [--image ppm|png] [--camera FILE]"
+			<< " [--load FILE] [--save FILE] [--record FILE] [--replay FILE] [--timings FILE] [--world FILE] [--worldDimension N] [--processes N] [--moves partitioned|claimed] [--sleep N] [--kernel scalar|packed]"
+			<< " [--render serial|pipelined] [--renderThreads N] [--rayCache N] [--stats FILE]"
+			<< " [--feed NAME] [--feedKey N] [--feedMiB N] [--watch NAME] [--verify FILE]" << std::endl;
+	}
+
+	bool parseArgs(int argc, char* argv[]) {
+		for (int i = 1; i < argc; i++) {
+			if (i + 1 >= argc) {
+				usage(argv[0]);
+				return false;
+			}
+
+			const char* value = argv[++i];
+			if (std::strcmp(argv[i - 1], "--dimension") == 0)		options.dimension = std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--steps") == 0)		options.steps = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--threads") == 0)	options.threads = std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--seed") == 0)		options.seed = std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--rays") == 0)		options.rays = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--drawdist") == 0)	options.drawDist = float(std::atof(value));
+			else if (std::strcmp(argv[i - 1], "--frames") == 0)	options.frames = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--width") == 0)		options.width = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--height") == 0)	options.height = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--output") == 0)	options.output = value;
+			else if (std::strcmp(argv[i - 1], "--image") == 0)		options.imageFormat = value;
+			else if (std::strcmp(argv[i - 1], "--camera") == 0)	options.cameraPath = value;
+			else if (std::strcmp(argv[i - 1], "--load") == 0)		options.load = value;
+			else if (std::strcmp(argv[i - 1], "--save") == 0)		options.save = value;
+			else if (std::strcmp(argv[i - 1], "--record") == 0)	options.record = value;
+			else if (std::strcmp(argv[i - 1], "--replay") == 0)	options.replay = value;
+			else if (std::strcmp(argv[i - 1], "--timings") == 0)	options.timings = value;
+			else if (std::strcmp(argv[i - 1], "--world") == 0)		options.world = value;
+			else if (std::strcmp(argv[i - 1], "--worldDimension") == 0)	options.worldDimension = std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--processes") == 0)	options.processes = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--sleep") == 0)		options.sleep = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--moves") == 0) {
+				if (std::strcmp(value, "partitioned") == 0)		options.claimed = false;
+				else if (std::strcmp(value, "claimed") == 0)	options.claimed = true;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--renderThreads") == 0)	options.renderThreads = std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--rayCache") == 0)	options.rayCache = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--stats") == 0)		options.stats = value;
+			else if (std::strcmp(argv[i - 1], "--feed") == 0)		options.feed = value;
+			else if (std::strcmp(argv[i - 1], "--feedKey") == 0)	options.feedKey = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--feedMiB") == 0)	options.feedMiB = std::atoi(value);
+			else if (std::strcmp(argv[i - 1], "--watch") == 0)		options.watch = value;
+			else if (std::strcmp(argv[i - 1], "--verify") == 0)	options.verify = value;
+			else if (std::strcmp(argv[i - 1], "--render") == 0) {
+				if (std::strcmp(value, "serial") == 0)			options.pipelined = false;
+				else if (std::strcmp(value, "pipelined") == 0)	options.pipelined = true;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--kernel") == 0) {
+				if (std::strcmp(value, "scalar") == 0)			options.scalar = true;
+				else if (std::strcmp(value, "packed") == 0)		options.scalar = false;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else if (std::strcmp(argv[i - 1], "--format") == 0) {
+				const int bits = std::atoi(value);
+				if (bits == 8)			options.format = voxel::CellFormat::R8UI;
+				else if (bits == 16)	options.format = voxel::CellFormat::R16UI;
+				else if (bits == 32)	options.format = voxel::CellFormat::R32UI;
+				else {
+					usage(argv[0]);
+					return false;
+				}
+			}
+			else {
+				usage(argv[0]);
+				return false;
+			}
+		}
+
+		return options.dimension > 0 && options.width > 0 && options.height > 0;
+	}
+
+	template<typename Cell>
+	size_t countParticles(const VoxelGrid<Cell>& grid) {
+		size_t count = 0;
+		for (size_t i = 0; i < grid.size(); i++)
+			count += (grid.data()[i] & voxel::TYPE) != voxel::AIR;
+
+		return count;
+	}
+
+	// FNV-1a over every cell, equal for runs that ended in the same world
+	template<typename Cell>
+	uint32_t checksum(const VoxelGrid<Cell>& grid) {
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < grid.size(); i++)
+			h = (h ^ grid.data()[i]) * 16777619u;
+
+		return h;
+	}
+
+	// pour alternating sand and water from above the center of the world
+	Brush pour(int step) {
+		Brush brush;
+		brush.placeBlock = true;
+		brush.blockType = (step / 50) % 2 ? voxel::WATER : voxel::SAND;
+		brush.blockSize = std::max(options.dimension / 32.f, 2.f);
+		brush.blockLocation[0] = int(options.dimension / 2);
+		brush.blockLocation[1] = int(options.dimension * 3 / 4);
+		brush.blockLocation[2] = int(options.dimension / 2);
+
+		return brush;
+	}
+
+	void normalize(float v[3]) {
+		const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int a = 0; a < 3; a++)
+			v[a] /= length;
+	}
+
+	// App::setupObjects
+	Camera startCamera(unsigned int dimension) {
+		Camera camera;
+		std::fill(camera.position, camera.position + 3, float(dimension + 30));
+		camera.yaw = -2.35f;
+		camera.pitch = -.3f;
+
+		return camera;
+	}
+
+	// cast the same rays with the flat DDA and the occupancy pyramid traversal from App's starting camera
+	template<typename Cell>
+	void measureRays(const VoxelGrid<Cell>& grid, const OccupancyPyramid& occupancy) {
+		using clock = std::chrono::steady_clock;
+
+		// the tracked pyramid should match one built from scratch
+		OccupancyPyramid fresh(grid.dimension());
+		fresh.rebuild(grid);
+		const int bricks = int(fresh.levelDim(0));
+		size_t staleBricks = 0;
+		for (int z = 0; z < bricks; z++)
+			for (int y = 0; y < bricks; y++)
+				for (int x = 0; x < bricks; x++)
+					staleBricks += fresh.occupied(0, x, y, z) != occupancy.occupied(0, x, y, z);
+
+		const Camera camera = startCamera(grid.dimension());
+		const float* eye = camera.position;
+		float right[3], up[3], forward[3];
+		camera.basis(right, up, forward);
+
+		size_t mismatches = 0, hits = 0;
+		unsigned long long flatSteps = 0, pyramidSteps = 0;
+		clock::duration flatTime{}, pyramidTime{};
+
+		for (int py = 0; py < options.rays; py++) {
+			for (int px = 0; px < options.rays; px++) {
+				const float sx = (px - .5f * options.rays) / options.rays;
+				const float sy = (py - .5f * options.rays) / options.rays;
+
+				float dir[3];
+				for (int a = 0; a < 3; a++)
+					dir[a] = right[a] * sx + up[a] * sy + forward[a];
+				normalize(dir);
+
+				auto start = clock::now();
+				const RayHit flat = castRay(grid, eye, dir, options.drawDist);
+				auto middle = clock::now();
+				const RayHit skipped = castRay(grid, eye, dir, options.drawDist, &occupancy);
+				flatTime += middle - start;
+				pyramidTime += clock::now() - middle;
+
+				hits += flat.hit;
+				flatSteps += flat.steps;
+				pyramidSteps += skipped.steps;
+				mismatches += flat.hit != skipped.hit || !std::equal(flat.pos, flat.pos + 3, skipped.pos);
+			}
+		}
+
+		const double rays = double(options.rays) * options.rays;
+		const auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+		std::cout << rays << " rays, " << hits << " hits, " << mismatches << " mismatches, " << staleBricks << " stale bricks" << std::endl;
+		std::cout << "flat dda:\t" << flatSteps / rays << " steps/ray\t" << ms(flatTime) << "ms" << std::endl;
+		std::cout << "pyramid:\t" << pyramidSteps / rays << " steps/ray\t" << ms(pyramidTime) << "ms" << std::endl;
+	}
+}
+
+
+template<typename Cell>
+int run() {
+	// a replay runs every recorded iteration in the recorded world size
+	ReplayLog replayLog;
+	if (!options.replay.empty()) {
+		if (!replayLog.load(options.replay)) {
+			std::cout << "could not read input log " << options.replay << std::endl;
+			return 1;
+		}
+		options.dimension = replayLog.dimension();
+		options.steps = int(replayLog.steps().size());
+		std::cout << "replaying " << options.replay << std::endl;
+	}
+
+	ReplayRecorder recorder;
+	if (!options.record.empty() && !recorder.open(options.record, options.dimension)) {
+		std::cout << "could not write input log " << options.record << std::endl;
+		return 1;
+	}
+
+	Simulation<Cell> sim(options.dimension, options.threads);
+	sim.seed(options.seed);
+	if (options.claimed)
+		sim.setMoves(Simulation<Cell>::Moves::Claimed);
+	if (options.scalar)
+		sim.setKernel(Simulation<Cell>::Kernel::Scalar);
+
+	if (!options.load.empty()) {
+		if (!loadSnapshot(options.load, sim.grid())) {
+			std::cout << "could not load " << options.load << " as a " << options.dimension << "^3 world" << std::endl;
+			return 1;
+		}
+		std::cout << "loaded " << options.load << ", " << countParticles(sim.grid()) << " particles" << std::endl;
+	}
+
+	// a paged world is walked through along x, the window around the walker is what gets simulated
+	PagedWorld<Cell> paged(options.dimension);
+	float walker[3] = {}, walk[3] = {};
+	int windowMoves = 0;
+	if (!options.world.empty()) {
+		const unsigned int worldDimension = options.worldDimension ? options.worldDimension : options.dimension;
+		if (!options.load.empty() || !options.record.empty() || !options.replay.empty()) {
+			std::cout << "a paged world can't be combined with --load, --record or --replay" << std::endl;
+			return 1;
+		}
+		if (!paged.open(options.world, worldDimension)) {
+			std::cout << "could not page " << options.world << " as a " << worldDimension << "^3 world around a " << options.dimension << "^3 window" << std::endl;
+			return 1;
+		}
+
+		walker[1] = walker[2] = worldDimension / 2.f;
+		walk[0] = float(worldDimension) / float(std::max(options.steps, 1));
+		paged.moveTo(walker);
+		paged.load(sim.grid());
+		std::cout << "paging a " << worldDimension << "^3 world from " << options.world << ", " << paged.chunks().limit() << " cached chunks" << std::endl;
+	}
+
+	sim.setSleep(options.sleep);
+
+	// spectator feed of the world's changed chunks and the rendered frames, see feed.h
+	FeedWriter feedWriter;
+	std::mutex feedLock;	// pipelined frames are published from the render thread
+	std::unique_ptr<WorldPublisher<Cell>> publisher;
+	if (!options.feed.empty()) {
+		if (options.dimension % feed::chunkDim != 0) {
+			std::cout << "a feed needs a dimension that's a multiple of " << feed::chunkDim << std::endl;
+			return 1;
+		}
+
+		const size_t worldBytes = size_t(options.dimension) * options.dimension * options.dimension;
+		const size_t frameBytes = options.frames > 0 ? size_t(options.width) * options.height * 3 : 0;
+		const size_t capacity = options.feedMiB > 0 ? size_t(options.feedMiB) << 20 : 2 * (worldBytes + frameBytes) + (size_t(16) << 20);
+		if (!feedWriter.create(options.feed, options.dimension, capacity)) {
+			std::cout << "could not create the feed " << options.feed << std::endl;
+			return 1;
+		}
+
+		sim.trackChanges();
+		publisher.reset(new WorldPublisher<Cell>(feedWriter, sim, options.feedKey));
+		publisher->publish(0);
+		std::cout << "publishing to " << options.feed << ", " << (capacity >> 20) << " MiB ring" << std::endl;
+	}
+
+	OccupancyPyramid occupancy(options.dimension);
+	if (options.rays > 0 || options.frames > 0)
+		sim.trackOccupancy(&occupancy);
+
+	CameraPath cameraPath = CameraPath::orbit(options.dimension);
+	if (!options.cameraPath.empty() && !CameraPath::load(options.cameraPath, cameraPath)) {
+		std::cout << "could not read camera path " << options.cameraPath << std::endl;
+		return 1;
+	}
+
+	ThreadPool renderPool(options.renderThreads ? options.renderThreads : options.threads);
+	Renderer renderer(options.width, options.height, renderPool);
+	renderer.setDrawDistance(options.drawDist);
+	renderer.setRayCache(options.rayCache);
+	const int renderEvery = options.frames > 0 ? std::max(options.steps / options.frames, 1) : 0;
+	int frame = 0;
+
+	// traversal totals over the frames, written by whichever thread renders
+	unsigned long long renderedSteps = 0, cachedRays = 0, retracedRays = 0;
+
+	using Pipeline = RenderPipeline<Cell>;
+	const auto writeFrame = [&](const typename Pipeline::Frame& f, const Renderer& r, uint64_t renderNs) {
+		std::ostringstream path;
+		path << options.output << std::setw(4) << std::setfill('0') << f.index << "." << options.imageFormat;
+		const bool written = options.imageFormat == "ppm" ? writePPM(path.str(), r.image()) : writePNG(path.str(), r.image());
+
+		// one write per frame, pipelined frames report from the render thread
+		std::ostringstream report;
+		if (!written)
+			report << "could not write " << path.str() << "\n";
+		const double pixels = double(options.width) * options.height;
+		report << path.str() << "\trender time: " << renderNs / 1000 << "us\t" << double(r.steps()) / pixels << " steps/pixel";
+		if (options.rayCache > 0)
+			report << "\t" << 100. * double(r.cachedRays()) / pixels << "% cached, " << 100. * double(r.retracedRays()) / pixels << "% retraced";
+		report << "\n";
+		std::cout << report.str() << std::flush;
+
+		renderedSteps += r.steps();
+		cachedRays += r.cachedRays();
+		retracedRays += r.retracedRays();
+
+		if (feedWriter.isOpen()) {
+			std::lock_guard<std::mutex> guard(feedLock);
+			publishFrame(feedWriter, r.image(), uint32_t(f.index), uint64_t(f.index + 1) * renderEvery);
+		}
+	};
+
+	// pipelined render times wait on the render thread's side until the loop collects them
+	std::mutex renderedLock;
+	std::vector<uint64_t> rendered;
+
+	std::unique_ptr<Pipeline> pipeline;
+	if (options.pipelined && options.frames > 0) {
+		pipeline.reset(new Pipeline(options.dimension, renderer, [&](const typename Pipeline::Frame& f, const Renderer& r, uint64_t renderNs) {
+			writeFrame(f, r, renderNs);
+			std::lock_guard<std::mutex> guard(renderedLock);
+			rendered.push_back(renderNs);
+		}));
+	}
+
+	std::cout << "dimension " << options.dimension << ", " << voxel::cellFormatName(sim.grid().format) << " cells (" << sim.grid().bytes() / 1048576.0 << " MiB), "
+		<< sim.threads() << " threads, " << options.steps << " steps" << std::endl;
+
+	Brush brush = pour(0);
+
+	enum { simPhase, renderPhase };
+	FrameTimings timings({ "sim", "render" });
+	ChronoClock cpuClock(2);
+
+	// world statistics after every step, their reductions run outside the sim timings on a pool of their own
+	ThreadPool statsPool(options.stats.empty() ? 1 : options.threads);
+	WorldStatistics<Cell> stats(statsPool);
+	std::ofstream statsFile;
+	uint64_t stepNs = 0;
+	int leakingSteps = 0, firstLeak = 0;
+	if (!options.stats.empty()) {
+		statsFile.open(options.stats);
+		if (!statsFile) {
+			std::cout << "could not write " << options.stats << std::endl;
+			return 1;
+		}
+		statsFile << "step,sim_us," << WorldStats::csvHeader() << "\n";
+
+		stats.sample(sim.grid(), sim.brushed());
+		timings.observe([&](int phase, uint64_t nanoseconds) {
+			if (phase == simPhase)
+				stepNs = nanoseconds;
+		});
+	}
+
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+	auto lastReport = start;
+	size_t activeBricks = 0;
+
+	// the renderer may be busy with an earlier frame on the pipeline's thread, so a window move only marks the
+	// cached rays stale and the next frame clears them where it's rendered
+	bool rayCacheStale = false;
+
+	for (int step = 0; step < options.steps; step++) {
+		if (!options.world.empty()) {
+			for (int a = 0; a < 3; a++)
+				walker[a] += walk[a];
+
+			// chunks half a window of steps ahead are loaded before the window gets there
+			paged.prefetch(walker, walk, options.dimension / 2.f / walk[0]);
+			if (paged.follow(walker, sim.grid())) {
+				windowMoves++;
+				sim.wake();
+				rayCacheStale = true;
+				stats.reset();
+				if (publisher)
+					publisher->requestKey();
+				if (options.rays > 0 || options.frames > 0)
+					occupancy.rebuild(sim.grid());
+			}
+
+			for (int a = 0; a < 3; a += 2)
+				brush.blockLocation[a] = std::min(std::max(int(walker[a]) - paged.origin()[a], 0), int(options.dimension) - 1);
+		}
+
+		cpuClock.begin(simPhase);
+		if (!options.replay.empty()) {
+			const ReplayStep& recorded = replayLog.steps()[step];
+			brush = recorded.brush;
+			sim.setBrush(brush);
+			sim.stepWith(recorded.rng);
+		}
+		else {
+			brush.blockType = pour(step).blockType;
+			sim.setBrush(brush);
+			sim.step();
+		}
+		cpuClock.end(simPhase);
+		activeBricks += sim.activeBricks();
+
+		if (recorder.isOpen())
+			recorder.record({ brush, sim.lastRNG() });
+
+		if (publisher) {
+			std::lock_guard<std::mutex> guard(feedLock);
+			publisher->publish(uint64_t(step) + 1);
+		}
+
+		if (frame < options.frames && (step + 1) % renderEvery == 0) {
+			typename Pipeline::Frame f;
+			f.index = frame;
+			f.overlay.blockSize = brush.blockSize;
+			std::copy(brush.blockLocation, brush.blockLocation + 3, f.overlay.blockLocation);
+			f.camera = cameraPath.at(options.frames > 1 ? float(frame) / float(options.frames - 1) : 0.f);
+			f.clearRayCache = rayCacheStale;
+			rayCacheStale = false;
+
+			if (pipeline) {
+				pipeline->submit(sim.grid(), occupancy, f);
+			}
+			else {
+				const auto renderStart = clock::now();
+				if (f.clearRayCache)
+					renderer.clearRayCache();
+				renderer.render(sim.grid(), &occupancy, f.camera, &f.overlay);
+				const uint64_t renderNs = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - renderStart).count());
+				timings.add(renderPhase, renderNs);
+				writeFrame(f, renderer, renderNs);
+			}
+			frame++;
+		}
+
+		if (pipeline) {
+			std::lock_guard<std::mutex> guard(renderedLock);
+			for (uint64_t renderNs : rendered)
+				timings.add(renderPhase, renderNs);
+			rendered.clear();
+		}
+
+		// output step time percentiles every second
+		cpuClock.collect(timings);
+
+		if (statsFile.is_open()) {
+			const WorldStats& s = stats.sample(sim.grid(), sim.brushed());
+			statsFile << step + 1 << "," << stepNs / 1000. << "," << s.csvRow() << "\n";
+
+			// leaks are reported as they happen, the file keeps every step
+			if (!s.conserved()) {
+				if (leakingSteps++ == 0)
+					firstLeak = step + 1;
+				std::cout << "step " << step + 1 << "\t" << s.summary() << std::endl;
+			}
+		}
+
+		const auto now = clock::now();
+		if (now - lastReport >= std::chrono::seconds(1)) {
+			std::cout << "step " << step + 1 << "\t" << timings.summary();
+			if (options.sleep > 0)
+				std::cout << "\t" << sim.activeBricks() << " of " << sim.brickCount() << " bricks active";
+			if (statsFile.is_open())
+				std::cout << "\t" << stats.last().summary();
+			std::cout << std::endl;
+
+			timings.resetWindow();
+			lastReport = now;
+		}
+	}
+
+	if (pipeline) {
+		pipeline->finish();
+		for (uint64_t renderNs : rendered)
+			timings.add(renderPhase, renderNs);
+		std::cout << "pipelined rendering held the simulation back " << pipeline->stalledNs() / 1000000.0 << "ms" << std::endl;
+	}
+
+	const auto total = std::chrono::duration<double>(clock::now() - start).count();
+	std::cout << "finished in " << total << "s, " << options.steps / total << " steps/s, " << countParticles(sim.grid()) << " particles, checksum "
+		<< std::hex << checksum(sim.grid()) << std::dec << std::endl;
+
+	if (options.sleep > 0)
+		std::cout << double(activeBricks) / std::max(options.steps, 1) << " of " << sim.brickCount() << " bricks active per step on average" << std::endl;
+
+	if (statsFile.is_open()) {
+		if (leakingSteps > 0)
+			std::cout << "particle counts drifted from the brush's changes in " << leakingSteps << " steps, first after step " << firstLeak << std::endl;
+		else
+			std::cout << "particle counts matched the brush's changes every step" << std::endl;
+
+		statsFile.close();
+		if (!statsFile) {
+			std::cout << "could not write " << options.stats << std::endl;
+			return 1;
+		}
+		std::cout << "wrote world statistics to " << options.stats << std::endl;
+	}
+
+	if (frame > 0) {
+		const double rays = double(frame) * options.width * options.height;
+		std::cout << double(renderedSteps) / rays << " steps/pixel over " << frame << " frames";
+		if (options.rayCache > 0)
+			std::cout << ", " << 100. * double(cachedRays) / rays << "% of rays started from the cache, " << 100. * double(retracedRays) / rays << "% cast again in full";
+		std::cout << std::endl;
+	}
+
+	if (!options.world.empty()) {
+		const auto& stats = paged.chunks().stats();
+		std::cout << windowMoves << " window moves, chunk cache " << stats.hits << " hits, " << stats.misses << " misses, " << stats.prefetches << " prefetched, "
+			<< stats.evictions << " evicted, " << stats.writeBacks << " written back" << std::endl;
+
+		if (!paged.save(sim.grid())) {
+			std::cout << "could not save " << options.world << std::endl;
+			return 1;
+		}
+		std::cout << "saved " << options.world << std::endl;
+	}
+
+	if (!options.timings.empty()) {
+		if (!timings.write(options.timings)) {
+			std::cout << "could not write " << options.timings << std::endl;
+			return 1;
+		}
+		std::cout << "wrote timings to " << options.timings << std::endl;
+	}
+
+	if (recorder.isOpen()) {
+		const size_t recorded = recorder.count();
+		if (!recorder.close()) {
+			std::cout << "could not write input log " << options.record << std::endl;
+			return 1;
+		}
+		std::cout << "recorded " << recorded << " steps to " << options.record << std::endl;
+	}
+
+	if (options.rays > 0)
+		measureRays(sim.grid(), occupancy);
+
+	if (!options.save.empty()) {
+		if (!saveSnapshot(options.save, sim.grid())) {
+			std::cout << "could not save " << options.save << std::endl;
+			return 1;
+		}
+		std::cout << "saved " << options.save << std::endl;
+	}
+
+	// closed after the snapshot is saved, a watcher verifying against it finds it written
+	if (publisher) {
+		std::cout << "published " << publisher->keyframes() << " keyframes and " << publisher->chunksPublished() << " chunks in " << feedWriter.published() << " records";
+		if (feedWriter.dropped() > 0)
+			std::cout << ", " << feedWriter.dropped() << " records didn't fit the ring";
+		std::cout << std::endl;
+		feedWriter.close();
+	}
+
+	return 0;
+}
+
+
+// the same pour stepped by worker processes that each own a slab of the world, see decomposition.h
+template<typename Cell>
+int runProcesses() {
+	if (options.rays > 0 || options.frames > 0 || !options.record.empty() || !options.replay.empty() || !options.world.empty() || options.claimed || options.sleep > 0 || !options.feed.empty()) {
+		std::cout << "--processes only combines with --load and --save" << std::endl;
+		return 1;
+	}
+
+	DecomposedWorld<Cell> decomposed(options.dimension, options.processes, options.threads);
+	if (!decomposed.valid()) {
+		std::cout << "a " << options.dimension << "^3 world splits into at most " << (options.dimension + 15) / 16 << " slabs" << std::endl;
+		return 1;
+	}
+
+	VoxelGrid<Cell> world(options.dimension);
+	if (!options.load.empty() && !loadSnapshot(options.load, world)) {
+		std::cout << "could not load " << options.load << " as a " << options.dimension << "^3 world" << std::endl;
+		return 1;
+	}
+
+	std::cout << "dimension " << options.dimension << ", " << voxel::cellFormatName(world.format) << " cells, " << options.processes << " processes of "
+		<< ThreadPool(options.threads).size() << " threads, " << options.steps << " steps" << std::endl;
+	for (const auto& slab : decomposed.slabsOf())
+		std::cout << "slab z " << slab.zBegin << " to " << slab.zEnd << std::endl;
+
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+
+	if (!decomposed.run(world, options.steps, options.seed, pour)) {
+		std::cout << "worker processes failed" << std::endl;
+		return 1;
+	}
+
+	const auto total = std::chrono::duration<double>(clock::now() - start).count();
+	std::cout << "finished in " << total << "s, " << options.steps / total << " steps/s, " << countParticles(world) << " particles, checksum "
+		<< std::hex << checksum(world) << std::dec << std::endl;
+
+	if (!options.save.empty()) {
+		if (!saveSnapshot(options.save, world)) {
+			std::cout << "could not save " << options.save << std::endl;
+			return 1;
+		}
+		std::cout << "saved " << options.save << std::endl;
+	}
+
+	return 0;
+}
+
+
+// rebuilds the world of a running simulator's feed, resyncing at its keyframes whenever it falls a ring behind
+int watch() {
+	FeedReader reader;
+	bool opened = false;
+	for (int attempt = 0; attempt < 50 && !(opened = reader.open(options.watch)); attempt++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	if (!opened) {
+		std::cout << "could not open the feed " << options.watch << std::endl;
+		return 1;
+	}
+
+	const int dim = int(reader.dimension());
+	if (dim == 0 || dim % int(feed::chunkDim) != 0) {
+		std::cout << "the feed " << options.watch << " has no world" << std::endl;
+		return 1;
+	}
+	std::cout << "watching " << options.watch << ", dimension " << dim << std::endl;
+
+	VoxelGrid<uint8_t> world(reader.dimension());
+	const int edge = int(feed::chunkDim);
+	const size_t chunkCells = size_t(edge) * edge * edge;
+
+	// chunks are only applied from a keyframe on, before it the world isn't whole
+	bool synced = false;
+	uint32_t stepChunks = 0;
+	uint64_t steps = 0, incomplete = 0, frames = 0, resyncs = 0, lastStep = 0;
+	bool ended = false;
+
+	const auto resync = [&]() {
+		resyncs++;
+		synced = false;
+		reader.seekKey();
+	};
+
+	while (!ended) {
+		FeedReader::Record record;
+		if (!reader.next(record)) {
+			if (reader.lapped())
+				resync();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		switch (record.type) {
+		case feed::KEY:
+			synced = true;
+			stepChunks = 0;
+			break;
+
+		case feed::CHUNK: {
+			if (!synced || record.bytes < sizeof(feed::ChunkRecord))
+				break;
+
+			feed::ChunkRecord chunk;
+			std::memcpy(&chunk, record.payload, sizeof(chunk));
+			if (chunk.x < 0 || chunk.y < 0 || chunk.z < 0 || chunk.x >= dim / edge || chunk.y >= dim / edge || chunk.z >= dim / edge)
+				break;
+			if (chunk.fill == feed::mixed && record.bytes < sizeof(chunk) + chunkCells)
+				break;
+
+			const uint8_t* cells = record.payload + sizeof(chunk);
+			for (int z = 0; z < edge; z++) {
+				for (int y = 0; y < edge; y++) {
+					uint8_t* row = world.data() + world.index(chunk.x * edge, chunk.y * edge + y, chunk.z * edge + z);
+					if (chunk.fill == feed::mixed)
+						std::memcpy(row, cells + (size_t(z) * edge + y) * edge, size_t(edge));
+					else
+						std::memset(row, int(chunk.fill), size_t(edge));
+				}
+			}
+			stepChunks++;
+			break;
+		}
+
+		case feed::STEP: {
+			if (!synced || record.bytes < sizeof(feed::StepRecord))
+				break;
+
+			feed::StepRecord step;
+			std::memcpy(&step, record.payload, sizeof(step));
+			if (step.chunks != stepChunks)
+				incomplete++;
+			stepChunks = 0;
+			lastStep = record.step;
+			steps++;
+			break;
+		}
+
+		case feed::FRAME:
+			frames++;
+			break;
+
+		case feed::END:
+			ended = true;
+			break;
+		}
+
+		// a record the writer reached while it was applied leaves the world torn until the next keyframe
+		if (!reader.intact())
+			resync();
+	}
+
+	std::cout << "feed ended after step " << lastStep << ", " << steps << " steps, " << frames << " frames, " << resyncs << " resyncs";
+	if (incomplete > 0)
+		std::cout << ", " << incomplete << " steps missed chunks";
+	std::cout << ", " << countParticles(world) << " particles" << std::endl;
+
+	if (!options.verify.empty()) {
+		VoxelGrid<uint32_t> expected(reader.dimension());
+		if (!loadSnapshot(options.verify, expected)) {
+			std::cout << "could not load " << options.verify << " as a " << dim << "^3 world" << std::endl;
+			return 1;
+		}
+
+		size_t differ = 0;
+		for (size_t i = 0; i < world.size(); i++)
+			differ += (expected.data()[i] & voxel::TYPE) != world.data()[i];
+		if (!synced || differ > 0) {
+			std::cout << "the watched world differs from " << options.verify << " in " << differ << " cells" << (synced ? "" : ", never synced") << std::endl;
+			return 1;
+		}
+		std::cout << "the watched world matches " << options.verify << std::endl;
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (!parseArgs(argc, argv))
+		return 1;
+
+	if (!options.watch.empty())
+		return watch();
+
+	if (options.processes > 0) {
+		switch (options.format) {
+		case voxel::CellFormat::R8UI:	return runProcesses<uint8_t>();
+		case voxel::CellFormat::R16UI:	return runProcesses<uint16_t>();
+		default:						return runProcesses<uint32_t>();
+		}
+	}
+
+	switch (options.format) {
+	case voxel::CellFormat::R8UI:	return run<uint8_t>();
+	case voxel::CellFormat::R16UI:	return run<uint16_t>();
+	default:						return run<uint32_t>();
+	}
+}
@@ -0,0 +1,112 @@
+#include "image.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+
+namespace {
+	uint32_t crc32(const uint8_t* data, size_t length) {
+		static const std::array<uint32_t, 256> table = []() {
+			std::array<uint32_t, 256> t;
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+
+		uint32_t crc = 0xFFFFFFFF;
+		for (size_t i = 0; i < length; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+		return ~crc;
+	}
+
+	void putBigEndian(std::vector<uint8_t>& out, uint32_t v) {
+		out.push_back(uint8_t(v >> 24));
+		out.push_back(uint8_t(v >> 16));
+		out.push_back(uint8_t(v >> 8));
+		out.push_back(uint8_t(v));
+	}
+
+	void writeChunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data) {
+		std::vector<uint8_t> chunk;
+		putBigEndian(chunk, uint32_t(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+
+		file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	}
+}
+
+
+bool writePPM(const std::string& path, const Image& image) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file << "P6\n" << image.width << " " << image.height << "\n255\n";
+	file.write(reinterpret_cast<const char*>(image.rgb.data()), image.rgb.size());
+
+	return bool(file);
+}
+
+
+bool writePNG(const std::string& path, const Image& image) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	// 8 bit RGB, no interlacing
+	std::vector<uint8_t> header;
+	putBigEndian(header, uint32_t(image.width));
+	putBigEndian(header, uint32_t(image.height));
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });
+	writeChunk(file, "IHDR", header);
+
+	// scanlines each prefixed with filter type 0
+	const size_t stride = size_t(image.width) * 3;
+	std::vector<uint8_t> raw;
+	raw.reserve((stride + 1) * image.height);
+	for (int y = 0; y < image.height; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), image.rgb.begin() + y * stride, image.rgb.begin() + (y + 1) * stride);
+	}
+
+	// zlib stream of stored deflate blocks
+	std::vector<uint8_t> zlib = { 0x78, 0x01 };
+	for (size_t offset = 0; ; ) {
+		const size_t length = std::min(raw.size() - offset, size_t(0xFFFF));
+		const bool last = offset + length == raw.size();
+
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(uint8_t(length));
+		zlib.push_back(uint8_t(length >> 8));
+		zlib.push_back(uint8_t(~length));
+		zlib.push_back(uint8_t(~length >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+
+		offset += length;
+		if (last)
+			break;
+	}
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(zlib, b << 16 | a);
+
+	writeChunk(file, "IDAT", zlib);
+	writeChunk(file, "IEND", {});
+
+	return bool(file);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// RGB8 image, rows stored top to bottom
+struct Image
+{
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> rgb;
+
+	void resize(int width, int height) {
+		this->width = width;
+		this->height = height;
+		rgb.assign(size_t(width) * height * 3, 0);
+	}
+};
+
+
+bool writePPM(const std::string& path, const Image& image);
+
+// uncompressed deflate so no zlib is needed, the files are about as large as a PPM
+bool writePNG(const std::string& path, const Image& image);
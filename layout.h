@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Cell orders a VoxelGrid can store its cells in
+// Linear is x-major like the 3D texture, so the y - 1 neighbour every sand and water rule probes first is a whole
+// row away and the z neighbours a whole layer. Bricked stores 8^3 tiles, the bricks the simulation passes update,
+// one after another, keeping a particle's 3x3x2 stencil within a tile or two. Morton interleaves the coordinate
+// bits, which keeps neighbours close at every scale but costs more to index. Only Linear matches the texture,
+// snapshots and renderers, other orders are converted with copyCells in voxelgrid.h on the way in and out.
+namespace layout
+{
+	struct Linear {
+		static const char* name() { return "linear"; }
+
+		static size_t size(unsigned int dim, unsigned int depth) { return size_t(dim) * dim * depth; }
+
+		static size_t index(int x, int y, int z, unsigned int dim) {
+			return (size_t(z) * dim + size_t(y)) * dim + size_t(x);
+		}
+	};
+
+	struct Bricked {
+		static const int shift = 3;
+		static const int mask = (1 << shift) - 1;
+
+		static const char* name() { return "bricked"; }
+
+		// edges are padded to whole bricks
+		static size_t size(unsigned int dim, unsigned int depth) {
+			const size_t bricks = (size_t(dim) + mask) >> shift;
+			return bricks * bricks * ((size_t(depth) + mask) >> shift) << (3 * shift);
+		}
+
+		static size_t index(int x, int y, int z, unsigned int dim) {
+			const size_t bricks = (size_t(dim) + mask) >> shift;
+			const size_t brick = (size_t(z >> shift) * bricks + size_t(y >> shift)) * bricks + size_t(x >> shift);
+			return brick << (3 * shift) | size_t((z & mask) << (2 * shift) | (y & mask) << shift | (x & mask));
+		}
+	};
+
+	struct Morton {
+		static const char* name() { return "morton"; }
+
+		// edges are padded to the next power of two
+		static size_t size(unsigned int dim, unsigned int depth) {
+			size_t edge = 1;
+			while (edge < dim || edge < depth)
+				edge *= 2;
+			return edge * edge * edge;
+		}
+
+		static size_t index(int x, int y, int z, unsigned int) {
+			return size_t(spread(uint32_t(x)) | spread(uint32_t(y)) << 1 | spread(uint32_t(z)) << 2);
+		}
+
+		// the low 21 bits of v two bits apart
+		static uint64_t spread(uint32_t v) {
+			uint64_t b = v & 0x1FFFFF;
+			b = (b | b << 32) & 0x1F00000000FFFFull;
+			b = (b | b << 16) & 0x1F0000FF0000FFull;
+			b = (b | b << 8) & 0x100F00F00F00F00Full;
+			b = (b | b << 4) & 0x10C30C30C30C30C3ull;
+			b = (b | b << 2) & 0x1249249249249249ull;
+			return b;
+		}
+	};
+}
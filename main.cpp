@@ -2,9 +2,67 @@
 
 #include "App.h"
 
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
 
-int main() {
-	App::getInstance().run();
+
+namespace {
+	void usage(const char* name) {
+		std::cout << "usage: " << name << " [--config FILE] [--dimension N] [--simIterations N] [--adaptiveIterations 0|1] [--simLocalDim 4|8] [--maxDrawDist N]"
+			<< " [--cellFormat 8|16|32] [--rayCache N] [--statsEvery N] [--record FILE] [--replay FILE] [--timings FILE] [--stats FILE]" << std::endl;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	// world settings come from --config FILE and --key value flags, they have to be known before the app is created
+	Config& config = App::startupConfig();
+	std::vector<std::pair<const char*, const char*>> appOptions;
+
+	for (int i = 1; i < argc; i += 2) {
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		bool valid = false;
+		if (!value)													valid = false;
+		else if (std::strcmp(argv[i], "--config") == 0)				valid = config.load(value);
+		else if (std::strcmp(argv[i], "--record") == 0 || std::strcmp(argv[i], "--replay") == 0 || std::strcmp(argv[i], "--timings") == 0 || std::strcmp(argv[i], "--stats") == 0) {
+			appOptions.emplace_back(argv[i], value);
+			valid = true;
+		}
+		else														valid = config.set(argv[i], value);
+
+		if (!valid) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	const std::string error = config.check();
+	if (!error.empty()) {
+		std::cout << error << std::endl;
+		return 1;
+	}
+
+	App& app = App::getInstance();
+
+	// --record FILE logs the simulation's input, --replay FILE runs a log instead of live input and exits,
+	// --timings FILE writes frame timing histograms on exit, --stats FILE a row of world statistics per readback
+	for (const auto& option : appOptions) {
+		bool opened = true;
+		if (std::strcmp(option.first, "--record") == 0)			opened = app.recordInput(option.second);
+		else if (std::strcmp(option.first, "--replay") == 0)	opened = app.replayInput(option.second);
+		else if (std::strcmp(option.first, "--stats") == 0)		opened = app.exportStats(option.second);
+		else													app.exportTimings(option.second);
+
+		if (!opened) {
+			std::cout << "could not open " << option.second << std::endl;
+			return 1;
+		}
+	}
+
+	app.run();
 
 	return 0;
 }
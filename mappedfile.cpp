@@ -0,0 +1,176 @@
+#include "mappedfile.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+	length = size_t(fileSize.QuadPart);
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		mapping = nullptr;
+		close();
+		return false;
+	}
+
+	view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view == nullptr) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+	close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		close();
+		return false;
+	}
+	length = std::max(size_t(fileSize.QuadPart), size);
+
+	// a mapping larger than the file extends it
+	mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, DWORD(uint64_t(length) >> 32), DWORD(length), NULL);
+	if (mapping == NULL) {
+		mapping = nullptr;
+		close();
+		return false;
+	}
+
+	view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+	if (view == nullptr) {
+		close();
+		return false;
+	}
+
+	writable = true;
+	return true;
+}
+
+bool MappedFile::flush() {
+	return !writable || (FlushViewOfFile(view, 0) && FlushFileBuffers(file));
+}
+
+void MappedFile::close() {
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+
+	view = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	length = 0;
+	writable = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+		close();
+		return false;
+	}
+	length = size_t(fileStat.st_size);
+
+	void* address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED) {
+		close();
+		return false;
+	}
+	view = static_cast<uint8_t*>(address);
+
+	return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+	close();
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+
+	// growing with ftruncate leaves a sparse file, untouched space takes no disk
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || (size_t(fileStat.st_size) < size && ftruncate(fd, off_t(size)) != 0)) {
+		close();
+		return false;
+	}
+	length = std::max(size_t(fileStat.st_size), size);
+
+	void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED) {
+		close();
+		return false;
+	}
+	view = static_cast<uint8_t*>(address);
+
+	writable = true;
+	return true;
+}
+
+bool MappedFile::flush() {
+	return !writable || msync(view, length, MS_SYNC) == 0;
+}
+
+void MappedFile::close() {
+	if (view)
+		munmap(view, length);
+	if (fd >= 0)
+		::close(fd);
+
+	view = nullptr;
+	fd = -1;
+	length = 0;
+	writable = false;
+}
+
+#endif
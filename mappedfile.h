@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// memory map of a whole file, pages are only read from disk when touched
+// open maps read only, create maps read write and dirty pages go back to the file when the OS evicts them or on flush
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+
+	// opens or creates the file, growing it to at least size bytes, added space reads as zeros
+	bool create(const std::string& path, size_t size);
+
+	bool flush();
+	void close();
+
+	bool isOpen() const { return view != nullptr; }
+	bool isWritable() const { return writable; }
+	const uint8_t* data() const { return view; }
+	uint8_t* writableData() { return writable ? view : nullptr; }
+	size_t size() const { return length; }
+
+
+private:
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+	uint8_t* view = nullptr;
+	size_t length = 0;
+	bool writable = false;
+};
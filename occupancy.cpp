@@ -0,0 +1,99 @@
+#include "occupancy.h"
+
+#include <algorithm>
+
+
+OccupancyPyramid::OccupancyPyramid(unsigned int dimension) {
+	for (unsigned int d = std::max((dimension + brickDim - 1) >> brickShift, 1U); ; d = (d + 1) / 2) {
+		Level level;
+		level.dim = d;
+		level.cells.reset(new std::atomic<uint8_t>[size_t(d) * d * d]);
+		for (size_t i = 0; i < size_t(d) * d * d; i++)
+			level.cells[i].store(0, std::memory_order_relaxed);
+
+		pyramid.push_back(std::move(level));
+
+		if (d == 1)
+			break;
+	}
+}
+
+
+int OccupancyPyramid::emptyLevel(int x, int y, int z) const {
+	int level = -1;
+	for (int l = 0; l < levels(); l++) {
+		const int shift = brickShift + l;
+		if (occupied(l, x >> shift, y >> shift, z >> shift))
+			break;
+
+		level = l;
+	}
+
+	return level;
+}
+
+
+template<typename Cell, typename Layout>
+void OccupancyPyramid::rebuild(const VoxelGrid<Cell, Layout>& grid) {
+	const int dim = int(grid.dimension());
+	const int bricks = int(pyramid[0].dim);
+
+	for (int bz = 0; bz < bricks; bz++) {
+		for (int by = 0; by < bricks; by++) {
+			for (int bx = 0; bx < bricks; bx++) {
+				bool any = false;
+				for (int z = bz * brickDim; z < std::min((bz + 1) * brickDim, dim) && !any; z++)
+					for (int y = by * brickDim; y < std::min((by + 1) * brickDim, dim) && !any; y++)
+						for (int x = bx * brickDim; x < std::min((bx + 1) * brickDim, dim) && !any; x++)
+							any = voxel::type(grid.get(x, y, z)) != voxel::AIR;
+
+				setBrick(bx, by, bz, any);
+			}
+		}
+	}
+
+	reduce();
+}
+
+void OccupancyPyramid::assign(const OccupancyPyramid& other) {
+	for (size_t l = 0; l < pyramid.size(); l++) {
+		const size_t cells = size_t(pyramid[l].dim) * pyramid[l].dim * pyramid[l].dim;
+		for (size_t i = 0; i < cells; i++)
+			pyramid[l].cells[i].store(other.pyramid[l].cells[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+}
+
+// port of shaders/occupancy.comp
+void OccupancyPyramid::reduce() {
+	for (size_t l = 1; l < pyramid.size(); l++) {
+		const Level& finer = pyramid[l - 1];
+		const Level& coarser = pyramid[l];
+
+		for (unsigned int z = 0; z < coarser.dim; z++) {
+			for (unsigned int y = 0; y < coarser.dim; y++) {
+				for (unsigned int x = 0; x < coarser.dim; x++) {
+					uint8_t any = 0;
+					for (unsigned int cz = z * 2; cz < std::min(z * 2 + 2, finer.dim); cz++)
+						for (unsigned int cy = y * 2; cy < std::min(y * 2 + 2, finer.dim); cy++)
+							for (unsigned int cx = x * 2; cx < std::min(x * 2 + 2, finer.dim); cx++)
+								any |= finer.cells[(size_t(cz) * finer.dim + cy) * finer.dim + cx].load(std::memory_order_relaxed);
+
+					coarser.cells[(size_t(z) * coarser.dim + y) * coarser.dim + x].store(any, std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+}
+
+
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint8_t>&);
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint16_t>&);
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint32_t>&);
+
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint8_t, layout::Bricked>&);
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint16_t, layout::Bricked>&);
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint32_t, layout::Bricked>&);
+
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint8_t, layout::Morton>&);
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint16_t, layout::Morton>&);
+template void OccupancyPyramid::rebuild(const VoxelGrid<uint32_t, layout::Morton>&);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "voxelgrid.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// CPU copy of the occupancy pyramid used by shaders/dda.comp to skip empty space
+// Level 0 holds one cell per 8^3 brick, the same cubes the simulation passes update, and each level above
+// halves the resolution down to a single cell. Bricks may be marked from several simulation threads at once.
+class OccupancyPyramid
+{
+public:
+	static const int brickShift = 3;
+	static const int brickDim = 1 << brickShift;
+
+	OccupancyPyramid(unsigned int dimension);
+
+	int levels() const { return static_cast<int>(pyramid.size()); }
+	unsigned int levelDim(int level) const { return pyramid[level].dim; }
+
+	// coordinates are in cells of the given level
+	bool occupied(int level, int x, int y, int z) const {
+		const Level& l = pyramid[level];
+		return l.cells[(size_t(z) * l.dim + y) * l.dim + x].load(std::memory_order_relaxed) != 0;
+	}
+
+	void setBrick(int bx, int by, int bz, bool occupied) {
+		const Level& l = pyramid[0];
+		l.cells[(size_t(bz) * l.dim + by) * l.dim + bx].store(occupied, std::memory_order_relaxed);
+	}
+
+	void markVoxel(int x, int y, int z) { setBrick(x >> brickShift, y >> brickShift, z >> brickShift, true); }
+
+	// coarsest empty level around a voxel, or -1 if its brick is occupied
+	int emptyLevel(int x, int y, int z) const;
+
+	// rebuild level 0 from a grid, then the levels above it
+	template<typename Cell, typename Layout>
+	void rebuild(const VoxelGrid<Cell, Layout>& grid);
+
+	// rebuild the levels above 0 from the bricks
+	void reduce();
+
+	// copy every level of a pyramid of the same dimension
+	void assign(const OccupancyPyramid& other);
+
+
+private:
+	struct Level {
+		unsigned int dim;
+		std::unique_ptr<std::atomic<uint8_t>[]> cells;
+	};
+
+	std::vector<Level> pyramid;
+};
@@ -0,0 +1,296 @@
+#include "pagedworld.h"
+
+#include <cmath>
+#include <cstring>
+
+
+namespace {
+	const char magic[4] = { 'V', 'P', 'P', 'W' };
+	const uint32_t version = 1;
+	const size_t chunkCells = size_t(paged::chunkDim) * paged::chunkDim * paged::chunkDim;
+
+	void put32(uint8_t* out, uint32_t v) {
+		for (int b = 0; b < 4; b++)
+			out[b] = uint8_t(v >> (8 * b));
+	}
+
+	uint32_t get32(const uint8_t* in) {
+		uint32_t v = 0;
+		for (int b = 0; b < 4; b++)
+			v |= uint32_t(in[b]) << (8 * b);
+		return v;
+	}
+}
+
+
+template<typename Cell>
+bool ChunkCache<Cell>::open(const std::string& path, unsigned int dimension) {
+	if (dimension == 0 || dimension % paged::chunkDim != 0)
+		return false;
+
+	const voxel::CellFormat format = voxel::CellTraits<Cell>::format;
+	const size_t chunks = size_t(dimension / paged::chunkDim) * (dimension / paged::chunkDim) * (dimension / paged::chunkDim);
+	if (!file.create(path, paged::headerBytes + chunks * chunkCells * sizeof(Cell)))
+		return false;
+
+	// a new file is all zeros, so a missing magic means it was just created
+	uint8_t* header = file.writableData();
+	if (std::memcmp(header, magic, 4) != 0) {
+		std::memcpy(header, magic, 4);
+		put32(header + 4, version);
+		put32(header + 8, dimension);
+		put32(header + 12, paged::chunkDim);
+		put32(header + 16, uint32_t(format));
+	}
+	else if (get32(header + 4) != version || get32(header + 8) != dimension || get32(header + 12) != paged::chunkDim || get32(header + 16) != uint32_t(format)) {
+		file.close();
+		return false;
+	}
+
+	worldDim = dimension;
+	slots.clear();
+	ages.clear();
+	counters = Stats();
+	return true;
+}
+
+template<typename Cell>
+bool ChunkCache<Cell>::flush() {
+	for (auto& entry : slots) {
+		if (entry.second.dirty) {
+			std::copy(entry.second.cells.begin(), entry.second.cells.end(), stored(entry.first));
+			entry.second.dirty = false;
+			counters.writeBacks++;
+		}
+	}
+
+	return file.flush();
+}
+
+template<typename Cell>
+const Cell* ChunkCache<Cell>::read(int chunk) {
+	auto found = slots.find(chunk);
+	if (found == slots.end()) {
+		counters.misses++;
+		return load(chunk).cells.data();
+	}
+
+	counters.hits++;
+	ages.splice(ages.begin(), ages, found->second.age);
+	return found->second.cells.data();
+}
+
+template<typename Cell>
+Cell* ChunkCache<Cell>::write(int chunk) {
+	auto found = slots.find(chunk);
+	if (found == slots.end()) {
+		counters.misses++;
+		Slot& slot = load(chunk);
+		slot.dirty = true;
+		return slot.cells.data();
+	}
+
+	counters.hits++;
+	ages.splice(ages.begin(), ages, found->second.age);
+	found->second.dirty = true;
+	return found->second.cells.data();
+}
+
+template<typename Cell>
+void ChunkCache<Cell>::prefetch(int chunk) {
+	if (slots.count(chunk))
+		return;
+
+	counters.prefetches++;
+	load(chunk);
+}
+
+template<typename Cell>
+typename ChunkCache<Cell>::Slot& ChunkCache<Cell>::load(int chunk) {
+	if (slots.size() >= capacity)
+		evict();
+
+	Slot& slot = slots[chunk];
+	slot.cells.swap(spare);
+	slot.cells.resize(chunkCells);
+
+	const Cell* source = stored(chunk);
+	std::copy(source, source + chunkCells, slot.cells.begin());
+
+	ages.push_front(chunk);
+	slot.age = ages.begin();
+	return slot;
+}
+
+template<typename Cell>
+void ChunkCache<Cell>::evict() {
+	const int chunk = ages.back();
+	ages.pop_back();
+
+	auto found = slots.find(chunk);
+	if (found->second.dirty) {
+		std::copy(found->second.cells.begin(), found->second.cells.end(), stored(chunk));
+		counters.writeBacks++;
+	}
+
+	spare.swap(found->second.cells);
+	slots.erase(found);
+	counters.evictions++;
+}
+
+
+template<typename Cell>
+PagedWorld<Cell>::PagedWorld(unsigned int windowDimension, size_t cacheChunks) :
+	cache(cacheChunks ? cacheChunks : 2 * size_t(windowDimension / paged::chunkDim) * (windowDimension / paged::chunkDim) * (windowDimension / paged::chunkDim)),
+	windowDim(windowDimension) {}
+
+template<typename Cell>
+bool PagedWorld<Cell>::open(const std::string& path, unsigned int worldDimension) {
+	if (windowDim == 0 || windowDim % paged::chunkDim != 0 || windowDim > worldDimension)
+		return false;
+
+	return cache.open(path, worldDimension);
+}
+
+template<typename Cell>
+void PagedWorld<Cell>::target(const float position[3], int chunkOrigin[3]) const {
+	const int last = cache.chunksPerAxis() - windowChunks();
+
+	for (int a = 0; a < 3; a++) {
+		const int centered = int(std::lround((position[a] - .5f * windowDim) / paged::chunkDim));
+		chunkOrigin[a] = std::min(std::max(centered, 0), last);
+	}
+}
+
+template<typename Cell>
+bool PagedWorld<Cell>::needsMove(const float position[3]) const {
+	int chunkOrigin[3];
+	target(position, chunkOrigin);
+
+	// moving is a full store and load, so the player gets a chunk of slack around the center first
+	bool away = false, moved = false;
+	for (int a = 0; a < 3; a++) {
+		away |= std::abs(position[a] - (windowOrigin[a] + .5f * windowDim)) > float(paged::chunkDim);
+		moved |= chunkOrigin[a] * int(paged::chunkDim) != windowOrigin[a];
+	}
+
+	return away && moved;
+}
+
+template<typename Cell>
+bool PagedWorld<Cell>::follow(const float position[3], VoxelGrid<Cell>& window) {
+	if (!needsMove(position))
+		return false;
+
+	store(window);
+	moveTo(position);
+	load(window);
+	return true;
+}
+
+template<typename Cell>
+void PagedWorld<Cell>::moveTo(const float position[3]) {
+	int chunkOrigin[3];
+	target(position, chunkOrigin);
+	for (int a = 0; a < 3; a++)
+		windowOrigin[a] = chunkOrigin[a] * int(paged::chunkDim);
+}
+
+template<typename Cell>
+void PagedWorld<Cell>::prefetch(const float position[3], const float velocity[3], float lookahead) {
+	float ahead[3];
+	for (int a = 0; a < 3; a++)
+		ahead[a] = position[a] + velocity[a] * lookahead;
+
+	int chunkOrigin[3];
+	target(ahead, chunkOrigin);
+
+	const int span = windowChunks();
+	const int current[3] = { windowOrigin[0] / int(paged::chunkDim), windowOrigin[1] / int(paged::chunkDim), windowOrigin[2] / int(paged::chunkDim) };
+
+	// chunks inside the current window live in the window itself
+	for (int cz = chunkOrigin[2]; cz < chunkOrigin[2] + span; cz++) {
+		for (int cy = chunkOrigin[1]; cy < chunkOrigin[1] + span; cy++) {
+			for (int cx = chunkOrigin[0]; cx < chunkOrigin[0] + span; cx++) {
+				const bool inWindow = cx >= current[0] && cx < current[0] + span
+					&& cy >= current[1] && cy < current[1] + span
+					&& cz >= current[2] && cz < current[2] + span;
+				if (!inWindow)
+					cache.prefetch(cache.chunkIndex(cx, cy, cz));
+			}
+		}
+	}
+}
+
+template<typename Cell>
+void PagedWorld<Cell>::store(const VoxelGrid<Cell>& window) {
+	const int edge = int(paged::chunkDim);
+	std::vector<Cell> cells(chunkCells);
+
+	for (int cz = 0; cz < windowChunks(); cz++) {
+		for (int cy = 0; cy < windowChunks(); cy++) {
+			for (int cx = 0; cx < windowChunks(); cx++) {
+				Cell* out = cells.data();
+				for (int z = 0; z < edge; z++) {
+					for (int y = 0; y < edge; y++) {
+						const Cell* row = window.data() + window.index(cx * edge, cy * edge + y, cz * edge + z);
+						out = std::copy(row, row + edge, out);
+					}
+				}
+
+				storeChunk(cx, cy, cz, cells.data());
+			}
+		}
+	}
+}
+
+template<typename Cell>
+void PagedWorld<Cell>::load(VoxelGrid<Cell>& window) {
+	const int edge = int(paged::chunkDim);
+
+	for (int cz = 0; cz < windowChunks(); cz++) {
+		for (int cy = 0; cy < windowChunks(); cy++) {
+			for (int cx = 0; cx < windowChunks(); cx++) {
+				const Cell* in = loadChunk(cx, cy, cz);
+				for (int z = 0; z < edge; z++) {
+					for (int y = 0; y < edge; y++) {
+						std::copy(in, in + edge, window.data() + window.index(cx * edge, cy * edge + y, cz * edge + z));
+						in += edge;
+					}
+				}
+			}
+		}
+	}
+}
+
+template<typename Cell>
+void PagedWorld<Cell>::storeChunk(int cx, int cy, int cz, const Cell* cells) {
+	const int edge = int(paged::chunkDim);
+	const int chunk = cache.chunkIndex(windowOrigin[0] / edge + cx, windowOrigin[1] / edge + cy, windowOrigin[2] / edge + cz);
+
+	// chunks the window didn't change stay clean and are never written to the file
+	const Cell* cached = cache.read(chunk);
+	if (!std::equal(cells, cells + chunkCells, cached))
+		std::copy(cells, cells + chunkCells, cache.write(chunk));
+}
+
+template<typename Cell>
+const Cell* PagedWorld<Cell>::loadChunk(int cx, int cy, int cz) {
+	const int edge = int(paged::chunkDim);
+	return cache.read(cache.chunkIndex(windowOrigin[0] / edge + cx, windowOrigin[1] / edge + cy, windowOrigin[2] / edge + cz));
+}
+
+template<typename Cell>
+bool PagedWorld<Cell>::save(const VoxelGrid<Cell>& window) {
+	store(window);
+	return cache.flush();
+}
+
+
+template class ChunkCache<uint8_t>;
+template class ChunkCache<uint16_t>;
+template class ChunkCache<uint32_t>;
+
+template class PagedWorld<uint8_t>;
+template class PagedWorld<uint16_t>;
+template class PagedWorld<uint32_t>;
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "mappedfile.h"
+#include "voxelgrid.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// World file for worlds larger than memory
+// The file is a header page followed by every chunkDim^3 chunk uncompressed at a fixed offset, x fastest like
+// snapshots. New files are grown sparse, so chunks nothing was ever written to take no disk and read as air.
+//
+// header		"VPPW", version, dimension, chunkDim, cell format (u32 each), padded to headerBytes
+namespace paged
+{
+	const unsigned int chunkDim = 32;
+	const size_t headerBytes = 4096;	// keeps chunks page aligned in the mapping
+}
+
+
+// least recently used cache of chunks copied out of a memory mapped world file
+// Chunks are only written back when evicted or flushed, and only if something changed them.
+template<typename Cell>
+class ChunkCache
+{
+public:
+	ChunkCache(size_t capacity) : capacity(std::max(capacity, size_t(1))) {}
+
+	// opens the world file, creating it when missing, an existing file must match dimension and cell format
+	bool open(const std::string& path, unsigned int dimension);
+	bool flush();
+
+	unsigned int dimension() const { return worldDim; }
+	int chunksPerAxis() const { return int(worldDim / paged::chunkDim); }
+	int chunkIndex(int cx, int cy, int cz) const { return (cz * chunksPerAxis() + cy) * chunksPerAxis() + cx; }
+
+	// resident copy of a chunk, loading it and evicting the least recently used chunk on a miss
+	const Cell* read(int chunk);
+	Cell* write(int chunk);
+
+	// load ahead of use, a no-op for resident chunks
+	void prefetch(int chunk);
+
+	bool resident(int chunk) const { return slots.count(chunk) != 0; }
+	size_t residentCount() const { return slots.size(); }
+	size_t limit() const { return capacity; }
+
+	struct Stats {
+		uint64_t hits = 0, misses = 0, prefetches = 0, evictions = 0, writeBacks = 0;
+	};
+	const Stats& stats() const { return counters; }
+
+
+private:
+	struct Slot {
+		std::vector<Cell> cells;
+		std::list<int>::iterator age;
+		bool dirty = false;
+	};
+
+	MappedFile file;
+	unsigned int worldDim = 0;
+	size_t capacity;
+
+	std::unordered_map<int, Slot> slots;
+	std::list<int> ages;			// most recently used chunk first
+	std::vector<Cell> spare;		// storage of the last evicted slot, reused by the next load
+	Stats counters;
+
+	Slot& load(int chunk);
+	void evict();
+
+	Cell* stored(int chunk) {
+		return reinterpret_cast<Cell*>(file.writableData() + paged::headerBytes) + size_t(chunk) * paged::chunkDim * paged::chunkDim * paged::chunkDim;
+	}
+};
+
+
+// window of a paged world around the player, the part that is resident and simulated
+// The window is a VoxelGrid the simulation runs on, its edge a multiple of chunkDim. When the player moves more
+// than a chunk from its center it is stored back to the cache and reloaded around the player, the chunks it will
+// need next are prefetched along the player's velocity.
+template<typename Cell>
+class PagedWorld
+{
+public:
+	// the cache holds twice the window's chunks when no capacity is given
+	PagedWorld(unsigned int windowDimension, size_t cacheChunks = 0);
+
+	bool open(const std::string& path, unsigned int worldDimension);
+
+	// world voxel coordinates of the window's first cell
+	const int* origin() const { return windowOrigin; }
+	unsigned int windowDimension() const { return windowDim; }
+
+	int windowChunks() const { return int(windowDim / paged::chunkDim); }
+
+	// true if the window should move to keep position, in world voxels, near its center
+	bool needsMove(const float position[3]) const;
+
+	// store the window, move it around position and load it again, returns false if nothing moved
+	bool follow(const float position[3], VoxelGrid<Cell>& window);
+
+	// load the chunks a window around position + velocity * lookahead would need
+	void prefetch(const float position[3], const float velocity[3], float lookahead);
+
+	void store(const VoxelGrid<Cell>& window);
+	void load(VoxelGrid<Cell>& window);
+
+	// store the window and write every changed chunk to the file
+	bool save(const VoxelGrid<Cell>& window);
+
+	// chunk level steps of follow for windows held elsewhere, like a texture, chunk coordinates are window relative
+	// storeChunk every chunk, moveTo, then loadChunk every chunk
+	void storeChunk(int cx, int cy, int cz, const Cell* cells);
+	const Cell* loadChunk(int cx, int cy, int cz);
+	void moveTo(const float position[3]);
+
+	ChunkCache<Cell>& chunks() { return cache; }
+
+
+private:
+	ChunkCache<Cell> cache;
+	unsigned int windowDim;
+	int windowOrigin[3] = { 0, 0, 0 };
+
+	void target(const float position[3], int chunkOrigin[3]) const;
+};
@@ -0,0 +1,100 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+template<typename Cell>
+RenderPipeline<Cell>::RenderPipeline(unsigned int dimension, Renderer& renderer, Done done) :
+	renderer(renderer),
+	done(std::move(done)) {
+	buffers.reserve(2);
+	buffers.emplace_back(dimension);
+	buffers.emplace_back(dimension);
+
+	thread = std::thread([this]() { renderLoop(); });
+}
+
+template<typename Cell>
+RenderPipeline<Cell>::~RenderPipeline() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	thread.join();
+}
+
+
+template<typename Cell>
+void RenderPipeline<Cell>::submit(const VoxelGrid<Cell>& grid, const OccupancyPyramid& occupancy, const Frame& frame) {
+	using clock = std::chrono::steady_clock;
+
+	int free;
+	{
+		const auto start = clock::now();
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [&]() { return queued == -1; });
+		stalled += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+
+		free = rendering == 0 ? 1 : 0;
+	}
+
+	// the render thread only reads the buffer it took, so the other one is copied without the lock
+	Buffer& buffer = buffers[free];
+	std::copy(grid.data(), grid.data() + grid.size(), buffer.grid.data());
+	buffer.occupancy.assign(occupancy);
+	buffer.frame = frame;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queued = free;
+	}
+	changed.notify_all();
+}
+
+template<typename Cell>
+void RenderPipeline<Cell>::finish() {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&]() { return queued == -1 && rendering == -1; });
+}
+
+
+template<typename Cell>
+void RenderPipeline<Cell>::renderLoop() {
+	using clock = std::chrono::steady_clock;
+
+	for (;;) {
+		int taken;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [&]() { return queued != -1 || stopping; });
+			if (queued == -1)
+				return;
+
+			taken = rendering = queued;
+			queued = -1;
+		}
+		changed.notify_all();
+
+		const Buffer& buffer = buffers[taken];
+		const auto start = clock::now();
+		if (buffer.frame.clearRayCache)
+			renderer.clearRayCache();
+		renderer.render(buffer.grid, &buffer.occupancy, buffer.frame.camera, &buffer.frame.overlay);
+		const auto renderNs = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+		done(buffer.frame, renderer, uint64_t(renderNs));
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			rendering = -1;
+		}
+		changed.notify_all();
+	}
+}
+
+
+template class RenderPipeline<uint8_t>;
+template class RenderPipeline<uint16_t>;
+template class RenderPipeline<uint32_t>;
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "camera.h"
+#include "occupancy.h"
+#include "raycast.h"
+#include "renderer.h"
+#include "voxelgrid.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Renders frames on their own thread from copies of the world, so the simulation keeps stepping meanwhile
+// Two world buffers ping-pong: one is rendered while the next frame is copied into the other. submit waits while
+// a copied frame is still queued behind the one rendering, so the images lag the simulation by at most two frames
+// and a step costs about the slower of simulating and rendering instead of both.
+template<typename Cell>
+class RenderPipeline
+{
+public:
+	struct Frame {
+		int index = 0;
+		Camera camera;
+		RayOverlay overlay;
+		bool clearRayCache = false;	// the world moved under the camera since the last frame, cached rays are stale
+	};
+
+	// called on the render thread once a frame's image is ready in the renderer
+	using Done = std::function<void(const Frame& frame, const Renderer& renderer, uint64_t renderNs)>;
+
+	// renderer should draw on a thread pool of its own, the simulation's keeps running alongside it
+	RenderPipeline(unsigned int dimension, Renderer& renderer, Done done);
+	~RenderPipeline();
+
+	RenderPipeline(const RenderPipeline&) = delete;
+	RenderPipeline& operator=(const RenderPipeline&) = delete;
+
+	// copy the world and queue a frame of it
+	void submit(const VoxelGrid<Cell>& grid, const OccupancyPyramid& occupancy, const Frame& frame);
+
+	// wait until every submitted frame is done
+	void finish();
+
+	// time submit spent waiting for the render thread
+	uint64_t stalledNs() const { return stalled; }
+
+
+private:
+	struct Buffer {
+		VoxelGrid<Cell> grid;
+		OccupancyPyramid occupancy;
+		Frame frame;
+
+		Buffer(unsigned int dimension) : grid(dimension), occupancy(dimension) {}
+	};
+
+	Renderer& renderer;
+	Done done;
+	std::vector<Buffer> buffers;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	int queued = -1;		// buffer waiting for the render thread
+	int rendering = -1;		// buffer the render thread reads
+	bool stopping = false;
+	uint64_t stalled = 0;
+
+	std::thread thread;
+
+	void renderLoop();
+};
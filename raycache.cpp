@@ -0,0 +1,161 @@
+#include "raycache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace {
+	const uint32_t none = ~0u;
+	const float halfDiagonal = .87f;	// center of a voxel to its furthest corner, rounded up
+
+	float dot(const float a[3], const float b[3]) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+}
+
+
+RayCache::RayCache(int width, int height) :
+	width(width),
+	height(height),
+	hits(size_t(width) * height, Hit{ { 0, 0, 0 }, voxel::AIR }),
+	depth(new std::atomic<uint32_t>[size_t(width) * height]) {
+	for (size_t i = 0; i < hits.size(); i++)
+		depth[i].store(none, std::memory_order_relaxed);
+}
+
+
+void RayCache::setRefresh(int frames) {
+	refreshFrames = std::max(frames, 0);
+
+	// hits stored before the cache was off are no use
+	clear();
+}
+
+void RayCache::clear() {
+	std::fill(hits.begin(), hits.end(), Hit{ { 0, 0, 0 }, voxel::AIR });
+}
+
+
+template<typename Cell>
+void RayCache::reproject(const VoxelGrid<Cell>& grid, const Camera& camera, ThreadPool& pool) {
+	frame++;
+
+	float right[3], up[3], forward[3];
+	camera.basis(right, up, forward);
+
+	pool.parallelFor(size_t(height), [&](size_t row) {
+		for (int px = 0; px < width; px++)
+			depth[row * width + px].store(none, std::memory_order_relaxed);
+	});
+
+	pool.parallelFor(size_t(height), [&](size_t row) {
+		for (int px = 0; px < width; px++) {
+			const Hit& hit = hits[row * width + px];
+			if (hit.voxel == voxel::AIR)
+				continue;
+
+			// voxels that changed since are found by casting in full
+			if (!grid.inBounds(hit.pos[0], hit.pos[1], hit.pos[2]) || voxel::type(grid.get(hit.pos[0], hit.pos[1], hit.pos[2])) != hit.voxel)
+				continue;
+
+			float v[3];
+			for (int a = 0; a < 3; a++)
+				v[a] = float(hit.pos[a]) + .5f - camera.position[a];
+
+			const float z = dot(v, forward);
+			if (z <= 0.f)
+				continue;
+
+			// the pixel whose ray passes closest to the voxel's center, the renderer's right * sx + up * sy + forward inverted
+			const int tx = int(std::floor(dot(v, right) / z * float(height) + .5f * float(width) + .5f));
+			const int ty = int(std::floor(dot(v, up) / z * float(height) + .5f * float(height) + .5f));
+			if (tx < 0 || tx >= width || ty < 0 || ty >= height)
+				continue;
+
+			// distance to the voxel's nearest possible point, positive floats order like their bits
+			const float d = std::max(std::sqrt(dot(v, v)) - halfDiagonal, 0.f);
+			uint32_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+
+			std::atomic<uint32_t>& slot = depth[size_t(ty) * width + tx];
+			uint32_t current = slot.load(std::memory_order_relaxed);
+			while (bits < current && !slot.compare_exchange_weak(current, bits, std::memory_order_relaxed));
+		}
+	});
+}
+
+
+bool RayCache::around(int px, int py, float& nearest, float& furthest) const {
+	bool found = false;
+	for (int y = std::max(py - 1, 0); y <= std::min(py + 1, height - 1); y++) {
+		for (int x = std::max(px - 1, 0); x <= std::min(px + 1, width - 1); x++) {
+			const uint32_t bits = depth[size_t(y) * width + x].load(std::memory_order_relaxed);
+			if (bits == none)
+				continue;
+
+			float d;
+			std::memcpy(&d, &bits, sizeof(d));
+			nearest = found ? std::min(nearest, d) : d;
+			furthest = found ? std::max(furthest, d) : d;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+
+float RayCache::start(int px, int py, const float origin[3], const float dir[3], const RayOverlay* overlay) const {
+	if (refreshFrames == 0 || (unsigned(px + 3 * py) + frame) % unsigned(refreshFrames) == 0)
+		return 0.f;
+
+	// grid lines are drawn along the near part of the ray
+	if (overlay && overlay->drawLines)
+		return 0.f;
+
+	float nearest, furthest;
+	if (!around(px, py, nearest, furthest))
+		return 0.f;
+
+	const float t = nearest - float(margin);
+	if (t <= 0.f)
+		return 0.f;
+
+	// the highlight is drawn where the ray passes within blockSize of the brush
+	if (overlay) {
+		float along = 0.f;
+		for (int a = 0; a < 3; a++)
+			along += (overlay->blockLocation[a] - origin[a]) * dir[a];
+		along = std::min(std::max(along, 0.f), t);
+
+		float d2 = 0.f;
+		for (int a = 0; a < 3; a++)
+			d2 += (origin[a] + dir[a] * along - overlay->blockLocation[a]) * (origin[a] + dir[a] * along - overlay->blockLocation[a]);
+		if (std::sqrt(d2) < overlay->blockSize + 2.f)
+			return 0.f;
+	}
+
+	return t;
+}
+
+bool RayCache::accept(int px, int py, float start, const RayHit& hit) const {
+	// a ray starting in a solid voxel may have passed other ones before it
+	if (!hit.hit || hit.t <= start)
+		return false;
+
+	float nearest, furthest;
+	around(px, py, nearest, furthest);
+	return hit.t <= furthest + float(2 * margin);
+}
+
+void RayCache::store(int px, int py, const RayHit& hit) {
+	Hit& cached = hits[size_t(py) * width + px];
+	std::copy(hit.pos, hit.pos + 3, cached.pos);
+	cached.voxel = hit.hit ? hit.voxel : voxel::AIR;
+}
+
+
+template void RayCache::reproject(const VoxelGrid<uint8_t>&, const Camera&, ThreadPool&);
+template void RayCache::reproject(const VoxelGrid<uint16_t>&, const Camera&, ThreadPool&);
+template void RayCache::reproject(const VoxelGrid<uint32_t>&, const Camera&, ThreadPool&);
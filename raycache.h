@@ -0,0 +1,64 @@
+#pragma once
+
+#include "camera.h"
+#include "raycast.h"
+#include "threadpool.h"
+#include "voxelgrid.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Previous frame's ray hits per pixel, reprojected so this frame's rays start just before them
+// Every frame the last frame's hits whose voxel still holds the same material are projected into the new camera,
+// the nearest per pixel kept. A ray starts margin voxels before the nearest reprojected hit around its pixel and
+// is cast in full again when nothing was reprojected there, when the skipped part passes the brush highlight or
+// grid lines, or when the shortened ray starts in a solid voxel or hits past the hits around it. Skipped space
+// isn't checked, so a particle that moved in front of an unchanged surface is missed until the pixel's next full
+// cast, every refresh frames and staggered across the image. The same steps run in shaders/reproject.comp and
+// shaders/dda.comp.
+class RayCache
+{
+public:
+	static const int margin = 2;	// voxels a ray starts before the reprojected hits
+
+	RayCache(int width, int height);
+
+	// frames between full casts of each pixel, 0 casts every ray in full
+	void setRefresh(int frames);
+	int refresh() const { return refreshFrames; }
+
+	// forget the stored hits, after the grid moved under their coordinates
+	void clear();
+
+	// start a frame, scatters the hits stored during the last one into the camera's pixels
+	template<typename Cell>
+	void reproject(const VoxelGrid<Cell>& grid, const Camera& camera, ThreadPool& pool);
+
+	// distance along the pixel's ray to start at, 0 casts it in full
+	float start(int px, int py, const float origin[3], const float dir[3], const RayOverlay* overlay) const;
+
+	// whether a ray started at start found the surface the cache expected, otherwise it's cast again in full
+	bool accept(int px, int py, float start, const RayHit& hit) const;
+
+	void store(int px, int py, const RayHit& hit);
+
+
+private:
+	struct Hit {
+		int32_t pos[3];
+		uint32_t voxel;		// AIR for a miss
+	};
+
+	int width, height;
+	int refreshFrames = 0;
+	unsigned int frame = 0;
+
+	std::vector<Hit> hits;							// per pixel, the last frame's hit
+	std::unique_ptr<std::atomic<uint32_t>[]> depth;	// per pixel, bits of the nearest reprojected distance, ~0 for none
+
+	// nearest and furthest reprojected distance in the 3x3 pixels around, false if there is none
+	bool around(int px, int py, float& nearest, float& furthest) const;
+};
@@ -0,0 +1,175 @@
+#include "raycast.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+	const float tLineThresh = .01f;
+	const float lineFactor = .004f;
+
+	float minComponent(const float v[3]) {
+		return std::min(std::min(v[0], v[1]), v[2]);
+	}
+
+	float maxComponent(const float v[3]) {
+		return std::max(std::max(v[0], v[1]), v[2]);
+	}
+
+	// lessThanEqual(v.xyz, min(v.yzx, v.zxy)), more than one axis is set when crossings coincide
+	void minMask(const float v[3], bool mask[3]) {
+		mask[0] = v[0] <= std::min(v[1], v[2]);
+		mask[1] = v[1] <= std::min(v[2], v[0]);
+		mask[2] = v[2] <= std::min(v[0], v[1]);
+	}
+
+	float distance(const int pos[3], const float location[3]) {
+		float d2 = 0;
+		for (int a = 0; a < 3; a++)
+			d2 += (float(pos[a]) - location[a]) * (float(pos[a]) - location[a]);
+
+		return std::sqrt(d2);
+	}
+
+	// emptyLevel in dda.comp, cells touching the placement highlight are not skipped
+	int emptyLevel(const OccupancyPyramid& occupancy, const int pos[3], const RayOverlay* overlay) {
+		if (!overlay)
+			return occupancy.emptyLevel(pos[0], pos[1], pos[2]);
+
+		int level = -1;
+		for (int l = 0; l < occupancy.levels(); l++) {
+			const int shift = OccupancyPyramid::brickShift + l;
+			if (occupancy.occupied(l, pos[0] >> shift, pos[1] >> shift, pos[2] >> shift))
+				break;
+
+			int closest[3];
+			for (int a = 0; a < 3; a++) {
+				const int cellMin = (pos[a] >> shift) << shift;
+				closest[a] = std::min(std::max(int(overlay->blockLocation[a]), cellMin), cellMin + (1 << shift) - 1);
+			}
+			if (distance(closest, overlay->blockLocation) < overlay->blockSize)
+				break;
+
+			level = l;
+		}
+
+		return level;
+	}
+}
+
+
+template<typename Cell>
+RayHit castRay(const VoxelGrid<Cell>& grid, const float rayOrigin[3], const float dir[3], float maxDist,
+	const OccupancyPyramid* occupancy, const RayOverlay* overlay, float tStart) {
+	const float inf = std::numeric_limits<float>::infinity();
+	const float dimension = float(grid.dimension());
+
+	RayHit result;
+
+	float inverseDir[3], boundsMin[3], boundsMax[3];
+	for (int a = 0; a < 3; a++) {
+		inverseDir[a] = 1.f / dir[a];
+		const float bias = inverseDir[a] * rayOrigin[a];
+		boundsMin[a] = std::min(-bias, dimension * inverseDir[a] - bias);
+		boundsMax[a] = std::max(-bias, dimension * inverseDir[a] - bias);
+	}
+
+	const float tMin = std::max(tStart, maxComponent(boundsMin));
+	const float tMax = minComponent(boundsMax);
+
+	// ray misses bounding cube
+	if (tMin > tMax)
+		return result;
+
+	float origin[3], tDelta[3], sideDist[3];
+	int pos[3], step[3];
+	for (int a = 0; a < 3; a++) {
+		origin[a] = rayOrigin[a] + dir[a] * tMin;
+
+		// an entry point on the world's far faces can round to the cell past them
+		pos[a] = std::min(std::max(int(origin[a]), 0), int(grid.dimension()) - 1);
+
+		const float dirSign = float((dir[a] > 0) - (dir[a] < 0));
+		tDelta[a] = std::abs(inverseDir[a]);
+		step[a] = int(dirSign);
+		sideDist[a] = (dirSign * (float(pos[a]) - origin[a] + .5f) + .5f) * tDelta[a];
+	}
+
+	float t = 0;
+	const float tBound = tMax - tMin;
+	bool mask[3] = { false, false, false };
+
+	while (t < tBound && (tMin + t < maxDist)) {
+		result.steps++;
+
+		if (!grid.inBounds(pos[0], pos[1], pos[2]))
+			break;
+
+		if (overlay && distance(pos, overlay->blockLocation) < overlay->blockSize)
+			result.placeColor = .5f;
+
+		// jump to the exit of the largest empty cell, except where grid lines are drawn
+		const bool linesHere = overlay && overlay->drawLines && t < (overlay->blockDist + overlay->blockSize);
+		const int level = occupancy && !linesHere ? emptyLevel(*occupancy, pos, overlay) : -1;
+		if (level >= 0) {
+			const int shift = OccupancyPyramid::brickShift + level;
+
+			float tExit[3], cellMin[3], cellMax[3];
+			for (int a = 0; a < 3; a++) {
+				cellMin[a] = float((pos[a] >> shift) << shift);
+				cellMax[a] = cellMin[a] + float(1 << shift);
+				tExit[a] = dir[a] == 0 ? inf : ((dir[a] > 0 ? cellMax[a] : cellMin[a]) - origin[a]) * inverseDir[a];
+			}
+
+			t = minComponent(tExit);
+			minMask(tExit, mask);
+
+			for (int a = 0; a < 3; a++) {
+				if (mask[a])
+					pos[a] = int(dir[a] > 0 ? cellMax[a] : cellMin[a] - 1);
+				else
+					pos[a] = int(std::min(std::max(std::floor(origin[a] + dir[a] * t), cellMin[a]), cellMax[a] - 1));
+
+				sideDist[a] = dir[a] == 0 ? inf : (float(pos[a]) + float(dir[a] > 0) - origin[a]) * inverseDir[a];
+			}
+
+			continue;
+		}
+
+		const uint32_t voxel = voxel::type(grid.get(pos[0], pos[1], pos[2]));
+		if (voxel != voxel::AIR) {
+			result.hit = true;
+			result.voxel = voxel;
+			result.t = tMin + t;
+			std::copy(pos, pos + 3, result.pos);
+			std::copy(mask, mask + 3, result.mask);
+			return result;
+		}
+
+		// dda traversal
+		const float tPrev = t;
+		t = minComponent(sideDist);
+
+		// draw lines when change in t is very small
+		if (overlay && overlay->drawLines && t > tLineThresh && std::abs(tPrev - t) < (t * lineFactor) && t < (overlay->blockDist + overlay->blockSize)) {
+			const float thisLine = std::min(std::max(overlay->blockSize / overlay->blockDist, .05f), .6f);
+			result.lineColor = std::min(result.lineColor + thisLine, .8f);
+		}
+
+		minMask(sideDist, mask);
+		for (int a = 0; a < 3; a++) {
+			if (mask[a]) {
+				sideDist[a] += tDelta[a];
+				pos[a] += step[a];
+			}
+		}
+	}
+
+	return result;
+}
+
+
+template RayHit castRay(const VoxelGrid<uint8_t>&, const float[3], const float[3], float, const OccupancyPyramid*, const RayOverlay*, float);
+template RayHit castRay(const VoxelGrid<uint16_t>&, const float[3], const float[3], float, const OccupancyPyramid*, const RayOverlay*, float);
+template RayHit castRay(const VoxelGrid<uint32_t>&, const float[3], const float[3], float, const OccupancyPyramid*, const RayOverlay*, float);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "occupancy.h"
+#include "voxelgrid.h"
+
+#include <cstdint>
+
+
+struct RayHit
+{
+	bool hit = false;
+	int pos[3] = { 0, 0, 0 };
+	uint32_t voxel = voxel::AIR;
+	bool mask[3] = { false, false, false };	// axes crossed into the hit voxel, used for face shading
+	float t = 0.f;							// distance from the ray origin
+	unsigned int steps = 0;					// traversal iterations, voxels visited plus empty cells skipped
+
+	float placeColor = 0.f;					// block placement highlight and grid line intensity along the ray
+	float lineColor = 0.f;
+};
+
+
+// what dda.comp draws on top of the voxels, the placement highlight and the grid lines near it
+struct RayOverlay
+{
+	bool drawLines = false;
+	float blockDist = 50.f;
+	float blockSize = 4.f;
+	float blockLocation[3] = { 0.f, 0.f, 0.f };
+};
+
+
+// CPU port of castRay in shaders/dda.comp
+// With an occupancy pyramid the ray jumps over empty cells like the shader does, without one it walks every voxel.
+// An overlay accumulates the highlight and line intensities, and keeps the ray from skipping where they are drawn.
+// tStart begins the traversal further along the ray, see RayCache, the hit's t still counts from the origin.
+template<typename Cell>
+RayHit castRay(const VoxelGrid<Cell>& grid, const float origin[3], const float dir[3], float maxDist,
+	const OccupancyPyramid* occupancy = nullptr, const RayOverlay* overlay = nullptr, float tStart = 0.f);
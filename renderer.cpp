@@ -0,0 +1,129 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+	const float bgColor = .15f;
+
+	const float rockColor[3] = { .26f, .25f, .22f };
+	const float sandColor[3] = { .98f, .69f, .01f };
+	const float waterColor[3] = { .17f, .25f, .31f };
+
+	uint8_t toByte(float c) {
+		return uint8_t(std::min(std::max(c, 0.f), 1.f) * 255.f + .5f);
+	}
+
+	// color returned by castRay in dda.comp
+	void shade(const RayHit& hit, float color[3]) {
+		if (!hit.hit) {
+			std::fill(color, color + 3, bgColor + hit.lineColor + hit.placeColor);
+			return;
+		}
+
+		const float* material = hit.voxel == voxel::ROCK ? rockColor : hit.voxel == voxel::SAND ? sandColor : waterColor;
+		const float shadowIntensity = float(hit.mask[0]) * .5f + float(hit.mask[1]) * .8f + float(hit.mask[2]) * .6f;
+		const float overlay = std::min(hit.placeColor + hit.lineColor, .7f);
+
+		for (int c = 0; c < 3; c++)
+			color[c] = overlay + material[c] * shadowIntensity;
+	}
+}
+
+
+Renderer::Renderer(int width, int height, ThreadPool& pool) :
+	pool(pool),
+	cache(width, height) {
+	frame.resize(width, height);
+
+	// workgroup size for rendering
+	tilesX = width / rtWork + (width % rtWork != 0);
+	tilesY = height / rtWork + (height % rtWork != 0);
+}
+
+
+template<typename Cell>
+void Renderer::render(const VoxelGrid<Cell>& grid, const OccupancyPyramid* occupancy, const Camera& camera, const RayOverlay* overlay) {
+	frameSteps = 0;
+	frameCached = 0;
+	frameRetraced = 0;
+
+	if (cache.refresh() > 0)
+		cache.reproject(grid, camera, pool);
+
+	pool.stealingFor(size_t(tilesX) * tilesY, [&](size_t tile) {
+		renderTile(int(tile), grid, occupancy, camera, overlay);
+	});
+}
+
+
+template<typename Cell>
+void Renderer::renderTile(int tile, const VoxelGrid<Cell>& grid, const OccupancyPyramid* occupancy, const Camera& camera, const RayOverlay* overlay) {
+	const int tileX = (tile % tilesX) * rtWork;
+	const int tileY = (tile / tilesX) * rtWork;
+	const float width = float(frame.width), height = float(frame.height);
+
+	float right[3], up[3], forward[3];
+	camera.basis(right, up, forward);
+
+	// the tile's rays are set up as one packet in structure of arrays form so the compiler can vectorize it,
+	// traversal diverges per ray and stays scalar
+	const int packetSize = rtWork * rtWork;
+	float dirX[packetSize], dirY[packetSize], dirZ[packetSize];
+	for (int i = 0; i < packetSize; i++) {
+		const float sx = (float(tileX + i % rtWork) - .5f * width) / height;
+		const float sy = (float(tileY + i / rtWork) - .5f * height) / height;
+
+		const float x = right[0] * sx + up[0] * sy + forward[0];
+		const float y = right[1] * sx + up[1] * sy + forward[1];
+		const float z = right[2] * sx + up[2] * sy + forward[2];
+		const float inverseLength = 1.f / std::sqrt(x * x + y * y + z * z);
+
+		dirX[i] = x * inverseLength;
+		dirY[i] = y * inverseLength;
+		dirZ[i] = z * inverseLength;
+	}
+
+	unsigned long long steps = 0, cached = 0, retraced = 0;
+	for (int i = 0; i < packetSize; i++) {
+		const int px = tileX + i % rtWork;
+		const int py = tileY + i / rtWork;
+		if (px >= frame.width || py >= frame.height)
+			continue;
+
+		const float dir[3] = { dirX[i], dirY[i], dirZ[i] };
+		const float start = cache.refresh() > 0 ? cache.start(px, py, camera.position, dir, overlay) : 0.f;
+		RayHit hit = castRay(grid, camera.position, dir, maxDrawDist, occupancy, overlay, start);
+
+		if (start > 0.f) {
+			cached++;
+			if (!cache.accept(px, py, start, hit)) {
+				steps += hit.steps;
+				hit = castRay(grid, camera.position, dir, maxDrawDist, occupancy, overlay);
+				retraced++;
+			}
+		}
+		steps += hit.steps;
+
+		if (cache.refresh() > 0)
+			cache.store(px, py, hit);
+
+		float color[3];
+		shade(hit, color);
+
+		// screen y points up like the shader's image, rows are stored top to bottom
+		uint8_t* pixel = &frame.rgb[(size_t(frame.height - 1 - py) * frame.width + px) * 3];
+		for (int c = 0; c < 3; c++)
+			pixel[c] = toByte(color[c]);
+	}
+
+	frameSteps += steps;
+	frameCached += cached;
+	frameRetraced += retraced;
+}
+
+
+template void Renderer::render(const VoxelGrid<uint8_t>&, const OccupancyPyramid*, const Camera&, const RayOverlay*);
+template void Renderer::render(const VoxelGrid<uint16_t>&, const OccupancyPyramid*, const Camera&, const RayOverlay*);
+template void Renderer::render(const VoxelGrid<uint32_t>&, const OccupancyPyramid*, const Camera&, const RayOverlay*);
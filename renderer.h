@@ -0,0 +1,53 @@
+#pragma once
+
+#include "camera.h"
+#include "image.h"
+#include "occupancy.h"
+#include "raycache.h"
+#include "raycast.h"
+#include "threadpool.h"
+#include "voxelgrid.h"
+
+#include <atomic>
+
+
+// CPU port of shaders/dda.comp for offline and headless rendering
+// The frame is split into rtWork x rtWork tiles like the shader's work groups. Tiles are handed out with
+// ThreadPool::stealingFor since their cost varies with how much of the world they cover.
+// With a ray cache rays start just before the surfaces the last frame hit around their pixel, see RayCache.
+class Renderer
+{
+public:
+	Renderer(int width, int height, ThreadPool& pool);
+
+	template<typename Cell>
+	void render(const VoxelGrid<Cell>& grid, const OccupancyPyramid* occupancy, const Camera& camera, const RayOverlay* overlay = nullptr);
+
+	void setDrawDistance(float maxDrawDist) { this->maxDrawDist = maxDrawDist; }
+
+	// frames between full casts of each pixel, 0 casts every ray in full
+	void setRayCache(int refresh) { cache.setRefresh(refresh); }
+	void clearRayCache() { cache.clear(); }	// after a paged window moved
+
+	const Image& image() const { return frame; }
+	unsigned long long steps() const { return frameSteps; }	// traversal iterations of the last frame
+	unsigned long long cachedRays() const { return frameCached; }	// rays of the last frame started from the cache
+	unsigned long long retracedRays() const { return frameRetraced; }	// of those, rays cast again in full
+
+
+private:
+	static const int rtWork = 16;	// ray cast in groups of 16x16 pixels
+	int tilesX, tilesY;
+
+	float maxDrawDist = 300.f;
+
+	ThreadPool& pool;
+	Image frame;
+	RayCache cache;
+	std::atomic<unsigned long long> frameSteps{ 0 };
+	std::atomic<unsigned long long> frameCached{ 0 };
+	std::atomic<unsigned long long> frameRetraced{ 0 };
+
+	template<typename Cell>
+	void renderTile(int tile, const VoxelGrid<Cell>& grid, const OccupancyPyramid* occupancy, const Camera& camera, const RayOverlay* overlay);
+};
@@ -0,0 +1,104 @@
+#include "replay.h"
+
+#include <cstring>
+#include <iterator>
+
+
+namespace {
+	const char magic[4] = { 'V', 'P', 'R', 'L' };
+	const uint32_t version = 1;
+	const size_t headerSize = 12;
+	const size_t recordSize = 24;
+
+	void put32(uint8_t* out, uint32_t v) {
+		for (int b = 0; b < 4; b++)
+			out[b] = uint8_t(v >> (8 * b));
+	}
+
+	uint32_t get32(const uint8_t* in) {
+		uint32_t v = 0;
+		for (int b = 0; b < 4; b++)
+			v |= uint32_t(in[b]) << (8 * b);
+		return v;
+	}
+
+	// floats are stored bit for bit so replayed uniforms match the recorded ones exactly
+	uint32_t floatBits(float f) {
+		uint32_t v;
+		std::memcpy(&v, &f, sizeof(v));
+		return v;
+	}
+
+	float bitsFloat(uint32_t v) {
+		float f;
+		std::memcpy(&f, &v, sizeof(f));
+		return f;
+	}
+}
+
+
+bool ReplayRecorder::open(const std::string& path, unsigned int dimension) {
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	recorded = 0;
+
+	uint8_t header[headerSize];
+	std::memcpy(header, magic, 4);
+	put32(header + 4, version);
+	put32(header + 8, dimension);
+	file.write(reinterpret_cast<const char*>(header), headerSize);
+
+	return bool(file);
+}
+
+bool ReplayRecorder::record(const ReplayStep& step) {
+	uint8_t out[recordSize] = {};
+	out[0] = step.brush.placeBlock;
+	out[1] = uint8_t(step.brush.blockType);
+	put32(out + 4, floatBits(step.brush.blockSize));
+	for (int a = 0; a < 3; a++)
+		put32(out + 8 + 4 * a, uint32_t(step.brush.blockLocation[a]));
+	put32(out + 20, floatBits(step.rng));
+
+	file.write(reinterpret_cast<const char*>(out), recordSize);
+	recorded++;
+
+	return bool(file);
+}
+
+bool ReplayRecorder::close() {
+	file.close();
+	return !file.fail();
+}
+
+
+bool ReplayLog::load(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	const std::vector<uint8_t> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	if (data.size() < headerSize || std::memcmp(data.data(), magic, 4) != 0 || get32(&data[4]) != version)
+		return false;
+
+	logDimension = get32(&data[8]);
+
+	replaySteps.clear();
+	for (size_t offset = headerSize; offset + recordSize <= data.size(); offset += recordSize) {
+		const uint8_t* in = &data[offset];
+
+		ReplayStep step;
+		step.brush.placeBlock = in[0] != 0;
+		step.brush.blockType = in[1];
+		step.brush.blockSize = bitsFloat(get32(in + 4));
+		for (int a = 0; a < 3; a++)
+			step.brush.blockLocation[a] = int(get32(in + 8 + 4 * a));
+		step.rng = bitsFloat(get32(in + 20));
+
+		replaySteps.push_back(step);
+	}
+
+	return true;
+}
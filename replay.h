@@ -0,0 +1,57 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Simulation input log
+// One record per simulation iteration holding everything the physics pass reads besides the world itself,
+// the brush and the rng uniform, so a run can be repeated exactly by the app or the headless simulator.
+//
+// header	"VPRL", version, dimension (u32 each)
+// record	placeBlock (u8), blockType (u8), reserved (u16), blockSize (f32), blockLocation (3 x i32), rng (f32)
+//
+// Replays start from an empty world, or from the snapshot the recording started from.
+struct ReplayStep
+{
+	Brush brush;
+	float rng = 0.f;
+};
+
+
+class ReplayRecorder
+{
+public:
+	bool open(const std::string& path, unsigned int dimension);
+
+	// records are written as they come, a recording cut short is still readable up to its last whole record
+	bool record(const ReplayStep& step);
+	bool close();
+
+	bool isOpen() const { return file.is_open(); }
+	size_t count() const { return recorded; }
+
+
+private:
+	std::ofstream file;
+	size_t recorded = 0;
+};
+
+
+class ReplayLog
+{
+public:
+	bool load(const std::string& path);
+
+	unsigned int dimension() const { return logDimension; }
+	const std::vector<ReplayStep>& steps() const { return replaySteps; }
+
+
+private:
+	unsigned int logDimension = 0;
+	std::vector<ReplayStep> replaySteps;
+};
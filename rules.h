@@ -0,0 +1,100 @@
+#pragma once
+
+#include "voxel.h"
+
+#include <cstdint>
+
+
+// material behaviour and lateral visiting orders shared with shaders/particlesim.comp
+// A moving particle tries its material's moves in the order of Move's bits: straight down, then the lateral-down
+// cells, then the lateral ones, then trading places with a current particle of sinksInto below or risesInto above.
+// The lateral cells are visited in one of 36 precomputed orders picked by hashing the cell and the iteration's
+// random value, the same orders random4to4 and the (i * dir + offset) % 3 - 1 loops visited before. Adding a
+// material is a row in materials here and in the shader, the update loops don't change.
+namespace rules
+{
+	enum Move : uint8_t {
+		FALL = 1,		// straight down into air
+		SLIDE = 2,		// lateral-down into air
+		FLOW = 4,		// lateral into air
+	};
+
+	struct Material {
+		const char* name;
+		uint8_t moves;			// Move bits
+		uint32_t sinksInto;		// material below to swap with, AIR for none
+		uint32_t risesInto;		// material above to swap with, AIR for none
+	};
+
+	// indexed by type, sand sinks through water and water rises through sand, so either side of a pair can trade
+	const Material materials[] = {
+		{ "air", 0, voxel::AIR, voxel::AIR },
+		{ "rock", 0, voxel::AIR, voxel::AIR },
+		{ "sand", FALL | SLIDE, voxel::WATER, voxel::AIR },
+		{ "water", FALL | SLIDE | FLOW, voxel::AIR, voxel::SAND },
+	};
+	const uint32_t materialCount = sizeof(materials) / sizeof(materials[0]);
+
+	// types past the table behave like rock
+	inline uint32_t materialIndex(uint32_t type) {
+		return type < materialCount ? type : voxel::ROCK;
+	}
+
+	inline const Material& material(uint32_t type) {
+		return materials[materialIndex(type)];
+	}
+
+
+	// lateral offsets of one order, negative directions reach up to 3 voxels like the old modulo did
+	// an order ends at its 9th entry or at the first 0, 0 one
+	struct Order {
+		int8_t x[9];
+		int8_t z[9];
+	};
+
+	const int orderCount = 36;
+
+	// order for directions of -1 or 1 and offsets of 0 to 2 on each axis, the old loops' i over x and j over z
+	constexpr Order makeOrder(int dirX, int dirZ, int offsetX, int offsetZ) {
+		Order order = {};
+		int n = 0;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				const int x = (i * dirX + offsetX) % 3 - 1;
+				const int z = (j * dirZ + offsetZ) % 3 - 1;
+				if (x == 0 && z == 0) continue;
+				order.x[n] = int8_t(x);
+				order.z[n] = int8_t(z);
+				n++;
+			}
+		}
+		return order;
+	}
+
+	// index is ((dirX > 0) * 2 + (dirZ > 0)) * 9 + offsetX * 3 + offsetZ
+	struct OrderTable {
+		Order orders[orderCount];
+
+		constexpr OrderTable() : orders() {
+			for (int i = 0; i < orderCount; i++)
+				orders[i] = makeOrder(i / 18 ? 1 : -1, (i / 9) % 2 ? 1 : -1, (i / 3) % 3, i % 3);
+		}
+	};
+
+	constexpr OrderTable orderTable;
+
+
+	// mixes a cell with the iteration's random value, claimed moves take their priority from the low bits
+	inline uint32_t cellHash(int x, int y, int z, float iterationRNG) {
+		uint32_t h = uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u ^ uint32_t(iterationRNG * 16777216.f);
+		h ^= h >> 15;
+		h *= 0x2C1B3C6Du;
+		h ^= h >> 12;
+		return h;
+	}
+
+	// the high half picks the order, so it doesn't follow a claim's priority
+	inline const Order& lateralOrder(int x, int y, int z, float iterationRNG) {
+		return orderTable.orders[(cellHash(x, y, z, iterationRNG) >> 16) % orderCount];
+	}
+}
@@ -0,0 +1,116 @@
+#include "scenes.h"
+
+#include <algorithm>
+
+
+namespace {
+	const char* names[scene::Count] = { "sandpile", "waterfall", "dambreak", "rain" };
+
+	template<typename Cell>
+	void fillBox(VoxelGrid<Cell>& grid, const int min[3], const int max[3], uint32_t type) {
+		const int dim = int(grid.dimension());
+		for (int z = std::max(min[2], 0); z < std::min(max[2], dim); z++)
+			for (int y = std::max(min[1], 0); y < std::min(max[1], dim); y++)
+				for (int x = std::max(min[0], 0); x < std::min(max[0], dim); x++)
+					grid.set(x, y, z, type);
+	}
+
+	// integer hash for rain drop positions, the same on every platform unlike std distributions
+	uint32_t hash(uint32_t v) {
+		v ^= v >> 16;
+		v *= 0x7FEB352D;
+		v ^= v >> 15;
+		v *= 0x846CA68B;
+		v ^= v >> 16;
+		return v;
+	}
+}
+
+
+const char* scene::name(Kind kind) {
+	return names[kind];
+}
+
+bool scene::parse(const std::string& name, Kind& kind) {
+	for (int k = 0; k < Count; k++) {
+		if (name == names[k]) {
+			kind = Kind(k);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+template<typename Cell>
+void scene::build(Kind kind, VoxelGrid<Cell>& grid) {
+	const int dim = int(grid.dimension());
+	grid.clear();
+
+	switch (kind) {
+	case Waterfall: {
+		// ledge across the back half at mid height, water spills off its front edge
+		const int ledgeMin[3] = { 0, dim / 2 - 2, 0 };
+		const int ledgeMax[3] = { dim, dim / 2, dim / 2 };
+		fillBox(grid, ledgeMin, ledgeMax, voxel::ROCK);
+
+		const int poolMin[3] = { 0, dim / 2, 0 };
+		const int poolMax[3] = { dim, dim / 2 + dim / 16, dim / 4 };
+		fillBox(grid, poolMin, poolMax, voxel::WATER);
+		break;
+	}
+	case DamBreak: {
+		const int waterMin[3] = { 0, 0, 0 };
+		const int waterMax[3] = { dim / 4, dim / 2, dim };
+		fillBox(grid, waterMin, waterMax, voxel::WATER);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+Brush scene::brush(Kind kind, unsigned int dimension, int step) {
+	const int dim = int(dimension);
+
+	Brush brush;
+	switch (kind) {
+	case SandPile:
+		brush.placeBlock = true;
+		brush.blockType = voxel::SAND;
+		brush.blockSize = std::max(dim / 32.f, 2.f);
+		brush.blockLocation[0] = dim / 2;
+		brush.blockLocation[1] = dim * 3 / 4;
+		brush.blockLocation[2] = dim / 2;
+		break;
+	case Waterfall:
+		// keeps the pool on the ledge topped up
+		brush.placeBlock = true;
+		brush.blockType = voxel::WATER;
+		brush.blockSize = std::max(dim / 32.f, 2.f);
+		brush.blockLocation[0] = dim / 2;
+		brush.blockLocation[1] = dim / 2 + dim / 8;
+		brush.blockLocation[2] = dim / 8;
+		break;
+	case Rain: {
+		const uint32_t h = hash(uint32_t(step));
+		brush.placeBlock = true;
+		brush.blockType = h & 1 ? voxel::WATER : voxel::SAND;
+		brush.blockSize = 2.f;
+		brush.blockLocation[0] = int((h >> 1) % uint32_t(dim));
+		brush.blockLocation[1] = dim - 3;
+		brush.blockLocation[2] = int(hash(h) % uint32_t(dim));
+		break;
+	}
+	default:
+		break;
+	}
+
+	return brush;
+}
+
+
+template void scene::build(Kind, VoxelGrid<uint8_t>&);
+template void scene::build(Kind, VoxelGrid<uint16_t>&);
+template void scene::build(Kind, VoxelGrid<uint32_t>&);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "simulation.h"
+#include "voxelgrid.h"
+
+#include <string>
+
+
+// Repeatable benchmark workloads
+// Each scene fills a starting world and gives the brush for every step, so a run depends only on the scene,
+// the world dimension and the simulation seed.
+namespace scene
+{
+	enum Kind {
+		SandPile,	// sand poured onto the center of the floor
+		Waterfall,	// water running off a rock ledge into a basin, like the README screenshot
+		DamBreak,	// a column of water released at one side of the world
+		Rain,		// sand and water drops scattered over the whole top of the world
+		Count
+	};
+
+	const char* name(Kind kind);
+	bool parse(const std::string& name, Kind& kind);
+
+	template<typename Cell>
+	void build(Kind kind, VoxelGrid<Cell>& grid);
+
+	Brush brush(Kind kind, unsigned int dimension, int step);
+}
@@ -0,0 +1,836 @@
+#include "simulation.h"
+
+#include "rules.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+using namespace voxel;
+
+
+namespace {
+	// claims are epoch << 26 | priority << 10 | move, compared as integers so the newest epoch and then the
+	// highest priority win, falls get the top priority bit over sideways moves
+	const uint32_t epochShift = 26;
+	const uint32_t maxEpoch = 63;
+	const uint32_t priorityShift = 10;
+	const uint32_t fallPriority = 0x8000;
+	const uint32_t moveMask = 0x3FF;
+
+	// move is -dy in bits 0-3, dx + 3 in 4-6 and dz + 3 in 7-9, dx fields past 4 are the two non moves
+	const uint32_t stay = 7 << 4;
+	const uint32_t sinkInWater = 6 << 4;
+
+	uint32_t encodeMove(int dx, int dy, int dz) {
+		return uint32_t(-dy) | uint32_t(dx + 3) << 4 | uint32_t(dz + 3) << 7;
+	}
+
+	void decodeMove(uint32_t move, int& dx, int& dy, int& dz) {
+		dy = -int(move & 15);
+		dx = int((move >> 4) & 7) - 3;
+		dz = int((move >> 7) & 7) - 3;
+	}
+
+	uint32_t claimPriority(int x, int y, int z, float iterationRNG) {
+		return rules::cellHash(x, y, z, iterationRNG) & 0x7FFF;
+	}
+
+
+	int lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return int(index);
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+}
+
+
+template<typename Cell, typename Layout>
+Simulation<Cell, Layout>::Simulation(unsigned int dimension, unsigned int threadCount) :
+	voxels(dimension),
+	pool(threadCount) {
+	partitionProperties.workGroups = (int(dimension) - 1) / partitionProperties.simSpacing + 1; // int division with ceiling rounding
+	partitionProperties.firstRow = 0;
+	partitionProperties.lastRow = partitionProperties.workGroups;
+}
+
+template<typename Cell, typename Layout>
+Simulation<Cell, Layout>::Simulation(unsigned int dimension, int zBegin, int zEnd, unsigned int threadCount) :
+	voxels(dimension, unsigned(std::min(zEnd + reach, int(dimension)) - std::max(zBegin - reach, 0))),
+	pool(threadCount),
+	zOrigin(std::max(zBegin - reach, 0)) {
+	const int spacing = partitionProperties.simSpacing;
+	partitionProperties.workGroups = (int(dimension) - 1) / spacing + 1;
+	partitionProperties.firstRow = zBegin / spacing;
+	partitionProperties.lastRow = (zEnd - 1) / spacing + 1;
+
+	// halo exchanges write the grid between passes, behind the planes' back
+	kernel = Kernel::Scalar;
+}
+
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::trackOccupancy(OccupancyPyramid* occupancy) {
+	this->occupancy = occupancy;
+	if (occupancy)
+		occupancy->rebuild(voxels);
+}
+
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::setMoves(Moves moves) {
+	this->moves = moves;
+
+	if (moves == Moves::Claimed && !claimBlocks) {
+		claimBlocks.reset(new std::atomic<ClaimBlock*>[brickCount()]());
+		epoch = 0;
+	}
+
+	// claimed moves step every brick, switching starts them all awake
+	wake();
+}
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::setSleep(int idleIterations) {
+	sleepIterations = std::max(idleIterations, 0);
+
+	if (sleepIterations == 0) {
+		if (!tracking)
+			changed.reset();
+		lastRun.clear();
+		awake.clear();
+		for (std::vector<int>& list : activeList)
+			list.clear();
+		return;
+	}
+
+	if (!changed)
+		changed.reset(new std::atomic<uint32_t>[brickCount()]());
+	if (lastRun.empty()) {
+		lastRun.assign(brickCount(), 0);
+		awake.assign(brickCount(), 0);
+	}
+
+	wake();
+}
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::trackChanges() {
+	tracking = true;
+	if (!changed)
+		changed.reset(new std::atomic<uint32_t>[brickCount()]());
+
+	wake();
+}
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::setKernel(Kernel kernel) {
+	this->kernel = kernel;
+	planesCurrent = false;
+}
+
+// every brick counts as changed this iteration, the grid's flags are taken as they are
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::wake() {
+	planesCurrent = false;
+
+	if (!changed)
+		return;
+
+	for (size_t b = 0; b < brickCount(); b++)
+		changed[b].store(iteration, std::memory_order_relaxed);
+	std::fill(lastRun.begin(), lastRun.end(), iteration);
+}
+
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::step(int n) {
+	for (int it = 0; it < n; it++) {
+		iterationRNG = float(rng()) / float(rng.max());
+		iterate();
+	}
+
+	if (occupancy)
+		occupancy->reduce();
+}
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::stepWith(float rngValue) {
+	iterationRNG = rngValue;
+	iterate();
+
+	if (occupancy)
+		occupancy->reduce();
+}
+
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::iterate() {
+	currentFlag = (!currentFlag) * FLAG;
+	iteration++;
+
+	const bool packed = kernel == Kernel::Packed;
+	if (packed && !planesCurrent)
+		rebuildPlanes();
+	planesCurrent = packed;
+
+	// bricks are scheduled before the brush fills them, waking ones would otherwise lose its particles' flags
+	if (sleepIterations > 0 && moves == Moves::Partitioned)
+		scheduleBricks();
+	else
+		lastActive = brickCount();
+
+	placeBrush();
+
+	if (moves == Moves::Claimed) {
+		switch (voxels.dimension()) {
+		case 64:	runClaimed<64>(); break;
+		case 128:	runClaimed<128>(); break;
+		case 256:	runClaimed<256>(); break;
+		case 512:	runClaimed<512>(); break;
+		case 1024:	runClaimed<1024>(); break;
+		default:	runClaimed<0>(); break;
+		}
+		return;
+	}
+
+	switch (voxels.dimension()) {
+	case 64:	runPasses<64>(); break;
+	case 128:	runPasses<128>(); break;
+	case 256:	runPasses<256>(); break;
+	case 512:	runPasses<512>(); break;
+	case 1024:	runPasses<1024>(); break;
+	default:	runPasses<0>(); break;
+	}
+}
+
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+void Simulation<Cell, Layout>::runPasses() {
+	const int workGroups = partitionProperties.workGroups;
+	const int firstRow = partitionProperties.firstRow;
+	const size_t bricks = size_t(workGroups) * workGroups * (partitionProperties.lastRow - firstRow);
+
+	for (int p = 0; p < 8; p++) {
+		const int part[3] = { p % 2, (p / 2) % 2, (p / 4) % 2 };
+
+		if (sleepIterations > 0) {
+			// brick coordinates are twice the work group's plus the pass offset
+			const int n = 2 * workGroups;
+			const std::vector<int>& list = activeList[p];
+			pool.parallelFor(list.size(), [&](size_t i) {
+				const int brick = list[i];
+				updateBrick<Dim>(brick % n / 2, brick / n % n / 2, brick / (n * n) / 2, part);
+			});
+		}
+		else {
+			pool.parallelFor(bricks, [&](size_t i) {
+				updateBrick<Dim>(int(i % workGroups), int((i / workGroups) % workGroups), firstRow + int(i / (size_t(workGroups) * workGroups)), part);
+			});
+		}
+
+		if (passDone)
+			passDone(part[2]);
+	}
+}
+
+// pick the bricks to step this iteration, a brick is scheduled while its neighbourhood changed recently or the
+// brush's box, grown by a brick for the particles it can reach, overlaps it
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::scheduleBricks() {
+	const int n = 2 * partitionProperties.workGroups;
+	const int localDim = partitionProperties.simLocalDim;
+	const int dim = int(voxels.dimension());
+
+	int lo[3] = { 0, 0, 0 }, hi[3] = { -1, -1, -1 };
+	if (brush.placeBlock) {
+		for (int a = 0; a < 3; a++) {
+			lo[a] = int(std::floor((brush.blockLocation[a] - brush.blockSize) / localDim)) - 1;
+			hi[a] = int(std::floor((brush.blockLocation[a] + brush.blockSize) / localDim)) + 1;
+		}
+	}
+
+	pool.parallelFor(size_t(n), [&](size_t i) {
+		const int bz = int(i);
+		for (int by = 0; by < n; by++) {
+			for (int bx = 0; bx < n; bx++) {
+				const size_t brick = (size_t(bz) * n + by) * n + bx;
+
+				bool active = bx >= lo[0] && bx <= hi[0] && by >= lo[1] && by <= hi[1] && bz >= lo[2] && bz <= hi[2];
+				for (int z = std::max(bz - 1, 0); z <= std::min(bz + 1, n - 1) && !active; z++)
+					for (int y = std::max(by - 1, 0); y <= std::min(by + 1, n - 1) && !active; y++)
+						for (int x = std::max(bx - 1, 0); x <= std::min(bx + 1, n - 1) && !active; x++)
+							active = iteration - changed[(size_t(z) * n + y) * n + x].load(std::memory_order_relaxed) <= uint32_t(sleepIterations);
+
+				awake[brick] = active;
+				if (!active)
+					continue;
+
+				// a brick that slept kept the flags of the iteration it last ran, every particle in it moves this one
+				if (lastRun[brick] != iteration - 1) {
+					for (int z = bz * localDim; z < std::min((bz + 1) * localDim, dim); z++) {
+						for (int y = by * localDim; y < std::min((by + 1) * localDim, dim); y++) {
+							for (int x = bx * localDim; x < std::min((bx + 1) * localDim, dim); x++) {
+								const uint32_t voxel = get<0>(x, y, z);
+								if (voxel != AIR)
+									set<0>(x, y, z, (voxel & ~FLAG) | (currentFlag ^ FLAG));
+							}
+						}
+					}
+				}
+				lastRun[brick] = iteration;
+			}
+		}
+	});
+
+	lastActive = 0;
+	for (std::vector<int>& list : activeList)
+		list.clear();
+
+	for (size_t brick = 0; brick < brickCount(); brick++) {
+		if (awake[brick]) {
+			const int bx = int(brick % n), by = int(brick / n % n), bz = int(brick / (size_t(n) * n));
+			activeList[(bx & 1) + 2 * (by & 1) + 4 * (bz & 1)].push_back(int(brick));
+			lastActive++;
+		}
+	}
+}
+
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::rebuildPlanes() {
+	const int n = 2 * partitionProperties.workGroups;
+	const int localDim = partitionProperties.simLocalDim;
+	const int dim = int(voxels.dimension());
+
+	if (!planes)
+		planes.reset(new std::atomic<uint64_t>[brickCount() * 8]);
+
+	pool.parallelFor(size_t(n), [&](size_t i) {
+		const int bz = int(i);
+		for (int by = 0; by < n; by++) {
+			for (int bx = 0; bx < n; bx++) {
+				const size_t brick = (size_t(bz) * n + by) * n + bx;
+				for (int layer = 0; layer < 8; layer++) {
+					const int z = bz * localDim + layer;
+					uint64_t bits = 0;
+					for (int y = by * localDim; y < std::min((by + 1) * localDim, dim) && z < dim; y++)
+						for (int x = bx * localDim; x < std::min((bx + 1) * localDim, dim); x++)
+							bits |= uint64_t(get<0>(x, y, z) != AIR) << ((y & 7) * 8 + (x & 7));
+
+					planes[brick * 8 + layer].store(bits, std::memory_order_relaxed);
+				}
+			}
+		}
+	});
+}
+
+
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+void Simulation<Cell, Layout>::updateBrick(int bx, int by, int bz, const int part[3]) {
+	const int localDim = partitionProperties.simLocalDim;
+	const int spacing = partitionProperties.simSpacing;
+	const int dim = Dim ? int(Dim) : int(voxels.dimension());
+
+	const int x0 = bx * spacing + part[0] * localDim;
+	const int y0 = by * spacing + part[1] * localDim;
+	const int z0 = bz * spacing + part[2] * localDim;
+
+	const int x1 = std::min(x0 + localDim, dim);
+	const int y1 = std::min(y0 + localDim, dim);
+	const int z1 = std::min(z0 + localDim, dim);
+
+	if (planesCurrent) {
+		// a layer's word is read once, cells it misses were filled by particles that already moved this iteration
+		// and bits of cells emptied since read as air, both of which updateVoxel skips anyway
+		const size_t base = brickOf(x0, y0, z0) * 8;
+		for (int z = z0; z < z1; z++) {
+			for (uint64_t bits = planes[base + size_t(z & 7)].load(std::memory_order_relaxed); bits; bits &= bits - 1) {
+				const int bit = lowestBit(bits);
+				updateVoxel<Dim>(x0 + (bit & 7), y0 + (bit >> 3), z);
+			}
+		}
+	}
+	else {
+		for (int z = z0; z < z1; z++)
+			for (int y = y0; y < y1; y++)
+				for (int x = x0; x < x1; x++)
+					updateVoxel<Dim>(x, y, z);
+	}
+
+	// a brick is exactly one cube, particles that left it into the gap were marked by swapIfAvailable
+	if (occupancy && x0 < dim && y0 < dim && z0 < dim) {
+		bool occupied = false;
+		if (planesCurrent) {
+			const size_t base = brickOf(x0, y0, z0) * 8;
+			for (int layer = 0; layer < 8 && !occupied; layer++)
+				occupied = planes[base + layer].load(std::memory_order_relaxed) != 0;
+		}
+		else {
+			for (int z = z0; z < z1 && !occupied; z++)
+				for (int y = y0; y < y1 && !occupied; y++)
+					for (int x = x0; x < x1 && !occupied; x++)
+						occupied = get<Dim>(x, y, z) != AIR;
+		}
+
+		occupancy->setBrick(x0 >> OccupancyPyramid::brickShift, y0 >> OccupancyPyramid::brickShift, z0 >> OccupancyPyramid::brickShift, occupied);
+	}
+}
+
+// body of main() in particlesim.comp
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+void Simulation<Cell, Layout>::updateVoxel(int x, int y, int z) {
+	uint32_t voxel = get<Dim>(x, y, z);
+
+	// if it's air, return quickly to optimize large empty space, placeBrush filled and erased the brush beforehand
+	if (voxel == AIR)
+		return;
+
+	// return if the current particle has already been updated
+	if ((voxel & FLAG) == currentFlag)
+		return;
+
+	voxel ^= FLAG;	// toggle flag bit
+
+
+	// apply the material's rules
+	uint32_t newVoxel = voxel;
+	const rules::Material& material = rules::material(voxel & TYPE);
+	if (material.moves) newVoxel = moveParticle<Dim>(voxel, material, x, y, z);
+
+	// if the particle hasn't changed store with new flag
+	if (newVoxel == voxel)
+		set<Dim>(x, y, z, newVoxel);
+}
+
+
+template<typename Cell, typename Layout>
+bool Simulation<Cell, Layout>::inBrush(int x, int y, int z) const {
+	const float dx = float(x) - float(brush.blockLocation[0]);
+	const float dy = float(y) - float(brush.blockLocation[1]);
+	const float dz = float(z) - float(brush.blockLocation[2]);
+
+	return std::sqrt(dx * dx + dy * dy + dz * dz) < brush.blockSize;
+}
+
+
+// cells outside the world count as occupied, the shader instead loses particles pushed past the edge
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+uint32_t Simulation<Cell, Layout>::swapIfAvailable(int x, int y, int z, int nx, int ny, int nz, uint32_t voxel) {
+	if (inWorld<Dim>(nx, ny, nz) && get<Dim>(nx, ny, nz) == AIR) {
+		set<Dim>(nx, ny, nz, voxel);
+		set<Dim>(x, y, z, voxel = AIR);
+
+		if (occupancy)
+			occupancy->markVoxel(nx, ny, nz);
+		if (planesCurrent) {
+			markPlane(nx, ny, nz, true);
+			markPlane(x, y, z, false);
+		}
+		if (changed) {
+			touch(x, y, z);
+			touch(nx, ny, nz);
+		}
+	}
+
+	return voxel;
+}
+
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+uint32_t Simulation<Cell, Layout>::swapIfBlock(int x, int y, int z, int nx, int ny, int nz, uint32_t voxel, uint32_t nVoxel) {
+	if (inWorld<Dim>(nx, ny, nz) && get<Dim>(nx, ny, nz) == nVoxel) {
+		set<Dim>(nx, ny, nz, voxel);
+		set<Dim>(x, y, z, voxel = nVoxel);
+
+		if (changed) {
+			touch(x, y, z);
+			touch(nx, ny, nz);
+		}
+	}
+
+	return voxel;
+}
+
+
+// Move() in particlesim.comp, driven by the material's row in rules.h
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+uint32_t Simulation<Cell, Layout>::moveParticle(uint32_t voxel, const rules::Material& material, int x, int y, int z) {
+	// straight down
+	if (y > 0 && (material.moves & rules::FALL)) {
+		voxel = swapIfAvailable<Dim>(x, y, z, x, y - 1, z, voxel);
+		if (voxel == AIR) return voxel;
+	}
+
+	const rules::Order& order = rules::lateralOrder(x, y, z, iterationRNG);
+
+	// lateral-down
+	if (y > 0 && (material.moves & rules::SLIDE)) {
+		for (int i = 0; i < 9 && (order.x[i] | order.z[i]); i++) {
+			voxel = swapIfAvailable<Dim>(x, y, z, x + order.x[i], y - 1, z + order.z[i], voxel);
+			if (voxel == AIR) return voxel;
+		}
+	}
+
+	// lateral
+	if (material.moves & rules::FLOW) {
+		for (int i = 0; i < 9 && (order.x[i] | order.z[i]); i++) {
+			voxel = swapIfAvailable<Dim>(x, y, z, x + order.x[i], y, z + order.z[i], voxel);
+			if (voxel == AIR) return voxel;
+		}
+	}
+
+	// if an updated lighter particle is below or a heavier one above
+	if (y > 0 && material.sinksInto != AIR)
+		voxel = swapIfBlock<Dim>(x, y, z, x, y - 1, z, voxel, (currentFlag | material.sinksInto));
+	if (material.risesInto != AIR)
+		voxel = swapIfBlock<Dim>(x, y, z, x, y + 1, z, voxel, (currentFlag | material.risesInto));
+
+	return voxel;
+}
+
+
+// the cells of a brick holding anything but air, the packed kernel's planes skip empty layers and rows
+template<typename Cell, typename Layout>
+template<unsigned int Dim, typename Visit>
+void Simulation<Cell, Layout>::forParticles(int bx, int by, int bz, Visit&& visit) {
+	const int localDim = partitionProperties.simLocalDim;
+	const int dim = Dim ? int(Dim) : int(voxels.dimension());
+	const int x0 = bx * localDim, y0 = by * localDim, z0 = bz * localDim;
+	const int x1 = std::min(x0 + localDim, dim), y1 = std::min(y0 + localDim, dim), z1 = std::min(z0 + localDim, dim);
+
+	if (planesCurrent) {
+		const size_t base = brickOf(x0, y0, z0) * 8;
+		for (int z = z0; z < z1; z++) {
+			for (uint64_t bits = planes[base + size_t(z & 7)].load(std::memory_order_relaxed); bits; bits &= bits - 1) {
+				const int bit = lowestBit(bits);
+				const int x = x0 + (bit & 7), y = y0 + (bit >> 3);
+				visit(x, y, z, get<Dim>(x, y, z));
+			}
+		}
+		return;
+	}
+
+	for (int z = z0; z < z1; z++) {
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				const uint32_t voxel = get<Dim>(x, y, z);
+				if (voxel != AIR)
+					visit(x, y, z, voxel);
+			}
+		}
+	}
+}
+
+// the claim state of a brick, handed out on its first mover or claim, blocks of bricks that had neither in an
+// iteration go back to the spares after it
+template<typename Cell, typename Layout>
+typename Simulation<Cell, Layout>::ClaimBlock& Simulation<Cell, Layout>::claimBlock(size_t brick) {
+	ClaimBlock* block = claimBlocks[brick].load(std::memory_order_acquire);
+	if (block)
+		return *block;
+
+	std::lock_guard<std::mutex> guard(blockLock);
+	block = claimBlocks[brick].load(std::memory_order_relaxed);
+	if (block)
+		return *block;
+
+	if (spareBlocks.empty()) {
+		blockStore.emplace_back(new ClaimBlock());
+		block = blockStore.back().get();
+	}
+	else {
+		block = spareBlocks.back();
+		spareBlocks.pop_back();
+		for (std::atomic<uint32_t>& claim : block->claims)
+			claim.store(0, std::memory_order_relaxed);
+		std::fill(std::begin(block->movers), std::end(block->movers), uint64_t(0));
+	}
+	block->used.store(epoch, std::memory_order_relaxed);
+
+	claimedBricks.push_back(int(brick));
+	claimBlocks[brick].store(block, std::memory_order_release);
+	return *block;
+}
+
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::releaseBlocks() {
+	size_t kept = 0;
+	for (int brick : claimedBricks) {
+		ClaimBlock* block = claimBlocks[brick].load(std::memory_order_relaxed);
+		if (block->used.load(std::memory_order_relaxed) == epoch) {
+			claimedBricks[kept++] = brick;
+			continue;
+		}
+
+		claimBlocks[brick].store(nullptr, std::memory_order_relaxed);
+		spareBlocks.push_back(block);
+	}
+	claimedBricks.resize(kept);
+}
+
+// the claim phase visits the same 8^3 bricks as the passes, but all of them at once, the commit phase only the
+// movers the claims recorded
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+void Simulation<Cell, Layout>::runClaimed() {
+	const int dim = Dim ? int(Dim) : int(voxels.dimension());
+	const int localDim = partitionProperties.simLocalDim;
+	const int n = 2 * partitionProperties.workGroups;
+
+	// claims left from the last wrap of the epoch could outrank new ones, spare blocks are cleared when reused
+	if (++epoch > maxEpoch) {
+		epoch = 1;
+		for (int brick : claimedBricks)
+			for (std::atomic<uint32_t>& claim : claimBlocks[brick].load(std::memory_order_relaxed)->claims)
+				claim.store(0, std::memory_order_relaxed);
+	}
+
+	// claim phase, the grid is only read so every particle sees where the others start
+	pool.parallelFor(brickCount(), [&](size_t brick) {
+		const int bx = int(brick % n), by = int(brick / n % n), bz = int(brick / (size_t(n) * n));
+		if (bx * localDim >= dim || by * localDim >= dim || bz * localDim >= dim)
+			return;
+
+		ClaimBlock* block = nullptr;
+		uint64_t movers[8] = {};
+		bool occupied = false;
+		forParticles<Dim>(bx, by, bz, [&](int x, int y, int z, uint32_t voxel) {
+			occupied = true;
+			if (!rules::material(voxel & TYPE).moves)
+				return;
+
+			if (!block)
+				block = &claimBlock(brick);
+			block->intents[blockCell(x, y, z)] = claim<Dim>(x, y, z, voxel);
+			movers[z & 7] |= uint64_t(1) << ((y & 7) * 8 + (x & 7));
+		});
+
+		// only this brick writes its movers, other bricks only claim its cells
+		if (block) {
+			std::copy(std::begin(movers), std::end(movers), block->movers);
+			block->used.store(epoch, std::memory_order_relaxed);
+		}
+		else if ((block = claimBlocks[brick].load(std::memory_order_acquire)))
+			std::fill(std::begin(block->movers), std::end(block->movers), uint64_t(0));
+
+		// bricks particles move into are marked on commit
+		if (occupancy)
+			occupancy->setBrick(bx, by, bz, occupied);
+	});
+
+	// commit phase, each particle touches only its own cell and the cell it won
+	pool.parallelFor(claimedBricks.size(), [&](size_t i) {
+		const int brick = claimedBricks[i];
+		const ClaimBlock& block = *claimBlocks[brick].load(std::memory_order_relaxed);
+		const int x0 = brick % n * localDim, y0 = brick / n % n * localDim, z0 = int(brick / (size_t(n) * n)) * localDim;
+
+		for (int layer = 0; layer < 8; layer++) {
+			for (uint64_t bits = block.movers[layer]; bits; bits &= bits - 1) {
+				const int bit = lowestBit(bits);
+				commit<Dim>(x0 + (bit & 7), y0 + (bit >> 3), z0 + layer, block.intents[(size_t(layer) * 8 + size_t(bit >> 3)) * 8 + size_t(bit & 7)]);
+			}
+		}
+	});
+
+	releaseBlocks();
+}
+
+// the material rules as destinations: fall along the velocity, else lateral-down, else sideways
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+uint32_t Simulation<Cell, Layout>::claim(int x, int y, int z, uint32_t voxel) {
+	const rules::Material& material = rules::material(voxel & TYPE);
+	const uint32_t key = epoch << epochShift | claimPriority(x, y, z, iterationRNG) << priorityShift;
+
+	// straight down through every cell that starts the iteration empty, one voxel further each iteration
+	const int speed = std::min(1 - velocityY(voxel), 8);
+	int fall = 0;
+	while (fall < speed && isAir<Dim>(x, y - fall - 1, z))
+		fall++;
+
+	uint32_t move = stay;
+	if (fall > 0 && (material.moves & rules::FALL))
+		move = encodeMove(0, -fall, 0);
+
+	const rules::Order& order = rules::lateralOrder(x, y, z, iterationRNG);
+
+	if (material.moves & rules::SLIDE) {
+		for (int i = 0; i < 9 && (order.x[i] | order.z[i]) && move == stay; i++) {
+			if (isAir<Dim>(x + order.x[i], y - 1, z + order.z[i]))
+				move = encodeMove(order.x[i], -1, order.z[i]);
+		}
+	}
+
+	if ((material.moves & rules::FLOW) && move == stay) {
+		// keep flowing the way it last moved
+		const int vx = velocityX(voxel), vz = velocityZ(voxel);
+		if ((vx != 0 || vz != 0) && isAir<Dim>(x + vx, y, z + vz))
+			move = encodeMove(vx, 0, vz);
+
+		for (int i = 0; i < 9 && (order.x[i] | order.z[i]) && move == stay; i++) {
+			if (isAir<Dim>(x + order.x[i], y, z + order.z[i]))
+				move = encodeMove(order.x[i], 0, order.z[i]);
+		}
+	}
+
+	// sinking claims the lighter particle's cell below, which swaps only if that particle stays put and rises into
+	// this one's material, the swap moves just what its commit sees above
+	if (material.sinksInto != AIR && move == stay && inWorld<Dim>(x, y - 1, z) && (get<Dim>(x, y - 1, z) & TYPE) == material.sinksInto
+		&& rules::material(material.sinksInto).risesInto == (voxel & TYPE))
+		move = sinkInWater;
+
+	if (move == stay)
+		return key | move;
+
+	int dx = 0, dy = -1, dz = 0;
+	if (move != sinkInWater)
+		decodeMove(move, dx, dy, dz);
+
+	const uint32_t intent = key | (dx == 0 && dz == 0 ? fallPriority << priorityShift : 0) | move;
+
+	ClaimBlock& block = claimBlock(brickOf(x + dx, y + dy, z + dz));
+	if (block.used.load(std::memory_order_relaxed) != epoch)
+		block.used.store(epoch, std::memory_order_relaxed);
+
+	std::atomic<uint32_t>& slot = block.claims[blockCell(x + dx, y + dy, z + dz)];
+	uint32_t current = slot.load(std::memory_order_relaxed);
+	while (current < intent && !slot.compare_exchange_weak(current, intent, std::memory_order_relaxed));
+
+	return intent;
+}
+
+template<typename Cell, typename Layout>
+template<unsigned int Dim>
+void Simulation<Cell, Layout>::commit(int x, int y, int z, uint32_t intent) {
+	// the sinking particle's cell is written by the one below it
+	const uint32_t move = intent & moveMask;
+	if (move == sinkInWater)
+		return;
+
+	const uint32_t voxel = get<Dim>(x, y, z);
+	const uint32_t type = voxel & TYPE;
+	const rules::Material& material = rules::material(type);
+
+	if (move != stay) {
+		int dx, dy, dz;
+		decodeMove(move, dx, dy, dz);
+
+		if (claimBlocks[brickOf(x + dx, y + dy, z + dz)].load(std::memory_order_relaxed)->claims[blockCell(x + dx, y + dy, z + dz)].load(std::memory_order_relaxed) == intent) {
+			// falling keeps the distance fallen as speed, flowing water remembers its direction
+			const bool flowing = (material.moves & rules::FLOW) && dy == 0;
+			set<Dim>(x + dx, y + dy, z + dz, pack(type, currentFlag, flowing ? std::max(dx, -2) : 0, dy, flowing ? std::max(dz, -2) : 0));
+			set<Dim>(x, y, z, AIR);
+
+			if (occupancy)
+				occupancy->markVoxel(x + dx, y + dy, z + dz);
+			if (planesCurrent) {
+				markPlane(x + dx, y + dy, z + dz, true);
+				markPlane(x, y, z, false);
+			}
+			if (changed) {
+				touch(x, y, z);
+				touch(x + dx, y + dy, z + dz);
+			}
+			return;
+		}
+	}
+
+	// a particle that stayed swaps with a heavier one that claimed its cell from above
+	const uint32_t sinking = claimBlocks[brickOf(x, y, z)].load(std::memory_order_relaxed)->claims[blockCell(x, y, z)].load(std::memory_order_relaxed);
+	if (material.risesInto != AIR && sinking >> epochShift == epoch) {
+		const uint32_t sunk = get<Dim>(x, y + 1, z) & TYPE;
+		set<Dim>(x, y + 1, z, pack(type, currentFlag));
+		set<Dim>(x, y, z, pack(sunk, currentFlag));
+		if (changed) {
+			touch(x, y, z);
+			touch(x, y + 1, z);
+		}
+		return;
+	}
+
+	// blocked particles lose their speed
+	set<Dim>(x, y, z, pack(type, currentFlag));
+}
+
+// port of shaders/place.comp, only the brush's bounding box is visited, once per iteration ahead of the moves
+// placed particles carry this iteration's flag, so the passes leave them in place until the next iteration
+// a slab fills its halo layers too, every process places the same cells so they stay in agreement
+template<typename Cell, typename Layout>
+void Simulation<Cell, Layout>::placeBrush() {
+	if (!brush.placeBlock)
+		return;
+
+	const int dim = int(voxels.dimension());
+	int lo[3], hi[3];
+	for (int a = 0; a < 3; a++) {
+		lo[a] = std::max(int(std::floor(brush.blockLocation[a] - brush.blockSize)), 0);
+		hi[a] = std::min(int(std::ceil(brush.blockLocation[a] + brush.blockSize)) + 1, dim);
+	}
+	lo[2] = std::max(lo[2], zOrigin);
+	hi[2] = std::min(hi[2], zOrigin + int(voxels.depth()));
+	if (lo[0] >= hi[0] || lo[1] >= hi[1] || lo[2] >= hi[2])
+		return;
+
+	// per material cells filled, air included, erasing subtracts from the material of each cell cleared
+	std::atomic<int64_t> filled[rules::materialCount] = {};
+
+	pool.parallelFor(size_t(hi[2] - lo[2]), [&](size_t i) {
+		const int z = lo[2] + int(i);
+		int64_t layer[rules::materialCount] = {};
+		for (int y = lo[1]; y < hi[1]; y++) {
+			for (int x = lo[0]; x < hi[0]; x++) {
+				if (!inBrush(x, y, z))
+					continue;
+
+				// erasing clears anything but air, placing only fills air
+				const uint32_t voxel = get<0>(x, y, z);
+				if (brush.blockType == AIR ? voxel == AIR : voxel != AIR)
+					continue;
+
+				layer[rules::materialIndex(voxel & TYPE)]--;
+				layer[rules::materialIndex(brush.blockType)]++;
+
+				set<0>(x, y, z, brush.blockType == AIR ? AIR : currentFlag | brush.blockType);
+				if (occupancy && brush.blockType != AIR)
+					occupancy->markVoxel(x, y, z);
+				if (planesCurrent)
+					markPlane(x, y, z, brush.blockType != AIR);
+				if (changed)
+					touch(x, y, z);
+			}
+		}
+
+		for (uint32_t m = 0; m < rules::materialCount; m++)
+			if (layer[m])
+				filled[m].fetch_add(layer[m], std::memory_order_relaxed);
+	});
+
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		brushCells[m] += filled[m].load(std::memory_order_relaxed);
+}
+
+
+template class Simulation<uint8_t>;
+template class Simulation<uint16_t>;
+template class Simulation<uint32_t>;
+
+template class Simulation<uint8_t, layout::Bricked>;
+template class Simulation<uint16_t, layout::Bricked>;
+template class Simulation<uint32_t, layout::Bricked>;
+
+template class Simulation<uint8_t, layout::Morton>;
+template class Simulation<uint16_t, layout::Morton>;
+template class Simulation<uint32_t, layout::Morton>;
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "occupancy.h"
+#include "rules.h"
+#include "threadpool.h"
+#include "voxelgrid.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+
+// block placement state, the CPU equivalent of blockPlacingProperties and the BlockLocation buffer
+struct Brush
+{
+	bool placeBlock = false;
+	uint32_t blockType = voxel::ROCK;
+	float blockSize = 4.f;
+	int blockLocation[3] = { 0, 0, 0 };
+};
+
+
+// CPU implementation of shaders/particlesim.comp and shaders/place.comp
+// The brush is placed over its bounding box at the start of every iteration, then each pass updates the same 8^3 bricks the shader's work groups cover, spread across a thread pool.
+// The 8 voxel gaps between the bricks of a pass keep concurrently updated particles apart.
+// Moves::Claimed instead moves every particle at once along its velocity, see setMoves.
+// Instantiated for uint8_t, uint16_t and uint32_t cells, matching the R8UI, R16UI and R32UI grid formats, each
+// with the linear, bricked and Morton cell orders of layout.h. Slabs and the app's snapshots use linear grids.
+template<typename Cell, typename Layout = layout::Linear>
+class Simulation
+{
+public:
+	Simulation(unsigned int dimension, unsigned int threadCount = 0);
+
+	// one z slab of a world split across processes, see decomposition.h
+	// Only bricks starting in [zBegin, zEnd) are updated, zBegin a multiple of simSpacing. The grid holds the
+	// layers [zBegin - reach, zEnd + reach) those bricks touch, firstLayer() is the world z of its layer 0.
+	Simulation(unsigned int dimension, int zBegin, int zEnd, unsigned int threadCount = 0);
+
+	// furthest a particle update reads or writes outside its brick, lateral moves go up to 3 voxels
+	static const int reach = 3;
+
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	// how particles move each iteration
+	// Partitioned runs the shader's 8 passes, a particle moves a voxel at a time and only within its brick's reach.
+	// Claimed moves all particles in two phases: each claims a destination along its velocity, up to 8 voxels of
+	// falling, and the highest claim on a cell wins, then the winners move. Nothing is moved while claims are
+	// made, so no particle is lost or duplicated without any partitioning. Falls accelerate a voxel per iteration
+	// in the VEL_Y bits and water keeps flowing the way VEL_X and VEL_Z point, R8UI cells have no velocity bits
+	// and fall one voxel per iteration. Claims are kept per brick, only for bricks holding particles that move or
+	// the cells they claim. Only for whole worlds, not slabs.
+	enum class Moves { Partitioned, Claimed };
+	void setMoves(Moves moves);
+	Moves movesUsed() const { return moves; }
+
+	// let settled bricks sleep, 0 steps every brick
+	// A brick is stepped while any brick of the 3^3 around it changed in the last idleIterations iterations or the
+	// brush's box reaches it, otherwise it sleeps and its cells aren't visited at all. A particle blocked under one
+	// random lateral order can find a way out under another, so sleeping trades a little of that for skipping
+	// settled piles and pools. Bricks waking up get this iteration's flag cleared so every particle moves once.
+	// Partitioned moves on whole worlds only, call wake() after changing the grid from outside.
+	void setSleep(int idleIterations);
+	int sleepAfter() const { return sleepIterations; }
+	void wake();
+
+	// keep the iteration each brick last changed in even without sleeping, so changes can be published
+	// A brick changes when a particle moves or swaps in or out of it, the brush fills or clears one of its cells,
+	// or wake() is called. Only the materials are covered, flags and velocities change without a stamp.
+	void trackChanges();
+	uint32_t iterations() const { return iteration; }
+
+	// whether the brick at brick coordinates changed after the iterations() count since
+	bool brickChanged(int bx, int by, int bz, uint32_t since) const {
+		const size_t n = size_t(2 * partitionProperties.workGroups);
+		return int32_t(changed[(size_t(bz) * n + size_t(by)) * n + size_t(bx)].load(std::memory_order_relaxed) - since) > 0;
+	}
+
+	// how a pass or the claim phase finds the particles in a brick
+	// Scalar visits all 512 cells like the shader does. Packed keeps a bit per cell holding anything but air, a
+	// 64 bit word per brick layer, and visits only the set bits, so empty rows, layers and bricks cost a word test.
+	// The bits are visited lowest first, the same order as the scalar loop, and both give identical results.
+	// Whole worlds only, slabs use Scalar. Call wake() after changing the grid from outside, the bits are rebuilt
+	// from it at the next iteration.
+	enum class Kernel { Scalar, Packed };
+	void setKernel(Kernel kernel);
+	Kernel kernelUsed() const { return kernel; }
+
+	// bricks the latest iteration stepped, out of brickCount()
+	size_t activeBricks() const { return lastActive; }
+	size_t brickCount() const { return size_t(2 * partitionProperties.workGroups) * (2 * partitionProperties.workGroups) * (2 * partitionProperties.workGroups); }
+
+	// advance the world n iterations, each made of the 8 partition passes or one claim and commit
+	void step(int n = 1);
+
+	// advance one iteration using the given rng uniform instead of drawing one, to replay recorded input
+	void stepWith(float rngValue);
+
+	// rng uniform used by the latest iteration, the value the shader gets as ptRNG
+	float lastRNG() const { return iterationRNG; }
+
+	void setBrush(const Brush& brush) { this->brush = brush; }
+
+	// cells of each material, air included, the brush filled since construction less the ones it cleared, the balance
+	// WorldStatistics checks particle counts against
+	const int64_t* brushed() const { return brushCells; }
+	void seed(unsigned int seed) { rng.seed(seed); }
+
+	// keep an occupancy pyramid current while particles move, like the physics shader does for the ray caster
+	// only for whole worlds, not slabs
+	void trackOccupancy(OccupancyPyramid* occupancy);
+
+	// called after each of the 8 partition passes with the pass' z offset of 0 or 1, a slab exchanges halos here
+	void afterPass(std::function<void(int)> callback) { passDone = std::move(callback); }
+
+	int firstLayer() const { return zOrigin; }
+
+	VoxelGrid<Cell, Layout>& grid() { return voxels; }
+	const VoxelGrid<Cell, Layout>& grid() const { return voxels; }
+	unsigned int threads() const { return pool.size(); }
+
+
+private:
+	struct {
+		const int simLocalDim = 8;				// brick edge, matches the shader work group size
+		const int simSpacing = 2 * simLocalDim;	// stride between bricks of one pass
+		int workGroups;							// bricks along each cube dimension
+		int firstRow, lastRow;					// z range of bricks this simulation updates, all of them unless it's a slab
+	} partitionProperties;
+
+	VoxelGrid<Cell, Layout> voxels;
+	ThreadPool pool;
+	Brush brush;
+	int64_t brushCells[rules::materialCount] = {};
+	OccupancyPyramid* occupancy = nullptr;
+	std::function<void(int)> passDone;
+	int zOrigin = 0;
+
+	Moves moves = Moves::Partitioned;
+	uint32_t epoch = 0;									// in every claim, so earlier iterations' never win
+
+	// claimed move state of one brick, cells are indexed ((z & 7) * 8 + (y & 7)) * 8 + (x & 7)
+	struct ClaimBlock {
+		std::atomic<uint32_t> claims[512];				// highest claim on each cell this iteration
+		uint32_t intents[512];							// the claim each mover made this iteration
+		uint64_t movers[8];								// per layer, bit y * 8 + x set for the cells with an intent
+		std::atomic<uint32_t> used;						// last epoch the brick held movers or was claimed into
+	};
+	std::unique_ptr<std::atomic<ClaimBlock*>[]> claimBlocks;	// per brick, null while it has no claim state
+	std::vector<std::unique_ptr<ClaimBlock>> blockStore;		// every block allocated, blocks are reused not freed
+	std::vector<ClaimBlock*> spareBlocks;
+	std::vector<int> claimedBricks;								// bricks holding a block
+	std::mutex blockLock;										// taken only to hand a brick its block
+
+	int sleepIterations = 0;
+	bool tracking = false;								// changed is kept for trackChanges without sleeping
+	uint32_t iteration = 0;								// counts iterate calls, wrapping is fine for the differences below
+	std::unique_ptr<std::atomic<uint32_t>[]> changed;	// per brick, the last iteration a particle moved in or out of it
+	std::vector<uint32_t> lastRun;						// per brick, the last iteration it was stepped
+	std::vector<uint8_t> awake;
+	std::vector<int> activeList[8];						// bricks stepped this iteration, per pass
+	size_t lastActive = 0;
+
+	Kernel kernel = Kernel::Packed;
+	std::unique_ptr<std::atomic<uint64_t>[]> planes;	// per brick layer, bit y * 8 + x set for cells that aren't air
+	bool planesCurrent = false;							// planes match the grid and moves keep them up to date
+
+	uint32_t currentFlag = 0;
+	float iterationRNG = 0.f;
+	std::minstd_rand rng;
+
+	void iterate();
+
+	// the update kernels are instantiated for the common power of two world edges so the index math and bounds
+	// checks fold into shifts and constant compares, Dim 0 reads the edge at run time for any other size
+	template<unsigned int Dim> void runPasses();
+	void scheduleBricks();
+	void rebuildPlanes();
+
+	size_t brickOf(int x, int y, int z) const {
+		const size_t n = size_t(2 * partitionProperties.workGroups);
+		return (size_t(z >> OccupancyPyramid::brickShift) * n + size_t(y >> OccupancyPyramid::brickShift)) * n + size_t(x >> OccupancyPyramid::brickShift);
+	}
+
+	// wake the brick holding a cell that changed, and through it its neighbours
+	void touch(int x, int y, int z) { changed[brickOf(x, y, z)].store(iteration, std::memory_order_relaxed); }
+
+	// keep a cell's plane bit in step with it turning to or from air, bricks of a pass can share a gap's words
+	void markPlane(int x, int y, int z, bool occupied) {
+		std::atomic<uint64_t>& word = planes[brickOf(x, y, z) * 8 + size_t(z & 7)];
+		const uint64_t bit = uint64_t(1) << ((y & 7) * 8 + (x & 7));
+		if (occupied)
+			word.fetch_or(bit, std::memory_order_relaxed);
+		else
+			word.fetch_and(~bit, std::memory_order_relaxed);
+	}
+	template<unsigned int Dim> void updateBrick(int bx, int by, int bz, const int part[3]);
+	template<unsigned int Dim> void updateVoxel(int x, int y, int z);
+
+	bool inBrush(int x, int y, int z) const;
+	void placeBrush();
+
+	template<unsigned int Dim> void runClaimed();
+	template<unsigned int Dim, typename Visit> void forParticles(int bx, int by, int bz, Visit&& visit);
+	ClaimBlock& claimBlock(size_t brick);
+	void releaseBlocks();
+
+	static size_t blockCell(int x, int y, int z) { return (size_t(z & 7) * 8 + size_t(y & 7)) * 8 + size_t(x & 7); }
+	template<unsigned int Dim> uint32_t claim(int x, int y, int z, uint32_t voxel);
+	template<unsigned int Dim> void commit(int x, int y, int z, uint32_t intent);
+	template<unsigned int Dim> bool isAir(int x, int y, int z) const { return inWorld<Dim>(x, y, z) && get<Dim>(x, y, z) == voxel::AIR; }
+
+	template<unsigned int Dim> uint32_t swapIfAvailable(int x, int y, int z, int nx, int ny, int nz, uint32_t voxel);
+	template<unsigned int Dim> uint32_t swapIfBlock(int x, int y, int z, int nx, int ny, int nz, uint32_t voxel, uint32_t nVoxel);
+
+	template<unsigned int Dim> uint32_t moveParticle(uint32_t voxel, const rules::Material& material, int x, int y, int z);
+
+	template<unsigned int Dim>
+	size_t cell(int x, int y, int z) const {
+		return Layout::index(x, y, z - zOrigin, Dim ? Dim : voxels.dimension());
+	}
+
+	template<unsigned int Dim>
+	bool inWorld(int x, int y, int z) const {
+		const unsigned int dim = Dim ? Dim : voxels.dimension();
+		return unsigned(x) < dim && unsigned(y) < dim && unsigned(z) < dim;
+	}
+
+	template<unsigned int Dim>
+	uint32_t get(int x, int y, int z) const { return voxels.data()[cell<Dim>(x, y, z)]; }
+
+	template<unsigned int Dim>
+	void set(int x, int y, int z, uint32_t v) { voxels.data()[cell<Dim>(x, y, z)] = static_cast<Cell>(v); }
+};
@@ -0,0 +1,283 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+	const char magic[4] = { 'V', 'P', 'S', 'N' };
+	const uint32_t version = 1;
+	const size_t headerSize = 32;
+	const size_t indexEntrySize = 16;
+
+	void put32(uint8_t* out, uint32_t v) {
+		for (int b = 0; b < 4; b++)
+			out[b] = uint8_t(v >> (8 * b));
+	}
+
+	void put64(uint8_t* out, uint64_t v) {
+		for (int b = 0; b < 8; b++)
+			out[b] = uint8_t(v >> (8 * b));
+	}
+
+	uint32_t get32(const uint8_t* in) {
+		uint32_t v = 0;
+		for (int b = 0; b < 4; b++)
+			v |= uint32_t(in[b]) << (8 * b);
+		return v;
+	}
+
+	uint64_t get64(const uint8_t* in) {
+		uint64_t v = 0;
+		for (int b = 0; b < 8; b++)
+			v |= uint64_t(in[b]) << (8 * b);
+		return v;
+	}
+
+	uint32_t formatMask(voxel::CellFormat format) {
+		switch (format) {
+		case voxel::CellFormat::R8UI:	return 0xFF;
+		case voxel::CellFormat::R16UI:	return 0xFFFF;
+		default:						return 0xFFFFFFFF;
+		}
+	}
+
+	void encodeRun(std::vector<uint8_t>& out, uint32_t length, uint32_t value, size_t cellBytes) {
+		while (length >= 0x80) {
+			out.push_back(uint8_t(length | 0x80));
+			length >>= 7;
+		}
+		out.push_back(uint8_t(length));
+
+		for (size_t b = 0; b < cellBytes; b++)
+			out.push_back(uint8_t(value >> (8 * b)));
+	}
+}
+
+
+void snapshot::Layout::setDimension(unsigned int dimension) {
+	this->dimension = dimension;
+	chunksPerAxis = int((dimension + chunkDim - 1) / chunkDim);
+}
+
+size_t snapshot::Layout::chunkCells(int chunk) const {
+	int origin[3], size[3];
+	chunkExtent(chunk, origin, size);
+	return size_t(size[0]) * size[1] * size[2];
+}
+
+void snapshot::Layout::chunkExtent(int chunk, int origin[3], int size[3]) const {
+	origin[0] = (chunk % chunksPerAxis) * int(chunkDim);
+	origin[1] = ((chunk / chunksPerAxis) % chunksPerAxis) * int(chunkDim);
+	origin[2] = (chunk / (chunksPerAxis * chunksPerAxis)) * int(chunkDim);
+
+	for (int a = 0; a < 3; a++)
+		size[a] = std::min(int(chunkDim), int(dimension) - origin[a]);
+}
+
+
+bool SnapshotWriter::open(const std::string& path, unsigned int dimension, voxel::CellFormat format) {
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	chunkLayout.setDimension(dimension);
+	cellFormat = format;
+	indexOffset = headerSize;
+	index.assign(size_t(chunkLayout.chunkCount()) * indexEntrySize, 0);
+
+	uint8_t header[headerSize] = {};
+	std::memcpy(header, magic, 4);
+	put32(header + 4, version);
+	put32(header + 8, dimension);
+	put32(header + 12, snapshot::chunkDim);
+	put32(header + 16, uint32_t(format));
+	put32(header + 20, uint32_t(chunkLayout.chunkCount()));
+	put64(header + 24, indexOffset);
+
+	// the index is rewritten once every chunk offset is known
+	file.write(reinterpret_cast<const char*>(header), headerSize);
+	file.write(reinterpret_cast<const char*>(index.data()), index.size());
+
+	return bool(file);
+}
+
+template<typename Cell>
+bool SnapshotWriter::writeChunk(int chunk, const Cell* cells) {
+	const size_t count = chunkLayout.chunkCells(chunk);
+	const size_t cellBytes = voxel::cellBytes(cellFormat);
+	const uint32_t mask = formatMask(cellFormat);
+
+	encoded.clear();
+	uint32_t runValue = uint32_t(cells[0]) & mask;
+	uint32_t runLength = 0;
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t value = uint32_t(cells[i]) & mask;
+		if (value != runValue) {
+			encodeRun(encoded, runLength, runValue, cellBytes);
+			runValue = value;
+			runLength = 0;
+		}
+		runLength++;
+	}
+
+	// an all air chunk takes no space beyond its index entry
+	const bool empty = runLength == count && runValue == voxel::AIR;
+	if (!empty)
+		encodeRun(encoded, runLength, runValue, cellBytes);
+
+	uint8_t* entry = &index[size_t(chunk) * indexEntrySize];
+	put64(entry, empty ? 0 : uint64_t(file.tellp()));
+	put32(entry + 8, uint32_t(encoded.size()));
+
+	file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+	return bool(file);
+}
+
+bool SnapshotWriter::close() {
+	file.seekp(std::streamoff(indexOffset));
+	file.write(reinterpret_cast<const char*>(index.data()), index.size());
+	file.close();
+
+	return !file.fail();
+}
+
+
+bool SnapshotReader::open(const std::string& path) {
+	if (!file.open(path) || file.size() < headerSize)
+		return false;
+
+	const uint8_t* header = file.data();
+	if (std::memcmp(header, magic, 4) != 0 || get32(header + 4) != version || get32(header + 12) != snapshot::chunkDim || get32(header + 16) > uint32_t(voxel::CellFormat::R32UI))
+		return false;
+
+	chunkLayout.setDimension(get32(header + 8));
+	cellFormat = voxel::CellFormat(get32(header + 16));
+
+	const uint64_t indexOffset = get64(header + 24);
+	if (get32(header + 20) != uint32_t(chunkLayout.chunkCount()) || indexOffset + uint64_t(chunkLayout.chunkCount()) * indexEntrySize > file.size())
+		return false;
+
+	index = file.data() + indexOffset;
+	return true;
+}
+
+bool SnapshotReader::chunkEmpty(int chunk) const {
+	return get32(index + size_t(chunk) * indexEntrySize + 8) == 0;
+}
+
+template<typename Cell>
+bool SnapshotReader::readChunk(int chunk, Cell* cells) const {
+	const size_t count = chunkLayout.chunkCells(chunk);
+	if (chunkEmpty(chunk)) {
+		std::fill(cells, cells + count, Cell(voxel::AIR));
+		return true;
+	}
+
+	const uint8_t* entry = index + size_t(chunk) * indexEntrySize;
+	const uint64_t offset = get64(entry);
+	const uint32_t size = get32(entry + 8);
+	if (offset + size > file.size())
+		return false;
+
+	const size_t cellBytes = voxel::cellBytes(cellFormat);
+	const uint8_t* in = file.data() + offset;
+	const uint8_t* end = in + size;
+
+	size_t filled = 0;
+	while (in < end && filled < count) {
+		uint32_t length = 0;
+		for (int shift = 0; in < end; shift += 7) {
+			const uint8_t byte = *in++;
+			length |= uint32_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+
+		if (size_t(end - in) < cellBytes || filled + length > count)
+			return false;
+
+		uint32_t value = 0;
+		for (size_t b = 0; b < cellBytes; b++)
+			value |= uint32_t(*in++) << (8 * b);
+
+		std::fill(cells + filled, cells + filled + length, static_cast<Cell>(value));
+		filled += length;
+	}
+
+	return filled == count;
+}
+
+
+template<typename Cell>
+bool saveSnapshot(const std::string& path, const VoxelGrid<Cell>& grid) {
+	SnapshotWriter writer;
+	if (!writer.open(path, grid.dimension(), grid.format))
+		return false;
+
+	const snapshot::Layout& layout = writer.layout();
+	std::vector<Cell> cells(size_t(snapshot::chunkDim) * snapshot::chunkDim * snapshot::chunkDim);
+
+	for (int chunk = 0; chunk < layout.chunkCount(); chunk++) {
+		int origin[3], size[3];
+		layout.chunkExtent(chunk, origin, size);
+
+		Cell* out = cells.data();
+		for (int z = 0; z < size[2]; z++) {
+			for (int y = 0; y < size[1]; y++) {
+				const Cell* row = grid.data() + grid.index(origin[0], origin[1] + y, origin[2] + z);
+				out = std::copy(row, row + size[0], out);
+			}
+		}
+
+		if (!writer.writeChunk(chunk, cells.data()))
+			return false;
+	}
+
+	return writer.close();
+}
+
+template<typename Cell>
+bool loadSnapshot(const std::string& path, VoxelGrid<Cell>& grid) {
+	SnapshotReader reader;
+	if (!reader.open(path) || reader.dimension() != grid.dimension())
+		return false;
+
+	const snapshot::Layout& layout = reader.layout();
+	std::vector<Cell> cells(size_t(snapshot::chunkDim) * snapshot::chunkDim * snapshot::chunkDim);
+
+	for (int chunk = 0; chunk < layout.chunkCount(); chunk++) {
+		if (!reader.readChunk(chunk, cells.data()))
+			return false;
+
+		int origin[3], size[3];
+		layout.chunkExtent(chunk, origin, size);
+
+		const Cell* in = cells.data();
+		for (int z = 0; z < size[2]; z++) {
+			for (int y = 0; y < size[1]; y++) {
+				std::copy(in, in + size[0], grid.data() + grid.index(origin[0], origin[1] + y, origin[2] + z));
+				in += size[0];
+			}
+		}
+	}
+
+	return true;
+}
+
+
+template bool SnapshotWriter::writeChunk(int, const uint8_t*);
+template bool SnapshotWriter::writeChunk(int, const uint16_t*);
+template bool SnapshotWriter::writeChunk(int, const uint32_t*);
+
+template bool SnapshotReader::readChunk(int, uint8_t*) const;
+template bool SnapshotReader::readChunk(int, uint16_t*) const;
+template bool SnapshotReader::readChunk(int, uint32_t*) const;
+
+template bool saveSnapshot(const std::string&, const VoxelGrid<uint8_t>&);
+template bool saveSnapshot(const std::string&, const VoxelGrid<uint16_t>&);
+template bool saveSnapshot(const std::string&, const VoxelGrid<uint32_t>&);
+
+template bool loadSnapshot(const std::string&, VoxelGrid<uint8_t>&);
+template bool loadSnapshot(const std::string&, VoxelGrid<uint16_t>&);
+template bool loadSnapshot(const std::string&, VoxelGrid<uint32_t>&);
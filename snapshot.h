@@ -0,0 +1,94 @@
+#pragma once
+
+#include "mappedfile.h"
+#include "voxel.h"
+#include "voxelgrid.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// World snapshot file
+// The world is split into chunkDim^3 chunks, each run length encoded on its own and listed in an index after
+// the header, so single chunks can be decoded straight from a memory mapped file without reading the rest.
+//
+// header		"VPSN", version, dimension, chunkDim, cell format, chunk count (u32 each), index offset (u64)
+// index		per chunk: data offset (u64), data size (u32), reserved (u32), a size of 0 is an all air chunk
+// chunk data	runs of a varint length followed by the cell value in the file's cell width, little endian
+//
+// Chunks are ordered x fastest, cells within a chunk x fastest over the chunk's extent, which is clipped at
+// the world edge when the dimension isn't a multiple of chunkDim.
+namespace snapshot
+{
+	const unsigned int chunkDim = 32;
+
+	struct Layout {
+		unsigned int dimension = 0;
+		int chunksPerAxis = 0;
+
+		void setDimension(unsigned int dimension);
+
+		int chunkCount() const { return chunksPerAxis * chunksPerAxis * chunksPerAxis; }
+		size_t chunkCells(int chunk) const;
+		void chunkExtent(int chunk, int origin[3], int size[3]) const;
+	};
+}
+
+
+class SnapshotWriter
+{
+public:
+	bool open(const std::string& path, unsigned int dimension, voxel::CellFormat format);
+
+	// chunks may be written in any order, cells are converted to the file's format
+	template<typename Cell>
+	bool writeChunk(int chunk, const Cell* cells);
+
+	// writes the index, chunks that were never written read back as air
+	bool close();
+
+	const snapshot::Layout& layout() const { return chunkLayout; }
+
+
+private:
+	std::ofstream file;
+	snapshot::Layout chunkLayout;
+	voxel::CellFormat cellFormat = voxel::CellFormat::R8UI;
+	uint64_t indexOffset = 0;
+	std::vector<uint8_t> index;
+	std::vector<uint8_t> encoded;
+};
+
+
+class SnapshotReader
+{
+public:
+	bool open(const std::string& path);
+
+	unsigned int dimension() const { return chunkLayout.dimension; }
+	voxel::CellFormat format() const { return cellFormat; }
+	const snapshot::Layout& layout() const { return chunkLayout; }
+
+	bool chunkEmpty(int chunk) const;
+
+	// decode one chunk into chunkCells(chunk) cells, converting to the requested cell width
+	template<typename Cell>
+	bool readChunk(int chunk, Cell* cells) const;
+
+
+private:
+	MappedFile file;
+	snapshot::Layout chunkLayout;
+	voxel::CellFormat cellFormat = voxel::CellFormat::R8UI;
+	const uint8_t* index = nullptr;
+};
+
+
+// whole grid helpers, both only hold a single chunk uncompressed at a time
+template<typename Cell>
+bool saveSnapshot(const std::string& path, const VoxelGrid<Cell>& grid);
+
+template<typename Cell>
+bool loadSnapshot(const std::string& path, VoxelGrid<Cell>& grid);
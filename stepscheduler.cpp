@@ -0,0 +1,87 @@
+#include "stepscheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+namespace {
+	// timer queries are read a few frames late, more unmatched frames than this means results were lost
+	const size_t maxPending = 64;
+}
+
+
+StepScheduler::StepScheduler(const Settings& settings) :
+	settings(settings) {
+	decision.rate = decision.fits = settings.nominal;
+}
+
+
+int StepScheduler::next() {
+	// what fits: the planned share of the budget left after the rest of the frame, in steps
+	if (measured) {
+		const double room = settings.frameNs * settings.headroom - decision.otherNs;
+		decision.fits = std::max(std::max(room, 0.) / std::max(decision.stepNs, 1.), settings.minRate);
+
+		if (std::abs(decision.fits - decision.rate) > settings.hysteresis * std::max(decision.rate, 1.))
+			decision.rate = decision.fits;
+	}
+
+	// owed steps are paid back out of whatever the plan has beyond the nominal rate
+	const double wanted = settings.nominal + decision.debt;
+	const double planned = std::min({ wanted, decision.rate, double(settings.maxSteps) });
+
+	carry += planned;
+	decision.steps = int(std::floor(carry));
+
+	// no frame is planned past the whole budget, the fraction waits for a frame with room to spare
+	if (measured) {
+		const int whole = int((settings.frameNs - decision.otherNs) / std::max(decision.stepNs, 1.));
+		decision.steps = std::min(decision.steps, std::max(whole, 1));
+	}
+	carry = std::min(carry - decision.steps, 1.);
+
+	decision.debt = std::min(std::max(decision.debt + settings.nominal - decision.steps, 0.), settings.maxDebt);
+
+	pending.push_back(decision.steps);
+	if (pending.size() > maxPending)
+		pending.pop_front();
+
+	return decision.steps;
+}
+
+void StepScheduler::simMeasured(uint64_t nanoseconds) {
+	if (pending.empty())
+		return;
+
+	const int steps = pending.front();
+	pending.pop_front();
+	if (steps == 0)
+		return;
+
+	const double stepNs = double(nanoseconds) / steps;
+	decision.stepNs = measured ? decision.stepNs + settings.smoothing * (stepNs - decision.stepNs) : stepNs;
+	measured = true;
+}
+
+void StepScheduler::otherMeasured(int source, uint64_t nanoseconds) {
+	if (source >= int(others.size()))
+		others.resize(size_t(source) + 1, -1.);
+
+	double& average = others[source];
+	average = average < 0. ? double(nanoseconds) : average + settings.smoothing * (double(nanoseconds) - average);
+
+	decision.otherNs = 0.;
+	for (double other : others)
+		decision.otherNs += std::max(other, 0.);
+}
+
+
+std::string StepScheduler::summary() const {
+	std::ostringstream out;
+	out.precision(3);
+	out << "steps " << decision.steps << " (rate " << decision.rate << ", fits " << decision.fits << ", owed " << decision.debt
+		<< ", step " << decision.stepNs / 1000. << "us, rest " << decision.otherNs / 1000. << "us)";
+
+	return out.str();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+
+// Picks how many simulation steps each frame runs so the frame fits the frame rate's budget
+// simIterations stays the steps per frame the world is meant to advance. The scheduler measures what a step and
+// the rest of the frame cost and plans the share of the budget that fits, fractions carried over to later
+// frames, though no frame is given more steps than its whole budget holds. The plan only moves when the fitting
+// rate leaves a band around it, so measurement noise doesn't make it oscillate. Steps a frame couldn't afford are
+// owed and paid back on frames with room to spare, and a debt past maxDebt is forgiven, the world then runs
+// slower instead of stalling frames to catch up.
+class StepScheduler
+{
+public:
+	struct Settings {
+		double frameNs = 1e9 / 60.;		// budget of one frame
+		double headroom = .9;			// share of the budget that is planned for
+		int nominal = 4;				// steps per frame the world should advance
+		int maxSteps = 8;				// cap on any one frame, catching up included
+		double hysteresis = .15;		// relative change the fitting rate needs before the plan follows
+		double smoothing = .2;			// weight of a new measurement in the running cost averages
+		double maxDebt = 240.;			// steps owed before the rest is dropped
+		double minRate = .5;			// steps per frame kept even when the rest of the frame fills the budget
+	};
+
+	// the last frame's plan, for stats output
+	struct Decision {
+		int steps = 0;			// run this frame
+		double fits = 0.;		// steps the measured costs leave room for
+		double rate = 0.;		// planned steps per frame, fits behind hysteresis
+		double debt = 0.;		// steps owed
+		double stepNs = 0.;		// average cost of a step
+		double otherNs = 0.;	// average cost of everything else in a frame
+	};
+
+	explicit StepScheduler(const Settings& settings);
+
+	// steps for the next frame
+	int next();
+
+	// cost of a frame's simulation, one per frame in the order next() handed the steps out, so timer query
+	// results arriving frames late still pair with their step counts
+	void simMeasured(uint64_t nanoseconds);
+
+	// cost of another part of the frame, like rendering, each source averaged apart and the averages added up
+	void otherMeasured(int source, uint64_t nanoseconds);
+
+	const Decision& last() const { return decision; }
+
+	// "steps N (rate R, fits F, owed D, step Sus, rest Rus)"
+	std::string summary() const;
+
+
+private:
+	Settings settings;
+	Decision decision;
+
+	double carry = 0.;					// fraction of a step left over from earlier frames
+	bool measured = false;				// stepNs holds a measurement
+	std::deque<int> pending;			// steps of frames whose simulation wasn't measured yet
+	std::vector<double> others;			// running average per other source, negative until measured
+};
@@ -0,0 +1,155 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+
+namespace {
+	uint64_t packRange(uint64_t begin, uint64_t end) {
+		return end << 32 | begin;
+	}
+}
+
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+
+	ranges.reset(new std::atomic<uint64_t>[threadCount]);
+	for (unsigned int i = 0; i < threadCount; i++)
+		ranges[i].store(0);
+
+	for (unsigned int i = 1; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+	run(count, task, false);
+}
+
+void ThreadPool::stealingFor(size_t count, const std::function<void(size_t)>& task) {
+	run(count, task, true);
+}
+
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task, bool stealing) {
+	if (count == 0)
+		return;
+
+	if (workers.empty()) {
+		for (size_t i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		this->task = &task;
+		this->stealing = stealing;
+		taskCount = count;
+		nextTask = 0;
+
+		// contiguous shares, the first threads take one extra index when the count doesn't divide evenly
+		const size_t threads = size();
+		for (size_t t = 0, begin = 0; t < threads; t++) {
+			const size_t share = count / threads + (t < count % threads);
+			ranges[t].store(packRange(begin, begin + share));
+			begin += share;
+		}
+
+		activeWorkers = static_cast<unsigned int>(workers.size());
+		generation++;
+	}
+	wake.notify_all();
+
+	drain(0, task, count, stealing);
+
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [&]() { return activeWorkers == 0; });
+	this->task = nullptr;
+}
+
+
+void ThreadPool::workerLoop(unsigned int index) {
+	unsigned long long seenGeneration = 0;
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [&]() { return stopping || generation != seenGeneration; });
+		if (stopping)
+			return;
+
+		seenGeneration = generation;
+		const std::function<void(size_t)>& currentTask = *task;
+		size_t count = taskCount;
+		bool currentStealing = stealing;
+
+		guard.unlock();
+		drain(index, currentTask, count, currentStealing);
+		guard.lock();
+
+		if (--activeWorkers == 0)
+			done.notify_one();
+	}
+}
+
+void ThreadPool::drain(unsigned int index, const std::function<void(size_t)>& task, size_t count, bool stealing) {
+	// claim indices until the range is exhausted, bricks finish at different speeds so this balances load
+	if (!stealing) {
+		for (size_t i = nextTask.fetch_add(1); i < count; i = nextTask.fetch_add(1))
+			task(i);
+		return;
+	}
+
+	size_t i;
+	while (popFront(index, i))
+		task(i);
+
+	// own share is done, steal from the other threads in turn
+	const unsigned int threads = size();
+	for (unsigned int v = 1; v < threads; v++) {
+		const unsigned int victim = (index + v) % threads;
+		while (popBack(victim, i))
+			task(i);
+	}
+}
+
+
+bool ThreadPool::popFront(unsigned int index, size_t& i) {
+	uint64_t range = ranges[index].load();
+	while (true) {
+		const uint64_t begin = range & 0xFFFFFFFF, end = range >> 32;
+		if (begin >= end)
+			return false;
+
+		if (ranges[index].compare_exchange_weak(range, packRange(begin + 1, end))) {
+			i = size_t(begin);
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::popBack(unsigned int index, size_t& i) {
+	uint64_t range = ranges[index].load();
+	while (true) {
+		const uint64_t begin = range & 0xFFFFFFFF, end = range >> 32;
+		if (begin >= end)
+			return false;
+
+		if (ranges[index].compare_exchange_weak(range, packRange(begin, end - 1))) {
+			i = size_t(end - 1);
+			return true;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// persistent worker threads for the CPU paths
+// the calling thread joins in on every parallelFor so a pool of size 1 spawns no workers
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount = 0);	// 0 uses every hardware thread
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int size() const { return static_cast<unsigned int>(workers.size()) + 1; }
+
+	// runs task(i) for every i in [0, count) and returns once all have finished
+	void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+	// like parallelFor, but each thread starts on its own contiguous share of the range and idle threads steal
+	// from the back of busy ones, so neighbouring indices of uneven cost like screen tiles stay on one thread
+	void stealingFor(size_t count, const std::function<void(size_t)>& task);
+
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const std::function<void(size_t)>* task = nullptr;
+	size_t taskCount = 0;
+	bool stealing = false;
+	std::atomic<size_t> nextTask{ 0 };
+	std::unique_ptr<std::atomic<uint64_t>[]> ranges;	// per thread [begin, end) packed as end << 32 | begin
+	unsigned int activeWorkers = 0;
+	unsigned long long generation = 0;
+	bool stopping = false;
+
+	void run(size_t count, const std::function<void(size_t)>& task, bool stealing);
+	void workerLoop(unsigned int index);
+	void drain(unsigned int index, const std::function<void(size_t)>& task, size_t count, bool stealing);
+
+	bool popFront(unsigned int index, size_t& i);
+	bool popBack(unsigned int index, size_t& i);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+// Lock free handoff of the latest value from one writer thread to one reader thread
+// The writer fills its own slot and swaps it with the middle one, the reader swaps its slot with the middle one
+// when a newer value is waiting. Neither side ever waits and a slot is never written while it is being read.
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() = default;
+	explicit TripleBuffer(const T& initial) {
+		for (Slot& slot : slots)
+			slot.value = initial;
+	}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// writer thread
+	void write(const T& value) {
+		slots[back].value = value;
+		back = middle.exchange(back | fresh, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// reader thread, the most recently written value, or the last one read if nothing newer was written
+	const T& read() {
+		if (middle.load(std::memory_order_relaxed) & fresh)
+			front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+
+		return slots[front].value;
+	}
+
+
+private:
+	static const uint8_t indexMask = 0x3;
+	static const uint8_t fresh = 0x4;	// middle slot holds a value the reader hasn't taken yet
+
+	// own cache lines so the threads don't contend on neighbouring slots
+	struct alignas(64) Slot {
+		T value{};
+	};
+
+	Slot slots[3];
+	std::atomic<uint8_t> middle{ 1 };
+	uint8_t back = 0;	// writer only
+	uint8_t front = 2;	// reader only
+};
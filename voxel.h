@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// voxel bit layout shared with shaders/particlesim.comp and shaders/dda.comp
+namespace voxel
+{
+	const uint32_t FLAG = 0x80;			// alternating update flag
+	const uint32_t TYPE = 0x7F;			// material
+	const uint32_t VEL_Y = 0xF000;		// signed 4 bit velocity, only stored by R16UI and wider cells
+	const uint32_t VEL_X = 0x0C00;		// signed 2 bit velocity
+	const uint32_t VEL_Z = 0x0300;		// signed 2 bit velocity
+
+	// block types
+	const uint32_t AIR = 0;
+	const uint32_t ROCK = 1;
+	const uint32_t SAND = 2;
+	const uint32_t WATER = 3;
+
+
+	// storage formats for gridTexture and the CPU grids
+	// type and flag fit in R8UI, R16UI is needed once the velocity bits are used
+	enum class CellFormat { R8UI, R16UI, R32UI };
+
+	template<typename Cell> struct CellTraits;
+	template<> struct CellTraits<uint8_t> { static const CellFormat format = CellFormat::R8UI; };
+	template<> struct CellTraits<uint16_t> { static const CellFormat format = CellFormat::R16UI; };
+	template<> struct CellTraits<uint32_t> { static const CellFormat format = CellFormat::R32UI; };
+
+	inline size_t cellBytes(CellFormat format) {
+		switch (format) {
+		case CellFormat::R8UI:	return 1;
+		case CellFormat::R16UI:	return 2;
+		default:				return 4;
+		}
+	}
+
+	inline const char* cellFormatName(CellFormat format) {
+		switch (format) {
+		case CellFormat::R8UI:	return "R8UI";
+		case CellFormat::R16UI:	return "R16UI";
+		default:				return "R32UI";
+		}
+	}
+
+
+	// pack and unpack helpers, cells are handled as uint32_t and truncated to the storage format on store
+	inline uint32_t pack(uint32_t type, uint32_t flag) {
+		return (type & TYPE) | (flag & FLAG);
+	}
+
+	inline uint32_t pack(uint32_t type, uint32_t flag, int velX, int velY, int velZ) {
+		return pack(type, flag)
+			| ((uint32_t(velY) << 12) & VEL_Y)
+			| ((uint32_t(velX) << 10) & VEL_X)
+			| ((uint32_t(velZ) << 8) & VEL_Z);
+	}
+
+	inline uint32_t type(uint32_t voxel) { return voxel & TYPE; }
+	inline uint32_t flag(uint32_t voxel) { return voxel & FLAG; }
+
+	// sign extend the velocity fields
+	inline int velocityY(uint32_t voxel) { return int(voxel << 16) >> 28; }
+	inline int velocityX(uint32_t voxel) { return int(voxel << 20) >> 30; }
+	inline int velocityZ(uint32_t voxel) { return int(voxel << 22) >> 30; }
+
+	// convert between storage formats, velocity is dropped when narrowing to R8UI
+	template<typename Dst, typename Src>
+	void convert(const Src* src, Dst* dst, size_t count) {
+		const uint32_t mask = sizeof(Dst) == 1 ? (TYPE | FLAG) : 0xFFFF;
+		for (size_t i = 0; i < count; i++)
+			dst[i] = static_cast<Dst>(uint32_t(src[i]) & mask);
+	}
+}
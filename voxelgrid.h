@@ -0,0 +1,64 @@
+#pragma once
+
+#include "layout.h"
+#include "voxel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// CPU side copy of gridTexture, x-major like the 3D texture unless another Layout is given, see layout.h
+// Cell selects the storage format, values are read and written as uint32_t like the shaders do
+// A grid can also be a slab of fewer z layers than its edge, for worlds split across processes.
+template<typename Cell, typename Layout = layout::Linear>
+class VoxelGrid
+{
+public:
+	using CellType = Cell;
+	using LayoutType = Layout;
+	static const voxel::CellFormat format = voxel::CellTraits<Cell>::format;
+
+	VoxelGrid(unsigned int dimension) : VoxelGrid(dimension, dimension) {}
+
+	VoxelGrid(unsigned int dimension, unsigned int depth) :
+		dim(dimension),
+		layers(depth),
+		voxels(Layout::size(dimension, depth), Cell(voxel::AIR)) {}
+
+	unsigned int dimension() const { return dim; }
+	unsigned int depth() const { return layers; }
+	size_t size() const { return voxels.size(); }	// cells stored, more than dimension^2 * depth for padded layouts
+	size_t bytes() const { return voxels.size() * sizeof(Cell); }
+
+	bool inBounds(int x, int y, int z) const {
+		return x >= 0 && y >= 0 && z >= 0 && unsigned(x) < dim && unsigned(y) < dim && unsigned(z) < layers;
+	}
+
+	size_t index(int x, int y, int z) const { return Layout::index(x, y, z, dim); }
+
+	uint32_t get(int x, int y, int z) const { return voxels[index(x, y, z)]; }
+	void set(int x, int y, int z, uint32_t v) { voxels[index(x, y, z)] = static_cast<Cell>(v); }
+
+	Cell* data() { return voxels.data(); }
+	const Cell* data() const { return voxels.data(); }
+
+	void clear() { std::fill(voxels.begin(), voxels.end(), Cell(voxel::AIR)); }
+
+
+private:
+	unsigned int dim;
+	unsigned int layers;
+	std::vector<Cell> voxels;
+};
+
+
+// copy a grid into one of the same size in another layout
+template<typename Cell, typename From, typename To>
+void copyCells(const VoxelGrid<Cell, From>& from, VoxelGrid<Cell, To>& to) {
+	for (int z = 0; z < int(from.depth()); z++)
+		for (int y = 0; y < int(from.dimension()); y++)
+			for (int x = 0; x < int(from.dimension()); x++)
+				to.set(x, y, z, from.get(x, y, z));
+}
@@ -0,0 +1,155 @@
+#include "worldstats.h"
+
+#include <algorithm>
+#include <sstream>
+
+
+uint64_t WorldStats::particles() const {
+	uint64_t count = 0;
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		if (m != voxel::AIR)
+			count += cells[m];
+
+	return count;
+}
+
+bool WorldStats::conserved() const {
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		if (leaked[m] != 0)
+			return false;
+
+	return true;
+}
+
+
+std::string WorldStats::summary() const {
+	std::ostringstream out;
+	out << particles() << " particles (";
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		if (m != voxel::AIR)
+			out << (m > 1 ? ", " : "") << rules::materials[m].name << " " << cells[m];
+	out << "), " << changed << " changed";
+	if (changed > 0)
+		out << " in [" << changedMin[0] << " " << changedMin[1] << " " << changedMin[2] << ", " << changedMax[0] << " " << changedMax[1] << " " << changedMax[2] << "]";
+
+	if (!conserved()) {
+		out << ", leaked";
+		for (uint32_t m = 0; m < rules::materialCount; m++)
+			if (m != voxel::AIR && leaked[m] != 0)
+				out << " " << rules::materials[m].name << " " << std::showpos << leaked[m] << std::noshowpos;
+	}
+
+	return out.str();
+}
+
+std::string WorldStats::csvHeader() {
+	std::ostringstream out;
+	out << "particles";
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		if (m != voxel::AIR)
+			out << "," << rules::materials[m].name;
+	out << ",changed,min_x,min_y,min_z,max_x,max_y,max_z";
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		if (m != voxel::AIR)
+			out << ",leaked_" << rules::materials[m].name;
+
+	return out.str();
+}
+
+// leaks are left empty for unchecked samples, a 0 there would claim the balance held
+std::string WorldStats::csvRow() const {
+	std::ostringstream out;
+	out << particles();
+	for (uint32_t m = 0; m < rules::materialCount; m++)
+		if (m != voxel::AIR)
+			out << "," << cells[m];
+	out << "," << changed;
+	for (int a = 0; a < 3; a++)
+		out << "," << changedMin[a];
+	for (int a = 0; a < 3; a++)
+		out << "," << changedMax[a];
+	for (uint32_t m = 0; m < rules::materialCount; m++) {
+		if (m == voxel::AIR)
+			continue;
+		out << ",";
+		if (checked)
+			out << leaked[m];
+	}
+
+	return out.str();
+}
+
+
+template<typename Cell, typename Layout>
+const WorldStats& WorldStatistics<Cell, Layout>::sample(const VoxelGrid<Cell, Layout>& grid, const int64_t* brushed) {
+	const int dim = int(grid.dimension());
+	const int depth = int(grid.depth());
+	const size_t layerCells = size_t(dim) * dim;
+
+	// the first sample after a reset only becomes the baseline
+	const bool compare = previous.size() == layerCells * depth;
+	if (!compare)
+		previous.assign(layerCells * depth, 0);
+
+	// each layer reduces on its own, combining them in order keeps the result independent of the threads
+	layers.resize(size_t(depth));
+	pool.parallelFor(size_t(depth), [&](size_t i) {
+		const int z = int(i);
+		Layer& layer = layers[i];
+		std::fill(layer.cells, layer.cells + rules::materialCount, 0);
+		layer.changed = 0;
+		layer.minX = layer.minY = dim;
+		layer.maxX = layer.maxY = -1;
+
+		uint8_t* before = &previous[i * layerCells];
+		for (int y = 0; y < dim; y++) {
+			for (int x = 0; x < dim; x++) {
+				const uint8_t m = uint8_t(rules::materialIndex(voxel::type(grid.get(x, y, z))));
+				layer.cells[m]++;
+
+				uint8_t& was = before[size_t(y) * dim + x];
+				if (compare && was != m) {
+					layer.changed++;
+					layer.minX = std::min(layer.minX, x);
+					layer.maxX = std::max(layer.maxX, x);
+					layer.minY = std::min(layer.minY, y);
+					layer.maxY = std::max(layer.maxY, y);
+				}
+				was = m;
+			}
+		}
+	});
+
+	WorldStats next;
+	for (int z = 0; z < depth; z++) {
+		const Layer& layer = layers[size_t(z)];
+		for (uint32_t m = 0; m < rules::materialCount; m++)
+			next.cells[m] += layer.cells[m];
+		if (layer.changed == 0)
+			continue;
+
+		const int lo[3] = { layer.minX, layer.minY, z }, hi[3] = { layer.maxX, layer.maxY, z };
+		for (int a = 0; a < 3; a++) {
+			next.changedMin[a] = next.changed ? std::min(next.changedMin[a], lo[a]) : lo[a];
+			next.changedMax[a] = next.changed ? std::max(next.changedMax[a], hi[a]) : hi[a];
+		}
+		next.changed += layer.changed;
+	}
+
+	// whatever the brush didn't fill or clear since the last sample, the update rules did
+	next.checked = compare && brushed;
+	if (next.checked) {
+		for (uint32_t m = 0; m < rules::materialCount; m++)
+			next.leaked[m] = int64_t(next.cells[m] - stats.cells[m]) - (brushed[m] - lastBrushed[m]);
+	}
+	if (brushed)
+		std::copy(brushed, brushed + rules::materialCount, lastBrushed);
+
+	stats = next;
+	return stats;
+}
+
+
+template class WorldStatistics<uint8_t>;
+template class WorldStatistics<uint16_t>;
+template class WorldStatistics<uint32_t>;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "rules.h"
+#include "threadpool.h"
+#include "voxelgrid.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// one sample of a world's contents, see WorldStatistics
+struct WorldStats
+{
+	uint64_t cells[rules::materialCount] = {};		// per material, air included, types past the table count as rock
+	uint64_t changed = 0;							// cells whose material differs from the previous sample
+	int changedMin[3] = { 0, 0, 0 };				// box around the changed cells, empty while changed is 0
+	int changedMax[3] = { -1, -1, -1 };
+
+	// per material count change the brush doesn't explain, negative for lost particles, positive for duplicated
+	// ones, only filled if checked
+	int64_t leaked[rules::materialCount] = {};
+	bool checked = false;	// there was a previous sample and the brush's changes since are known
+
+	uint64_t particles() const;		// cells that aren't air
+	bool conserved() const;
+
+	// "N particles (rock R, sand S, water W), C changed in [x y z, x y z]" and a leak note if one was found
+	std::string summary() const;
+
+	// CSV columns after the caller's own, per material counts, changed cells, their box and leaks
+	static std::string csvHeader();
+	std::string csvRow() const;
+};
+
+
+// per material counts and activity of a grid, reduced in parallel over its z layers
+// A sample counts every material and compares each cell to the previous sample, which is kept as a byte per
+// cell, so the cells that changed and the box around them cover everything between the two samples. Given the
+// brush's running totals (Simulation::brushed) the counts are also balanced: particles the update rules lost
+// or duplicated show up in leaked. reset() after changing the grid from outside, like a paged window moving,
+// makes the next sample a new baseline. Instantiated for the linear uint8_t, uint16_t and uint32_t grids.
+template<typename Cell, typename Layout = layout::Linear>
+class WorldStatistics
+{
+public:
+	explicit WorldStatistics(ThreadPool& pool) : pool(pool) {}
+
+	// brushed is null when the brush's changes since the last sample aren't known, leaks aren't checked then
+	const WorldStats& sample(const VoxelGrid<Cell, Layout>& grid, const int64_t* brushed);
+	const WorldStats& last() const { return stats; }
+
+	void reset() { previous.clear(); }
+
+
+private:
+	struct Layer {
+		uint64_t cells[rules::materialCount];
+		uint64_t changed;
+		int minX, minY, maxX, maxY;
+	};
+
+	ThreadPool& pool;
+	WorldStats stats;
+	std::vector<uint8_t> previous;						// per cell, the material index of the last sample
+	std::vector<Layer> layers;
+	int64_t lastBrushed[rules::materialCount] = {};		// brush totals at the last sample given them
+};